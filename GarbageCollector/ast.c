@@ -143,6 +143,7 @@ Node *ast_alloc_identifier(ast_t *ast, const char *name) {
     AST_NODE_DECL(NodeExprIdentifier, EXPR_IDENTIFIER);
     if (node) {
         node->name = arena_strdup(ast->arena, name);
+        node->slot = UNRESOLVED_SLOT;
     }
     return (Node *) node;
 }
@@ -116,9 +116,15 @@ typedef struct NodeExprLiteralSingleton {
 } NodeExprLiteralSingleton;
 
 
+/*! The slot of an identifier that has not been resolved yet. */
+#define UNRESOLVED_SLOT ((size_t) -1)
+
 typedef struct NodeExprIdentifier {
     NodeType type;
     const char *name;
+
+    /*! The index of the global variable named `name`, set by eval_root(). */
+    size_t slot;
 } NodeExprIdentifier;
 
 typedef struct NodeExprNotTest {
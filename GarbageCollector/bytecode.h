@@ -0,0 +1,127 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "eval.h"
+#include "exception.h"
+#include "types.h"
+
+/*!
+ * The instructions of the bytecode interpreter. Instructions work on a stack
+ * of references, each of which owns a reference count. The operands of an
+ * instruction are stored in the words that follow its opcode, and the comment
+ * of each instruction describes them as (operands) and its effect on the
+ * stack as [before -> after].
+ *
+ * This is an "X macro": define OPCODE(name) before using it.
+ */
+#define OPCODES \
+    OPCODE(LOAD_CONST)           /* (constant) [-> value] */ \
+    OPCODE(LOAD_GLOBAL)          /* (slot) [-> value] */ \
+    OPCODE(STORE_GLOBAL)         /* (slot) [value ->] */ \
+    OPCODE(DELETE_GLOBAL)        /* (slot) [->] */ \
+    OPCODE(POP)                  /* [value ->] */ \
+    OPCODE(NOT)                  /* [value -> bool] */ \
+    OPCODE(UNARY)                /* (builtin type) [value -> result] */ \
+    OPCODE(BINARY)               /* (builtin type) [left right -> result] */ \
+    OPCODE(COMPARE)              /* (builtin type) [left right -> bool] */ \
+    OPCODE(EQUALS)               /* [left right -> bool] */ \
+    OPCODE(JUMP)                 /* (target) [->] */ \
+    OPCODE(POP_JUMP_IF_FALSE)    /* (target) [cond ->] */ \
+    OPCODE(JUMP_IF_FALSE_OR_POP) /* (target) [cond -> cond] or [cond ->] */ \
+    OPCODE(JUMP_IF_TRUE_OR_POP)  /* (target) [cond -> cond] or [cond ->] */ \
+    OPCODE(SUBSCR_GET)           /* [obj index -> value] */ \
+    OPCODE(SUBSCR_SET)           /* [value obj index ->] */ \
+    OPCODE(SUBSCR_DEL)           /* [obj index ->] */ \
+    OPCODE(NEW_LIST)             /* (n) [-> list] */ \
+    OPCODE(LIST_STORE)           /* (index) [list value -> list] */ \
+    OPCODE(NEW_DICT)             /* (n) [-> dict] */ \
+    OPCODE(DICT_STORE)           /* [dict key value -> dict] */ \
+    OPCODE(CALL)                 /* (constant, n) [a1 .. an -> result] */ \
+    OPCODE(RAISE)                /* (constant) [->] */ \
+    OPCODE(RETURN)               /* [value ->] */ \
+    OPCODE(RETURN_NONE)          /* [->] */
+
+typedef enum {
+#define OPCODE(name) OP_##name,
+    OPCODES
+#undef OPCODE
+} opcode_t;
+
+/*!
+ * A constant used by an instruction. Which member is used depends on the
+ * instruction that refers to it.
+ */
+typedef union {
+    /*!
+     * For LOAD_CONST, the preloaded value of the literal node. Boxed
+     * integers and strings are made once when the program is compiled, and
+     * the constant holds a reference to its value until code_free(), so
+     * loading it is just an incref.
+     */
+    struct {
+        reference_t ref;
+        Node *literal;
+    } value;
+
+    /*! For CALL, the builtin function to call. */
+    builtin_function_t function;
+
+    /*! For RAISE, the exception to raise, formatted with arg. */
+    struct {
+        exception_t type;
+        const char *format;
+        const char *arg;
+    } error;
+} constant_t;
+
+/*! A compiled program. */
+typedef struct {
+    /*! The instructions, each an opcode followed by its operands. */
+    int32_t *words;
+    size_t length;
+    size_t capacity;
+
+    constant_t *constants;
+    size_t num_constants;
+    size_t max_constants;
+
+    /*! The indices of the constants that hold a reference until code_free(). */
+    size_t *held;
+    size_t num_held;
+    size_t max_held;
+
+    /*! The largest number of references the program keeps on the stack. */
+    size_t max_depth;
+} code_t;
+
+/*!
+ * Compiles an AST whose identifiers have been resolved to global slots.
+ * Returns NULL and sets an exception if there is not enough memory.
+ */
+code_t *compile(Node *root);
+
+/* Frees a compiled program. */
+void code_free(code_t *code);
+
+/*!
+ * Runs a compiled program. Returns a new reference to the value of its
+ * final expression statement, or NULL_REF if there is none or an exception
+ * occurred, like eval_root().
+ */
+reference_t vm_run(code_t *code);
+
+#ifdef DIRECT_REFS
+/*
+ * Call f on the address of each reference that the program being compiled or
+ * run holds, so that a collection can fix it up: the constants' references,
+ * and the interpreter's stack.
+ */
+void foreach_code_root(void (*f)(reference_t *ref));
+void foreach_vm_root(void (*f)(reference_t *ref));
+#endif
+
+#endif /* BYTECODE_H */
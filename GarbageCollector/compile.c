@@ -0,0 +1,520 @@
+/*! \file
+ * Compiles the AST produced by the parser into bytecode for vm.c.
+ *
+ * Each construct is compiled to the instructions that evaluate it the same
+ * way eval.c does: operands are evaluated left to right, and errors that
+ * eval.c raises when it reaches a statement are raised by a RAISE
+ * instruction at the same point of the program.
+ */
+
+#include "bytecode.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "eval_refs.h"
+#include "eval_types.h"
+#include "refs.h"
+
+static void compile_stmt(code_t *code, Node *node, bool keep_result);
+static void compile_expr(code_t *code, Node *node);
+
+/* The current and maximum stack depth while compiling. */
+static size_t depth;
+static size_t max_depth;
+
+/* The code being compiled or run, whose constants' references are roots. */
+static code_t *live_code;
+
+/*!
+ * Grows a dynamic array so it can hold at least one more element.
+ * Returns false and sets an exception if there is not enough memory.
+ */
+static bool grow(void **array, size_t *capacity, size_t used, size_t size) {
+    if (used < *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = *capacity == 0 ? INITIAL_SIZE : *capacity * 2;
+    void *new_array = realloc(*array, new_capacity * size);
+    if (new_array == NULL) {
+        exception_set(EXC_INTERNAL, "allocation of bytecode failed");
+        return false;
+    }
+    *array = new_array;
+    *capacity = new_capacity;
+    return true;
+}
+
+/*! Appends a word to the code. Returns its index. */
+static size_t emit_word(code_t *code, int32_t word) {
+    if (!grow((void **) &code->words, &code->capacity, code->length, sizeof(int32_t))) {
+        return 0;
+    }
+    code->words[code->length] = word;
+    return code->length++;
+}
+
+/*!
+ * Appends an instruction without operands, tracking how many references it
+ * pushes onto the stack (or pops, if stack_effect is negative).
+ */
+static void emit(code_t *code, opcode_t op, int stack_effect) {
+    emit_word(code, op);
+    depth += stack_effect;
+    if (depth > max_depth) {
+        max_depth = depth;
+    }
+}
+
+/*! Appends an instruction with one operand. */
+static void emit_arg(code_t *code, opcode_t op, int32_t arg, int stack_effect) {
+    emit(code, op, stack_effect);
+    emit_word(code, arg);
+}
+
+/*!
+ * Appends a jump instruction whose target is not known yet.
+ * Returns the index of the operand to pass to patch_jump().
+ */
+static size_t emit_jump(code_t *code, opcode_t op, int stack_effect) {
+    emit(code, op, stack_effect);
+    return emit_word(code, -1);
+}
+
+/*! Makes the jump with the given operand go to the end of the code. */
+static void patch_jump(code_t *code, size_t operand) {
+    if (!exception_occurred()) {
+        code->words[operand] = code->length;
+    }
+}
+
+/*! Appends a constant to the code. Returns its index. */
+static int32_t add_constant(code_t *code, constant_t constant) {
+    if (!grow((void **) &code->constants, &code->max_constants,
+              code->num_constants, sizeof(constant_t))) {
+        return 0;
+    }
+    code->constants[code->num_constants] = constant;
+    return code->num_constants++;
+}
+
+/*!
+ * Keeps the reference that the constant at an index holds until code_free().
+ * If the constant could not be added, the reference is released instead.
+ */
+static void hold(code_t *code, int32_t index, reference_t ref) {
+    if (exception_occurred() || !grow((void **) &code->held, &code->max_held,
+                                      code->num_held, sizeof(size_t))) {
+        decref(ref);
+        return;
+    }
+    code->held[code->num_held++] = index;
+}
+
+/*!
+ * Returns a new reference to a held integer with the given value, so that
+ * equal literals share one value, or NULL_REF if there is none yet.
+ */
+static reference_t find_held_int(code_t *code, int64_t value) {
+    for (size_t i = 0; i < code->num_held; i++) {
+        reference_t ref = code->constants[code->held[i]].value.ref;
+        value_t *held = deref(ref);
+        if (held->type == VAL_INTEGER &&
+                ((integer_value_t *) held)->integer_value == value) {
+            incref(ref);
+            return ref;
+        }
+    }
+    return NULL_REF;
+}
+
+/*! Appends an instruction that raises an exception when it is reached. */
+static void emit_raise(code_t *code, exception_t type, const char *format, const char *arg) {
+    constant_t constant = {.error = {.type = type, .format = format, .arg = arg}};
+    emit_arg(code, OP_RAISE, add_constant(code, constant), 0);
+}
+
+/*! Appends an instruction that loads a literal. */
+static void compile_literal(code_t *code, Node *node) {
+    /* Nothing more is allocated once compiling has failed. */
+    if (exception_occurred()) {
+        return;
+    }
+
+    constant_t constant = {.value = {.ref = NULL_REF, .literal = node}};
+
+    /* Tagged integers take no memory from the pool. Other values are made
+     * here, or shared with an equal literal, and each constant holds a
+     * reference to its value for as long as the code exists. */
+    if (node->type == EXPR_LITERAL_SINGLETON) {
+        constant.value.ref = singleton_to_ref(((NodeExprLiteralSingleton *) node)->singleton);
+    } else if (node->type == EXPR_LITERAL_INTEGER) {
+        int64_t value = ((NodeExprLiteralInteger *) node)->value;
+        if (tagged_ints && fits_tagged_int(value)) {
+            constant.value.ref = make_tagged_int(value);
+        } else {
+            constant.value.ref = find_held_int(code, value);
+            if (constant.value.ref == NULL_REF) {
+                constant.value.ref = make_reference_int(value);
+            }
+        }
+    } else if (node->type == EXPR_LITERAL_STRING) {
+        constant.value.ref = make_reference_string(((NodeExprLiteralString *) node)->value);
+    }
+    if (exception_occurred()) {
+        return;
+    }
+
+    int32_t index = add_constant(code, constant);
+    if (is_value_ref(constant.value.ref)) {
+        hold(code, index, constant.value.ref);
+    }
+    emit_arg(code, OP_LOAD_CONST, index, 1);
+}
+
+static void compile_list(code_t *code, NodeList *list) {
+    if (list != NULL) {
+        for (NodeListEntry *entry = list->head; entry; entry = entry->next) {
+            compile_expr(code, entry->node);
+        }
+    }
+}
+
+/*!
+ * Literal lists and dicts are allocated before their elements are evaluated,
+ * as in eval.c, so the pool is laid out the same way by both.
+ */
+static void compile_literal_list(code_t *code, NodeExprLiteralList *list) {
+    size_t length = list->values ? ast_nodelist_length(list->values) : 0;
+    emit_arg(code, OP_NEW_LIST, length, 1);
+    if (list->values) {
+        size_t idx = 0;
+        for (NodeListEntry *entry = list->values->head; entry; entry = entry->next) {
+            compile_expr(code, entry->node);
+            emit_arg(code, OP_LIST_STORE, idx++, -1);
+        }
+    }
+}
+
+static void compile_literal_dict(code_t *code, NodeExprLiteralDict *dict) {
+    size_t length = dict->keys ? ast_nodelist_length(dict->keys) : 0;
+    emit_arg(code, OP_NEW_DICT, length, 1);
+    if (dict->keys) {
+        NodeListEntry *key_entry = dict->keys->head;
+        NodeListEntry *value_entry = dict->values->head;
+        while (key_entry && value_entry) {
+            compile_expr(code, key_entry->node);
+            compile_expr(code, value_entry->node);
+            emit(code, OP_DICT_STORE, -2);
+            key_entry = key_entry->next;
+            value_entry = value_entry->next;
+        }
+    }
+}
+
+static void compile_builtin(code_t *code, NodeExprBuiltin *builtin) {
+    compile_expr(code, builtin->left);
+    if (builtin->right == NULL) {
+        emit_arg(code, OP_UNARY, builtin->builtin_type, 0);
+        return;
+    }
+
+    compile_expr(code, builtin->right);
+    if (builtin->builtin_type == COMP_EQUALS) {
+        emit(code, OP_EQUALS, -1);
+    } else if (builtin->builtin_type > COMP_EQUALS) {
+        emit_arg(code, OP_COMPARE, builtin->builtin_type, -1);
+    } else {
+        emit_arg(code, OP_BINARY, builtin->builtin_type, -1);
+    }
+}
+
+static void compile_call(code_t *code, NodeExprCall *call) {
+    if (call->func->type != EXPR_IDENTIFIER) {
+        /* RAISE never falls through, but count the call's result anyway. */
+        emit_raise(code, EXC_SYNTAX_ERROR, "calling non-identifiers not supported", NULL);
+        depth++;
+        return;
+    }
+
+    size_t arity = call->args ? ast_nodelist_length(call->args) : 0;
+    compile_list(code, call->args);
+
+    const char *name = ((NodeExprIdentifier *) call->func)->name;
+    builtin_function_t function = find_builtin(name);
+    if (function == NULL) {
+        /* The arguments are still evaluated first, as eval.c does. */
+        emit_raise(code, EXC_NAME_ERROR, "no such function '%s'", name);
+        depth = depth - arity + 1;
+        return;
+    }
+
+    constant_t constant = {.function = function};
+    emit_arg(code, OP_CALL, add_constant(code, constant), 1 - (int) arity);
+    emit_word(code, arity);
+}
+
+/*! Compiles an expression, leaving a new reference to its value on the stack. */
+static void compile_expr(code_t *code, Node *node) {
+    assert(node != NULL);
+    size_t jump;
+
+    switch (node->type) {
+        case EXPR_LITERAL_STRING:
+        case EXPR_LITERAL_INTEGER:
+        case EXPR_LITERAL_SINGLETON:
+            compile_literal(code, node);
+            break;
+
+        case EXPR_LITERAL_LIST:
+            compile_literal_list(code, (NodeExprLiteralList *) node);
+            break;
+        case EXPR_LITERAL_DICT:
+            compile_literal_dict(code, (NodeExprLiteralDict *) node);
+            break;
+
+        case EXPR_IDENTIFIER:
+            emit_arg(code, OP_LOAD_GLOBAL, ((NodeExprIdentifier *) node)->slot, 1);
+            break;
+
+        case EXPR_NOT_TEST:
+            compile_expr(code, ((NodeExprNotTest *) node)->operand);
+            emit(code, OP_NOT, 0);
+            break;
+        case EXPR_AND_TEST:
+            compile_expr(code, ((NodeExprAndTest *) node)->left);
+            jump = emit_jump(code, OP_JUMP_IF_FALSE_OR_POP, -1);
+            compile_expr(code, ((NodeExprAndTest *) node)->right);
+            patch_jump(code, jump);
+            break;
+        case EXPR_OR_TEST:
+            compile_expr(code, ((NodeExprOrTest *) node)->left);
+            jump = emit_jump(code, OP_JUMP_IF_TRUE_OR_POP, -1);
+            compile_expr(code, ((NodeExprOrTest *) node)->right);
+            patch_jump(code, jump);
+            break;
+
+        case EXPR_BUILTIN:
+            compile_builtin(code, (NodeExprBuiltin *) node);
+            break;
+        case EXPR_CALL:
+            compile_call(code, (NodeExprCall *) node);
+            break;
+        case EXPR_SUBSCRIPT:
+            compile_expr(code, ((NodeExprSubscript *) node)->obj);
+            compile_expr(code, ((NodeExprSubscript *) node)->index);
+            emit(code, OP_SUBSCR_GET, -1);
+            break;
+
+        default:
+            emit_raise(code, EXC_INTERNAL, "ast node type not implemented", NULL);
+            depth++;
+            break;
+    }
+}
+
+static void compile_assign(code_t *code, NodeStmtAssign *assign) {
+    switch (assign->left->type) {
+        case EXPR_LITERAL_STRING:
+        case EXPR_LITERAL_INTEGER:
+        case EXPR_LITERAL_FLOAT:
+        case EXPR_LITERAL_SINGLETON:
+            emit_raise(code, EXC_SYNTAX_ERROR, "can't assign to literal", NULL);
+            break;
+
+        case EXPR_LITERAL_DICT:
+        case EXPR_LITERAL_LIST:
+            emit_raise(code, EXC_SYNTAX_ERROR, "assignment destructuring not implemented", NULL);
+            break;
+
+        case EXPR_IDENTIFIER:
+            compile_expr(code, assign->right);
+            emit_arg(code, OP_STORE_GLOBAL, ((NodeExprIdentifier *) assign->left)->slot, -1);
+            break;
+
+        case EXPR_NOT_TEST:
+        case EXPR_AND_TEST:
+        case EXPR_OR_TEST:
+        case EXPR_BUILTIN:
+            emit_raise(code, EXC_SYNTAX_ERROR, "can't assign to operator", NULL);
+            break;
+
+        case EXPR_CALL:
+            emit_raise(code, EXC_SYNTAX_ERROR, "can't assign to function call", NULL);
+            break;
+
+        case EXPR_SUBSCRIPT: {
+            NodeExprSubscript *subscript = (NodeExprSubscript *) assign->left;
+            compile_expr(code, assign->right);
+            compile_expr(code, subscript->obj);
+            compile_expr(code, subscript->index);
+            emit(code, OP_SUBSCR_SET, -3);
+            break;
+        }
+
+        default:
+            emit_raise(code, EXC_INTERNAL, "assignment target node type not implemented", NULL);
+            break;
+    }
+}
+
+static void compile_del(code_t *code, NodeStmtDel *del) {
+    switch (del->arg->type) {
+        case EXPR_LITERAL_STRING:
+        case EXPR_LITERAL_INTEGER:
+        case EXPR_LITERAL_FLOAT:
+        case EXPR_LITERAL_SINGLETON:
+            emit_raise(code, EXC_SYNTAX_ERROR, "can't delete literal", NULL);
+            break;
+
+        case EXPR_LITERAL_DICT:
+        case EXPR_LITERAL_LIST:
+            emit_raise(code, EXC_SYNTAX_ERROR, "deletion destructuring not implemented", NULL);
+            break;
+
+        case EXPR_IDENTIFIER:
+            emit_arg(code, OP_DELETE_GLOBAL, ((NodeExprIdentifier *) del->arg)->slot, 0);
+            break;
+
+        case EXPR_NOT_TEST:
+        case EXPR_AND_TEST:
+        case EXPR_OR_TEST:
+        case EXPR_BUILTIN:
+            emit_raise(code, EXC_SYNTAX_ERROR, "can't delete operator", NULL);
+            break;
+
+        case EXPR_CALL:
+            emit_raise(code, EXC_SYNTAX_ERROR, "can't delete function call", NULL);
+            break;
+
+        case EXPR_SUBSCRIPT: {
+            NodeExprSubscript *subscript = (NodeExprSubscript *) del->arg;
+            compile_expr(code, subscript->obj);
+            compile_expr(code, subscript->index);
+            emit(code, OP_SUBSCR_DEL, -2);
+            break;
+        }
+
+        default:
+            emit_raise(code, EXC_INTERNAL, "deletion target node type not implemented", NULL);
+            break;
+    }
+}
+
+/*!
+ * Compiles a statement. If keep_result is set and the statement is an
+ * expression (or a sequence ending in one), its value is returned from the
+ * program, like eval_root() does. Otherwise it is discarded.
+ */
+static void compile_stmt(code_t *code, Node *node, bool keep_result) {
+    assert(node != NULL);
+    size_t jump, end;
+
+    switch (node->type) {
+        case STMT_SEQUENCE:
+            for (NodeListEntry *entry = ((NodeStmtSequence *) node)->statements->head;
+                 entry; entry = entry->next) {
+                compile_stmt(code, entry->node, keep_result && entry->next == NULL);
+            }
+            break;
+
+        case STMT_ASSIGN:
+            compile_assign(code, (NodeStmtAssign *) node);
+            break;
+
+        case STMT_DEL:
+            compile_del(code, (NodeStmtDel *) node);
+            break;
+
+        case STMT_IF: {
+            NodeStmtIf *ifn = (NodeStmtIf *) node;
+            compile_expr(code, ifn->cond);
+            jump = emit_jump(code, OP_POP_JUMP_IF_FALSE, -1);
+            compile_stmt(code, ifn->left, false);
+            if (ifn->right) {
+                end = emit_jump(code, OP_JUMP, 0);
+                patch_jump(code, jump);
+                compile_stmt(code, ifn->right, false);
+                patch_jump(code, end);
+            } else {
+                patch_jump(code, jump);
+            }
+            break;
+        }
+
+        case STMT_WHILE: {
+            NodeStmtWhile *whilen = (NodeStmtWhile *) node;
+            size_t start = code->length;
+            compile_expr(code, whilen->cond);
+            end = emit_jump(code, OP_POP_JUMP_IF_FALSE, -1);
+            compile_stmt(code, whilen->body, false);
+            emit_arg(code, OP_JUMP, start, 0);
+            patch_jump(code, end);
+            break;
+        }
+
+        default:
+            /* Anything else is an expression statement. */
+            compile_expr(code, node);
+            if (keep_result) {
+                emit(code, OP_RETURN, -1);
+            } else {
+                emit(code, OP_POP, -1);
+            }
+            break;
+    }
+}
+
+code_t *compile(Node *root) {
+    code_t *code = calloc(1, sizeof(code_t));
+    if (code == NULL) {
+        exception_set(EXC_INTERNAL, "allocation of bytecode failed");
+        return NULL;
+    }
+    live_code = code;
+
+    depth = 0;
+    max_depth = 0;
+    compile_stmt(code, root, true);
+    emit(code, OP_RETURN_NONE, 0);
+    code->max_depth = max_depth;
+
+    if (exception_occurred()) {
+        code_free(code);
+        return NULL;
+    }
+    assert(depth == 0);
+    return code;
+}
+
+void code_free(code_t *code) {
+    if (code == live_code) {
+        live_code = NULL;
+    }
+    for (size_t i = 0; i < code->num_held; i++) {
+        decref(code->constants[code->held[i]].value.ref);
+    }
+    free(code->held);
+    free(code->words);
+    free(code->constants);
+    free(code);
+}
+
+#ifdef DIRECT_REFS
+
+/*!
+ * Calls f on the address of each reference that the constants of the live
+ * code hold, so that a collection can fix it up.
+ */
+void foreach_code_root(void (*f)(reference_t *ref)) {
+    if (live_code == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < live_code->num_held; i++) {
+        f(&live_code->constants[live_code->held[i]].value.ref);
+    }
+}
+
+#endif /* DIRECT_REFS */
@@ -25,4 +25,10 @@
 
 extern bool interactive;
 
+/*! Whether small integers are stored directly in references, see refs.h. */
+extern bool tagged_ints;
+
+/*! Whether to evaluate the AST directly instead of compiling it to bytecode. */
+extern bool ast_eval;
+
 #endif /* CONFIG_H */
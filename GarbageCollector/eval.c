@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "ast.h"
+#include "bytecode.h"
 #include "config.h"
 #include "eval_dict.h"
 #include "eval_types.h"
@@ -13,7 +14,12 @@
 #include "mm.h"
 #include "refs.h"
 
-/* Global variable information. */
+/*
+ * Global variable information. Each name that is ever used gets a slot in
+ * global_vars, which it keeps even when the variable is deleted, so that
+ * identifiers can be resolved to slot indices before they are evaluated.
+ * Unbound variables have a ref of NULL_REF.
+ */
 
 typedef struct {
     char *name;
@@ -24,14 +30,27 @@ static global_variable_t *global_vars = NULL;
 static size_t num_vars = 0;
 static size_t max_vars = 0;
 
+/* The number of slots with a bound variable. */
+static size_t num_bound = 0;
+
+/*
+ * An open-addressing hash table from names to slots, for looking up
+ * names that are not resolved ahead of time. Empty entries are
+ * UNRESOLVED_SLOT, and the capacity is a power of two.
+ */
+static size_t *global_index = NULL;
+static size_t index_capacity = 0;
+
 //////////// EVALUATION ENGINE ////////////
 
 
 //// GLOBAL VARIABLES ////
 
-static reference_t globals_get(const char *name);
-static void globals_set(const char *name, reference_t value);
-static void globals_delete(const char *name);
+static size_t globals_resolve(const char *name);
+
+//// NAME RESOLUTION ////
+
+static void resolve_node(Node *node);
 
 //// AST EVALUATION FUNCTIONS ////
 
@@ -63,19 +82,24 @@ static reference_t eval_literal_dict(NodeExprLiteralDict *dist);
  *  None, True and False, which are tied to to respective names and cannot
  *  be deleted. */
 void eval_init() {
+    /* With DIRECT_REFS, the singletons' references change when they move, so
+     * the variables that hold them stay registered for good. */
     NONE_REF  = make_reference_none();
+    ROOT(NONE_REF);
     TRUE_REF  = make_reference_bool();
+    ROOT(TRUE_REF);
     FALSE_REF = make_reference_bool();
+    ROOT(FALSE_REF);
     if (exception_occurred()) {
         fprintf(stderr, "Failed to initialize evaluator\n");
         abort();
     }
 
-    globals_set("None", NONE_REF);
+    globals_set(globals_resolve("None"), NONE_REF);
     decref(NONE_REF);
-    globals_set("True", TRUE_REF);
+    globals_set(globals_resolve("True"), TRUE_REF);
     decref(TRUE_REF);
-    globals_set("False", FALSE_REF);
+    globals_set(globals_resolve("False"), FALSE_REF);
     decref(FALSE_REF);
 
     eval_types_init();
@@ -83,8 +107,23 @@ void eval_init() {
 
 /*! Entry point to the evaluation system. */
 reference_t eval_root(Node *root) {
-    /* Perform the full computation, starting at the root of the AST. */
-    reference_t result = eval_stmt(root);
+    /* Resolve identifiers to global slots first, so evaluating them is just
+     * an array access. Then perform the full computation, starting at the
+     * root of the AST. */
+    reference_t result = NULL_REF;
+    resolve_node(root);
+    if (exception_occurred()) {
+        /* Nothing to run. */
+    } else if (ast_eval) {
+        result = eval_stmt(root);
+    } else {
+        /* Unless asked to walk the AST, compile it to bytecode and run that. */
+        code_t *code = compile(root);
+        if (code != NULL) {
+            result = vm_run(code);
+            code_free(code);
+        }
+    }
 
     /* Sanitize a NULL_REF, which usually represents no result or that an
      * exception occured into a None. */
@@ -174,7 +213,7 @@ static void eval_stmt_assign(NodeStmtAssign *assign) {
         case EXPR_IDENTIFIER: {
             reference_t right = eval_expr(assign->right);
             if (!exception_occurred()) {
-                globals_set(((NodeExprIdentifier *) assign->left)->name, right);
+                globals_set(((NodeExprIdentifier *) assign->left)->slot, right);
                 decref(right);
             }
             break;
@@ -196,15 +235,21 @@ static void eval_stmt_assign(NodeStmtAssign *assign) {
 
             reference_t right = eval_expr(assign->right);
             if (!exception_occurred()) {
+                ROOT(right);
                 reference_t target = eval_expr(subscript->obj);
                 if (!exception_occurred()) {
+                    ROOT(target);
                     reference_t index = eval_expr(subscript->index);
                     if (!exception_occurred()) {
+                        ROOT(index);
                         ref_subscr_set(target, index, right);
+                        UNROOT(1);
                         decref(index);
                     }
+                    UNROOT(1);
                     decref(target);
                 }
+                UNROOT(1);
                 decref(right);
             }
 
@@ -236,7 +281,7 @@ static void eval_stmt_del(NodeStmtDel *del) {
             break;
 
         case EXPR_IDENTIFIER:
-            globals_delete(((NodeExprIdentifier *) del->arg)->name);
+            globals_delete(((NodeExprIdentifier *) del->arg)->slot);
             break;
 
         case EXPR_NOT_TEST:
@@ -256,7 +301,9 @@ static void eval_stmt_del(NodeStmtDel *del) {
 
             reference_t target = eval_expr(subscript->obj);
             if (!exception_occurred()) {
+                ROOT(target);
                 reference_t index = eval_expr(subscript->index);
+                UNROOT(1);
                 if (!exception_occurred()) {
                     ref_subscr_del(target, index);
                     decref(index);
@@ -361,7 +408,7 @@ static reference_t eval_expr(Node *node) {
 
 static reference_t eval_identifier(NodeExprIdentifier *ident) {
     /* Push the loaded reference onto the stack. */
-    return globals_get(ident->name);
+    return globals_get(ident->slot);
 }
 
 static reference_t eval_not_test(NodeExprNotTest *test) {
@@ -427,9 +474,11 @@ static reference_t eval_builtin(NodeExprBuiltin *builtin) {
     /* If this builtin is unary then the right operand will be NULL and we just
      * set the right operand to be the same as the left for simplicity. */
     reference_t right;
+    ROOT(left);
     if (builtin->right) {
         right = eval_expr(builtin->right);
         if (exception_occurred()) {
+            UNROOT(1);
             decref(left);
             return NULL_REF;
         }
@@ -437,6 +486,7 @@ static reference_t eval_builtin(NodeExprBuiltin *builtin) {
         incref(left);
         right = left;
     }
+    ROOT(right);
 
     /* Then, once we have the operands, we can dispatch to the particular
      * types being operated on. */
@@ -448,6 +498,7 @@ static reference_t eval_builtin(NodeExprBuiltin *builtin) {
         result = (type > COMP_EQUALS ? ref_compare : ref_builtin)(type, left, right);
     }
 
+    UNROOT(2);
     decref(left);
     decref(right);
     return result;
@@ -460,7 +511,9 @@ static reference_t eval_subscript(NodeExprSubscript *subscript) {
         return NULL_REF;
     }
 
+    ROOT(target);
     reference_t index = eval_expr(subscript->index);
+    UNROOT(1);
     if (exception_occurred()) {
         decref(target);
         return NULL_REF;
@@ -483,10 +536,11 @@ static reference_t eval_literal_list(NodeExprLiteralList *list) {
     if (exception_occurred()) {
         return NULL_REF;
     }
-    ref_array_value_t *val_array = (ref_array_value_t *) deref(ref_array);
 
     /* Then create a new list. */
+    ROOT(ref_array);
     reference_t ref_list = make_reference_list();
+    UNROOT(1);
     if (exception_occurred()) {
         decref(ref_array);
         return NULL_REF;
@@ -497,14 +551,23 @@ static reference_t eval_literal_list(NodeExprLiteralList *list) {
 
     /* Then compute and store the elements. */
     if (list->values) {
+        ROOT(ref_list);
         size_t idx = 0;
         for (NodeListEntry *entry = list->values->head; entry; entry = entry->next) {
-            val_array->values[idx++] = eval_expr(entry->node);
+            /* Evaluating the element may move the list and the array, so look
+             * them up after. Lists don't hold string builders, so flatten it
+             * first. */
+            reference_t element = eval_expr(entry->node);
+            string_flatten(element);
+            ref_array = ((list_value_t *) deref(ref_list))->values;
+            ((ref_array_value_t *) deref(ref_array))->values[idx++] = element;
             if (exception_occurred()) {
+                UNROOT(1);
                 decref(ref_list);
                 return NULL_REF;
             }
         }
+        UNROOT(1);
     }
 
     /* If all is well, then we have a new list. */
@@ -515,55 +578,35 @@ static reference_t eval_literal_dict(NodeExprLiteralDict *dict) {
     /* First figure out the number of elements. */
     size_t length = dict->keys ? ast_nodelist_length(dict->keys) : 0;
 
-    /* Initial capacity should be twice the number of elements, minimum 16. */
-    size_t capacity = length * 2;
-    if (capacity < 16) {
-        capacity = 16;
-    }
-
-    /* Then allocate space for the key references. */
-    reference_t ref_key_array = make_reference_refarray(capacity);
-    if (exception_occurred()) {
-        return NULL_REF;
-    }
-
-    /* Then allocate space for the value references. */
-    reference_t ref_value_array = make_reference_refarray(capacity);
-    if (exception_occurred()) {
-        decref(ref_key_array);
-        return NULL_REF;
-    }
-
-    /* Then create a new dict. */
-    reference_t ref_dict = make_reference_dict();
+    /* Then create a new dict with room for them. */
+    reference_t ref_dict = dict_new(length);
     if (exception_occurred()) {
-        decref(ref_value_array);
-        decref(ref_key_array);
         return NULL_REF;
     }
-    dict_value_t *val_dict = (dict_value_t *) deref(ref_dict);
-    val_dict->keys = ref_key_array;
-    val_dict->values = ref_value_array;
-    val_dict->size = 0;
-    val_dict->occupied = 0;
 
     /* Then compute and store the elements. */
     if (dict->keys) {
         NodeListEntry *key_entry = dict->keys->head;
         NodeListEntry *value_entry = dict->values->head;
 
+        ROOT(ref_dict);
         while (key_entry && value_entry) {
             reference_t key = eval_expr(key_entry->node);
             if (!exception_occurred()) {
+                ROOT(key);
                 reference_t value = eval_expr(value_entry->node);
                 if (!exception_occurred()) {
-                    dict_subscr_set((value_t *) val_dict, key, value);
+                    ROOT(value);
+                    dict_subscr_set(ref_dict, key, value);
+                    UNROOT(1);
                     decref(value);
                 }
+                UNROOT(1);
                 decref(key);
             }
 
             if (exception_occurred()) {
+                UNROOT(1);
                 decref(ref_dict);
                 return NULL_REF;
             }
@@ -571,6 +614,7 @@ static reference_t eval_literal_dict(NodeExprLiteralDict *dict) {
             key_entry = key_entry->next;
             value_entry = value_entry->next;
         }
+        UNROOT(1);
     }
 
     return ref_dict;
@@ -586,7 +630,8 @@ static reference_t eval_call_exit(size_t arity, reference_t *args) {
     int code = 0;
     if (arity == 1) {
         reference_t code_reference = args[0];
-        value_t *code_value = deref(code_reference);
+        integer_value_t box;
+        value_t *code_value = deref_boxed(code_reference, &box);
 
         if (code_value->type == VAL_INTEGER) {
             code = ((integer_value_t *) code_value)->integer_value;
@@ -630,6 +675,106 @@ static reference_t eval_call_gc(size_t arity, reference_t *args) {
     return NONE_REF;
 }
 
+/*!
+ * Stores value in dict under the given key, for gc_stats(). The reference to
+ * value is used up. Does nothing if value is NULL_REF because making it failed.
+ */
+static void stats_set(reference_t dict, const char *key, reference_t value) {
+    if (value == NULL_REF) {
+        return;
+    }
+    ROOT(dict);
+    ROOT(value);
+    reference_t key_ref = make_reference_string(key);
+    if (!exception_occurred()) {
+        ROOT(key_ref);
+        dict_subscr_set(dict, key_ref, value);
+        UNROOT(1);
+        decref(key_ref);
+    }
+    UNROOT(2);
+    decref(value);
+}
+
+/*! Stores an integer in dict, unless an exception has occurred already. */
+static void stats_set_int(reference_t dict, const char *key, size_t value) {
+    if (!exception_occurred()) {
+        ROOT(dict);
+        reference_t ref = make_reference_int(value);
+        UNROOT(1);
+        stats_set(dict, key, ref);
+    }
+}
+
+/*!
+ * Makes a dict of the number or the bytes of the values of each type in
+ * memory, unless an exception has occurred already.
+ */
+static reference_t stats_by_type(size_t *counts) {
+    if (exception_occurred()) {
+        return NULL_REF;
+    }
+    reference_t dict = dict_new(0);
+    ROOT(dict);
+    for (value_type_t type = 0; type < VAL_FREE; type++) {
+        if (counts[type] > 0) {
+            stats_set_int(dict, gc_stats_type_name(type), counts[type]);
+        }
+    }
+    UNROOT(1);
+    return dict;
+}
+
+static reference_t eval_call_gc_stats(size_t arity, reference_t *args) {
+    (void) args;
+
+    if (arity > 0) {
+        exception_set_format(EXC_TYPE_ERROR,
+                "gc_stats() takes 0 positional arguments but %d were given", arity);
+        return NULL_REF;
+    }
+
+    /* Take the statistics before the dict's allocations change them. */
+    gc_stats_t stats;
+    get_gc_stats(&stats);
+    size_t rate = stats.elapsed_ns == 0 ? 0 :
+        (size_t) (stats.bytes_allocated * 1e9 / stats.elapsed_ns);
+
+    reference_t dict = dict_new(18);
+    if (exception_occurred()) {
+        return NULL_REF;
+    }
+    ROOT(dict);
+    stats_set_int(dict, "collections", stats.full_collections);
+    stats_set_int(dict, "minor_collections", stats.minor_collections);
+    stats_set_int(dict, "incremental_cycles", stats.incremental_cycles);
+    stats_set_int(dict, "cycle_collections", stats.cycle_collections);
+    stats_set_int(dict, "pauses", stats.pauses);
+    stats_set_int(dict, "pause_total_us", stats.total_pause_ns / 1000);
+    stats_set_int(dict, "pause_max_us", stats.longest_pause_ns / 1000);
+    stats_set_int(dict, "bytes_allocated", stats.bytes_allocated);
+    stats_set_int(dict, "allocation_rate", rate);
+    stats_set_int(dict, "bytes_copied", stats.bytes_copied);
+    stats_set_int(dict, "survival_percent", stats.last_survival);
+    stats_set_int(dict, "mean_survival_percent", stats.mean_survival);
+    stats_set_int(dict, "pool_size", stats.pool_size);
+    stats_set_int(dict, "max_pool_size", stats.max_pool_size);
+    stats_set_int(dict, "refs", stats.refs);
+    stats_set_int(dict, "free_refs", stats.free_refs);
+    /* The dicts are made first, since making them may move dict. */
+    reference_t live = stats_by_type(stats.live_values);
+    stats_set(dict, "live", live);
+    reference_t live_bytes = stats_by_type(stats.live_bytes);
+    stats_set(dict, "live_bytes", live_bytes);
+
+    UNROOT(1);
+    if (exception_occurred()) {
+        decref(dict);
+        return NULL_REF;
+    }
+    return dict;
+}
+
 static reference_t eval_call_print(size_t arity, reference_t *args) {
     if (arity > 0) {
         ref_print(args[0], stdout, MAX_DEPTH);
@@ -665,6 +810,27 @@ static reference_t eval_call_bool(size_t arity, reference_t *args) {
     return bool_ref(ref_bool(args[0]));
 }
 
+builtin_function_t find_builtin(const char *name) {
+    /* For the time being, it's enough to just hardcode the list of available
+     * functions. */
+    if (strcmp(name, "exit") == 0 || strcmp(name, "quit") == 0) {
+        return eval_call_exit;
+    } else if (strcmp(name, "mem") == 0) {
+        return eval_call_mem;
+    } else if (strcmp(name, "gc") == 0) {
+        return eval_call_gc;
+    } else if (strcmp(name, "gc_stats") == 0) {
+        return eval_call_gc_stats;
+    } else if (strcmp(name, "print") == 0) {
+        return eval_call_print;
+    } else if (strcmp(name, "len") == 0) {
+        return eval_call_len;
+    } else if (strcmp(name, "bool") == 0) {
+        return eval_call_bool;
+    }
+    return NULL;
+}
+
 static reference_t eval_call(NodeExprCall *node) {
     /* First check to ensure this is a valid function call. */
     if (node->func->type != EXPR_IDENTIFIER) {
@@ -683,33 +849,22 @@ static reference_t eval_call(NodeExprCall *node) {
             if (exception_occurred()) {
                 break;
             }
+            ROOT(args[idx]);
         }
     }
 
     reference_t result = NULL_REF;
     if (!exception_occurred()) {
         const char *name = ((NodeExprIdentifier *) node->func)->name;
-
-        /* For the time being, it's enough to just hardcode the list of available
-         * functions. */
-        if (strcmp(name, "exit") == 0 || strcmp(name, "quit") == 0) {
-            result = eval_call_exit(arity, args);
-        } else if (strcmp(name, "mem") == 0) {
-            result = eval_call_mem(arity, args);
-        } else if (strcmp(name, "gc") == 0) {
-            result = eval_call_gc(arity, args);
-        } else if (strcmp(name, "print") == 0) {
-            result = eval_call_print(arity, args);
-        } else if (strcmp(name, "len") == 0) {
-            result = eval_call_len(arity, args);
-        } else if (strcmp(name, "bool") == 0) {
-            result = eval_call_bool(arity, args);
+        builtin_function_t function = find_builtin(name);
+        if (function != NULL) {
+            result = function(arity, args);
         } else {
-            result = NULL_REF;
             exception_set_format(EXC_NAME_ERROR, "no such function '%s'", name);
         }
     }
 
+    UNROOT(idx);
     for (size_t ridx = 0; ridx < idx; ridx++) {
         decref(args[idx - ridx - 1]);
     }
@@ -717,80 +872,228 @@ static reference_t eval_call(NodeExprCall *node) {
     return result;
 }
 
-//// GLOBAL VAR FUNCTIONS ////
+//// NAME RESOLUTION ////
+
+static void resolve_nodelist(NodeList *list) {
+    if (list == NULL) {
+        return;
+    }
+    for (NodeListEntry *entry = list->head; entry; entry = entry->next) {
+        resolve_node(entry->node);
+    }
+}
 
 /*!
- * Tries to retrieve a global variable's reference. The returned reference is
- * a new reference to the stored value.
+ * Walks an AST and sets the slot of every identifier that names a global
+ * variable. Function names in calls are builtins, so they are left alone.
  */
-static reference_t globals_get(const char *name) {
-    if (global_vars != NULL) {
-        for (size_t i = 0; i < num_vars; i++) {
-            if (global_vars[i].name != NULL && strcmp(name, global_vars[i].name) == 0) {
-                incref(global_vars[i].ref);
-                return global_vars[i].ref;
+static void resolve_node(Node *node) {
+    if (node == NULL || exception_occurred()) {
+        return;
+    }
+
+    switch (node->type) {
+        case STMT_SEQUENCE:
+            resolve_nodelist(((NodeStmtSequence *) node)->statements);
+            break;
+        case STMT_ASSIGN:
+            resolve_node(((NodeStmtAssign *) node)->left);
+            resolve_node(((NodeStmtAssign *) node)->right);
+            break;
+        case STMT_DEL:
+            resolve_node(((NodeStmtDel *) node)->arg);
+            break;
+        case STMT_IF:
+            resolve_node(((NodeStmtIf *) node)->cond);
+            resolve_node(((NodeStmtIf *) node)->left);
+            resolve_node(((NodeStmtIf *) node)->right);
+            break;
+        case STMT_WHILE:
+            resolve_node(((NodeStmtWhile *) node)->cond);
+            resolve_node(((NodeStmtWhile *) node)->body);
+            break;
+
+        case EXPR_LITERAL_LIST:
+            resolve_nodelist(((NodeExprLiteralList *) node)->values);
+            break;
+        case EXPR_LITERAL_DICT:
+            resolve_nodelist(((NodeExprLiteralDict *) node)->keys);
+            resolve_nodelist(((NodeExprLiteralDict *) node)->values);
+            break;
+
+        case EXPR_IDENTIFIER: {
+            NodeExprIdentifier *ident = (NodeExprIdentifier *) node;
+            if (ident->slot == UNRESOLVED_SLOT) {
+                ident->slot = globals_resolve(ident->name);
             }
+            break;
         }
+
+        case EXPR_NOT_TEST:
+            resolve_node(((NodeExprNotTest *) node)->operand);
+            break;
+        case EXPR_AND_TEST:
+            resolve_node(((NodeExprAndTest *) node)->left);
+            resolve_node(((NodeExprAndTest *) node)->right);
+            break;
+        case EXPR_OR_TEST:
+            resolve_node(((NodeExprOrTest *) node)->left);
+            resolve_node(((NodeExprOrTest *) node)->right);
+            break;
+        case EXPR_BUILTIN:
+            resolve_node(((NodeExprBuiltin *) node)->left);
+            resolve_node(((NodeExprBuiltin *) node)->right);
+            break;
+        case EXPR_CALL:
+            resolve_nodelist(((NodeExprCall *) node)->args);
+            break;
+        case EXPR_SUBSCRIPT:
+            resolve_node(((NodeExprSubscript *) node)->obj);
+            resolve_node(((NodeExprSubscript *) node)->index);
+            break;
+
+        default:
+            break;
     }
+}
 
-    exception_set_format(EXC_NAME_ERROR, "name '%s' is not defined", name);
-    return NULL_REF;
+//// GLOBAL VAR FUNCTIONS ////
+
+/*! Hashes a variable name. Adapted from Java's String.hashCode(). */
+static uint64_t hash_name(const char *name) {
+    uint64_t hash = 1125899906842597UL; // prime
+    for (const char *sp = name; *sp; sp++) {
+        hash = 31 * hash + *sp;
+    }
+    return hash;
 }
 
-/*! Tries to set a global variable's reference, creating it if it does not exist. */
-static void globals_set(const char *name, reference_t value) {
-    /* Look for the existing variable in the globals array. */
-    for (size_t i = 0; i < num_vars; i++) {
-        if (global_vars[i].name != NULL && strcmp(name, global_vars[i].name) == 0) {
-            decref(global_vars[i].ref);
-            incref(value);
-            global_vars[i].ref = value;
-            return;
+/*! Returns the index entry for a name: either its slot, or an empty entry. */
+static size_t *global_index_find(const char *name) {
+    size_t mask = index_capacity - 1;
+    for (size_t idx = hash_name(name) & mask; ; idx = (idx + 1) & mask) {
+        size_t slot = global_index[idx];
+        if (slot == UNRESOLVED_SLOT || strcmp(name, global_vars[slot].name) == 0) {
+            return &global_index[idx];
         }
     }
+}
+
+/*! Rebuilds the name index with room for at least twice the slots. */
+static bool global_index_grow(void) {
+    size_t capacity = index_capacity == 0 ? INITIAL_SIZE * 2 : index_capacity * 2;
+    size_t *index = malloc(sizeof(size_t[capacity]));
+    if (index == NULL) {
+        exception_set(EXC_INTERNAL, "allocation of global variable index failed");
+        return false;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        index[i] = UNRESOLVED_SLOT;
+    }
+
+    free(global_index);
+    global_index = index;
+    index_capacity = capacity;
+    for (size_t slot = 0; slot < num_vars; slot++) {
+        *global_index_find(global_vars[slot].name) = slot;
+    }
+    return true;
+}
+
+/*!
+ * Returns the slot of the global variable with the given name, creating an
+ * unbound one if the name has never been used. Returns UNRESOLVED_SLOT and
+ * sets an exception if the globals could not be grown.
+ */
+static size_t globals_resolve(const char *name) {
+    /* Keep the index at most half full, so probe sequences stay short. */
+    if ((num_vars + 1) * 2 > index_capacity && !global_index_grow()) {
+        return UNRESOLVED_SLOT;
+    }
+
+    size_t *entry = global_index_find(name);
+    if (*entry != UNRESOLVED_SLOT) {
+        return *entry;
+    }
 
     /* If we are out of space, increase the size of the globals array. */
     if (num_vars == max_vars) {
         /* Double its size (the JVM internal source said this
          * was a good resizing semantic, don't sue me!), and zero it out. */
-        max_vars = max_vars == 0 ? INITIAL_SIZE : max_vars * 2;
-        global_vars = realloc(global_vars, sizeof(global_variable_t[max_vars]));
-        if (global_vars == NULL) {
+        size_t new_max = max_vars == 0 ? INITIAL_SIZE : max_vars * 2;
+        global_variable_t *vars = realloc(global_vars, sizeof(global_variable_t[new_max]));
+        if (vars == NULL) {
             exception_set(EXC_INTERNAL, "allocation of global variable array failed");
-            return;
+            return UNRESOLVED_SLOT;
         }
+        global_vars = vars;
+        max_vars = new_max;
     }
 
-    /* Add the new variable to the end of the globals array. */
+    /* Add the new, unbound variable to the end of the globals array. */
     global_vars[num_vars].name = strdup(name);
+    global_vars[num_vars].ref = NULL_REF;
+    *entry = num_vars;
+    return num_vars++;
+}
+
+/*!
+ * Tries to retrieve a global variable's reference. The returned reference is
+ * a new reference to the stored value.
+ */
+reference_t globals_get(size_t slot) {
+    assert(slot < num_vars);
+    reference_t ref = global_vars[slot].ref;
+    if (ref == NULL_REF) {
+        exception_set_format(EXC_NAME_ERROR, "name '%s' is not defined",
+                global_vars[slot].name);
+        return NULL_REF;
+    }
+
+    incref(ref);
+    return ref;
+}
+
+/*! Sets a global variable's reference, binding it if it is unbound. */
+void globals_set(size_t slot, reference_t value) {
+    assert(slot < num_vars);
+    if (global_vars[slot].ref == NULL_REF) {
+        num_bound++;
+    } else {
+        decref(global_vars[slot].ref);
+    }
     incref(value);
-    global_vars[num_vars].ref = value;
-    num_vars++;
+    global_vars[slot].ref = value;
 }
 
-/*! Delete the global variable with name `name`. Error if no such variable
-    exists. */
-static void globals_delete(const char *name) {
-    for (size_t i = 0; i < num_vars; i++) {
-        if (strcmp(name, global_vars[i].name) == 0) {
-            // Found the variable.  Remove it by sliding the whole array down.
-            free(global_vars[i].name);
-            decref(global_vars[i].ref);
-
-            num_vars--;
-            // REVIEW:  Would be faster to do this with a memmove(), but whatever
-            for (size_t j = i; j < num_vars; j++) {
-                global_vars[j].name = global_vars[j + 1].name;
-                global_vars[j].ref = global_vars[j + 1].ref;
-            }
+/*! Unbinds the global variable in a slot. Error if it is not bound. */
+void globals_delete(size_t slot) {
+    assert(slot < num_vars);
+    if (global_vars[slot].ref == NULL_REF) {
+        exception_set_format(EXC_NAME_ERROR, "name '%s' is not defined",
+                global_vars[slot].name);
+        return;
+    }
 
-            global_vars[num_vars].name = NULL;
-            global_vars[num_vars].ref = NULL_REF;
-            return;
-        }
+    decref(global_vars[slot].ref);
+    global_vars[slot].ref = NULL_REF;
+    num_bound--;
+}
+
+/*!
+ * Unbinds the global variable in a slot if it refers to the given value, which
+ * the caller must also hold a reference to. Returns whether it was unbound.
+ */
+bool globals_release(size_t slot, reference_t ref) {
+    assert(slot < num_vars);
+    if (!is_value_ref(ref) || global_vars[slot].ref != ref) {
+        return false;
     }
 
-    exception_set_format(EXC_NAME_ERROR, "name '%s' is not defined", name);
+    decref(ref);
+    global_vars[slot].ref = NULL_REF;
+    num_bound--;
+    return true;
 }
 
 /*!
@@ -798,14 +1101,49 @@ static void globals_delete(const char *name) {
  * number of globals found.
  */
 size_t foreach_global(void (*f)(const char *name, reference_t ref)) {
-    /* Call the callback on each global. */
+    /* Call the callback on each bound global. */
     for (size_t i = 0; i < num_vars; i++) {
-        f(global_vars[i].name, global_vars[i].ref);
+        if (global_vars[i].ref != NULL_REF) {
+            f(global_vars[i].name, global_vars[i].ref);
+        }
+    }
+
+    return num_bound;
+}
+
+/*!
+ * Like foreach_global(), but only visits one of num_parts roughly equal
+ * slices of the global slots, so that several threads can share the work.
+ */
+void foreach_global_part(size_t part, size_t num_parts,
+        void (*f)(const char *name, reference_t ref)) {
+    size_t end = num_vars * (part + 1) / num_parts;
+    for (size_t i = num_vars * part / num_parts; i < end; i++) {
+        if (global_vars[i].ref != NULL_REF) {
+            f(global_vars[i].name, global_vars[i].ref);
+        }
     }
+}
 
-    return num_vars;
+#ifdef DIRECT_REFS
+
+/*!
+ * Calls f on the address of every reference that the evaluator holds outside
+ * the pool, other than in registered C variables: the global variables, and
+ * those of the program being compiled or run. Each one owns a reference count.
+ */
+void foreach_root(void (*f)(reference_t *ref)) {
+    for (size_t i = 0; i < num_vars; i++) {
+        if (global_vars[i].ref != NULL_REF) {
+            f(&global_vars[i].ref);
+        }
+    }
+    foreach_code_root(f);
+    foreach_vm_root(f);
 }
 
+#endif /* DIRECT_REFS */
+
 void print_global_helper(const char *name, reference_t ref) {
     fprintf(stdout, "%s = ref %d; value ", name, ref);
     ref_println(ref, stdout, MAX_DEPTH);
@@ -813,10 +1151,10 @@ void print_global_helper(const char *name, reference_t ref) {
 
 void print_globals(void) {
     // Just so we can make the text reflect the number of globals.
-    if (num_vars == 1) {
+    if (num_bound == 1) {
         fprintf(stdout, "1 Global:\n");
     } else {
-        fprintf(stdout, "%zu Globals:\n", num_vars);
+        fprintf(stdout, "%zu Globals:\n", num_bound);
     }
 
     foreach_global(print_global_helper);
@@ -15,6 +15,28 @@ bool ref_is_true(reference_t r);
 bool ref_is_false(reference_t r);
 
 size_t foreach_global(void (*f)(const char *name, reference_t ref));
+void foreach_global_part(size_t part, size_t num_parts,
+        void (*f)(const char *name, reference_t ref));
 void print_globals(void);
 
+#ifdef DIRECT_REFS
+/* Calls f on the address of each reference the evaluator holds outside the pool. */
+void foreach_root(void (*f)(reference_t *ref));
+#endif
+
+/* Global variables by slot, for the bytecode interpreter. */
+reference_t globals_get(size_t slot);
+void globals_set(size_t slot, reference_t value);
+void globals_delete(size_t slot);
+bool globals_release(size_t slot, reference_t ref);
+
+/*!
+ * A builtin function. It takes borrowed references to its arguments and
+ * returns a new reference, or NULL_REF with an exception set.
+ */
+typedef reference_t (*builtin_function_t)(size_t arity, reference_t *args);
+
+/* Returns the builtin function with the given name, or NULL if none. */
+builtin_function_t find_builtin(const char *name);
+
 #endif /* EVAL_H */
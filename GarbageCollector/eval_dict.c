@@ -1,105 +1,308 @@
 #include "eval_dict.h"
 
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "eval_refs.h"
 #include "eval_types.h"
 #include "exception.h"
 #include "refs.h"
 
+/*! The smallest number of slots in a dict's index. This must be a power of two. */
+#define DICT_MIN_CAPACITY 8
+
+/*! A bit mask with bit i set if the i-th control byte of a group matched. */
+typedef uint32_t group_mask_t;
+
 static inline dict_value_t *dict_coerce(value_t *obj) {
     assert(obj->type == VAL_DICT);
     return (dict_value_t *) obj;
 }
 
-static inline ref_array_value_t *dict_keyarray(dict_value_t *dict) {
-    value_t *obj = deref(dict->keys);
-    assert(obj->type == VAL_REF_ARRAY);
-    return (ref_array_value_t *) obj;
+static inline dict_index_value_t *dict_index(dict_value_t *dict) {
+    value_t *obj = deref(dict->index);
+    assert(obj->type == VAL_DICT_INDEX);
+    return (dict_index_value_t *) obj;
 }
-static inline ref_array_value_t *dict_valuearray(dict_value_t *dict) {
-    value_t *obj = deref(dict->values);
-    assert(obj->type == VAL_REF_ARRAY);
-    return (ref_array_value_t *) obj;
+static inline dict_entries_value_t *dict_entries(dict_value_t *dict) {
+    value_t *obj = deref(dict->entries);
+    assert(obj->type == VAL_DICT_ENTRIES);
+    return (dict_entries_value_t *) obj;
+}
+
+/*!
+ * Returns the number of entries a dict can hold with an index of the given
+ * capacity. Keeping the index at most two thirds full keeps probing short and
+ * guarantees that every probe sequence reaches an empty slot.
+ */
+static inline size_t usable_entries(size_t capacity) {
+    return capacity * 2 / 3;
 }
 
-static int64_t keys_find(ref_array_value_t *keys, uint64_t hash, reference_t subscr, bool skip_tombstones) {
-    int64_t capacity = keys->capacity;
-    int64_t bucket = hash % capacity;
+/*! Returns the number of bytes needed to store an entry number. */
+static inline size_t entry_width(size_t num_entries) {
+    if (num_entries <= UINT8_MAX + 1) {
+        return 1;
+    } else if (num_entries <= UINT16_MAX + 1) {
+        return 2;
+    } else {
+        return 4;
+    }
+}
 
-    for (int64_t idx = 0; idx < capacity; idx++) {
-        int64_t current = bucket + idx;
-        if (current > capacity) {
-            current -= capacity;
+/*! Returns the entry number stored in a full slot of the index. */
+static inline size_t index_get(dict_index_value_t *index, size_t slot) {
+    void *numbers = &index->ctrl[index->capacity + DICT_GROUP_WIDTH];
+    switch (index->width) {
+        case 1:  return ((uint8_t *) numbers)[slot];
+        case 2:  return ((uint16_t *) numbers)[slot];
+        default: return ((uint32_t *) numbers)[slot];
+    }
+}
+
+/*! Stores an entry number in a slot of the index. */
+static inline void index_set(dict_index_value_t *index, size_t slot, size_t entry) {
+    void *numbers = &index->ctrl[index->capacity + DICT_GROUP_WIDTH];
+    switch (index->width) {
+        case 1:  ((uint8_t *) numbers)[slot] = entry; break;
+        case 2:  ((uint16_t *) numbers)[slot] = entry; break;
+        default: ((uint32_t *) numbers)[slot] = entry; break;
+    }
+}
+
+/*!
+ * Returns the 7-bit fragment of a hash that is stored in the control byte of
+ * a full slot. The low bits of the hash already choose where probing starts,
+ * and integers hash to themselves, so the fragment comes from the top bits of
+ * the hash times a large odd constant, which depend on every bit of the hash.
+ */
+static inline uint8_t hash_fragment(uint64_t hash) {
+    return (uint8_t) ((hash * UINT64_C(0x9E3779B97F4A7C15)) >> 57);
+}
+
+/*! Returns a mask of the control bytes in the group at ctrl equal to byte. */
+static inline group_mask_t group_match(const uint8_t *ctrl, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return (group_mask_t) _mm_movemask_epi8(
+            _mm_cmpeq_epi8(group, _mm_set1_epi8((char) byte)));
+#else
+    group_mask_t mask = 0;
+    for (int i = 0; i < DICT_GROUP_WIDTH; i++) {
+        if (ctrl[i] == byte) {
+            mask |= (group_mask_t) 1 << i;
         }
+    }
+    return mask;
+#endif
+}
 
-        reference_t key = keys->values[current];
-        if (skip_tombstones && key == TOMBSTONE_REF) {
-            continue;
+/*! Returns a mask of the empty or deleted slots in the group at ctrl. */
+static inline group_mask_t group_match_free(const uint8_t *ctrl) {
+#ifdef __SSE2__
+    /* Free slots are exactly those whose control byte has its high bit set. */
+    return (group_mask_t) _mm_movemask_epi8(
+            _mm_loadu_si128((const __m128i *) ctrl));
+#else
+    group_mask_t mask = 0;
+    for (int i = 0; i < DICT_GROUP_WIDTH; i++) {
+        if (ctrl[i] & 0x80) {
+            mask |= (group_mask_t) 1 << i;
         }
-        if (key == NULL_REF || key == TOMBSTONE_REF || ref_eq(subscr, key)) {
-            return current;
+    }
+    return mask;
+#endif
+}
+
+/*! Returns the index of the lowest set bit in a nonzero mask. */
+static inline size_t lowest_bit(group_mask_t mask) {
+#ifdef __GNUC__
+    return __builtin_ctz(mask);
+#else
+    size_t bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/*!
+ * Sets the control byte of a slot, along with its copies after the last slot.
+ * Indices smaller than a group repeat their control bytes more than once.
+ */
+static inline void set_ctrl(dict_index_value_t *index, size_t slot, uint8_t byte) {
+    size_t end = index->capacity + DICT_GROUP_WIDTH;
+    for (; slot < end; slot += index->capacity) {
+        index->ctrl[slot] = byte;
+    }
+}
+
+/*!
+ * Returns the index slot of the entry whose key is equal to subscr, or -1 if
+ * there is none. Probing starts at the slot chosen by the low bits of the hash
+ * and looks at DICT_GROUP_WIDTH control bytes at a time, so ref_eq is only
+ * called for keys whose fragment and stored hash both match.
+ */
+static int64_t keys_find(dict_index_value_t *index, dict_entries_value_t *entries,
+        uint64_t hash, reference_t subscr) {
+    size_t mask = index->capacity - 1;
+    uint8_t fragment = hash_fragment(hash);
+
+    size_t pos = hash & mask;
+    for (size_t probed = 0; probed < index->capacity; probed += DICT_GROUP_WIDTH) {
+        group_mask_t match = group_match(&index->ctrl[pos], fragment);
+        for (; match != 0; match &= match - 1) {
+            size_t slot = (pos + lowest_bit(match)) & mask;
+            dict_entry_t *entry = &entries->entries[index_get(index, slot)];
+            if (entry->hash == hash && ref_eq(subscr, entry->key)) {
+                return slot;
+            }
+        }
+
+        /* Keys are stored in the first free slot along their probe sequence,
+         * so they can't be found past an empty slot. */
+        if (group_match(&index->ctrl[pos], CTRL_EMPTY) != 0) {
+            return -1;
         }
+        pos = (pos + DICT_GROUP_WIDTH) & mask;
     }
 
     return -1;
 }
 
-static void dict_upsize(dict_value_t *dict) {
-    ref_array_value_t *keys = dict_keyarray(dict);
-    ref_array_value_t *values = dict_valuearray(dict);
-    int64_t capacity = keys->capacity;
+/*!
+ * Returns the first empty or deleted slot along the probe sequence of hash,
+ * or -1 if the index is full.
+ */
+static int64_t slots_find_free(dict_index_value_t *index, uint64_t hash) {
+    size_t mask = index->capacity - 1;
+
+    size_t pos = hash & mask;
+    for (size_t probed = 0; probed < index->capacity; probed += DICT_GROUP_WIDTH) {
+        group_mask_t match = group_match_free(&index->ctrl[pos]);
+        if (match != 0) {
+            return (pos + lowest_bit(match)) & mask;
+        }
+        pos = (pos + DICT_GROUP_WIDTH) & mask;
+    }
 
-    int64_t new_capacity = capacity * 2;
-    reference_t ref_keys = make_reference_refarray(new_capacity);
+    return -1;
+}
+
+/*! Adds an entry number to the index, under the given hash. */
+static void index_insert(dict_index_value_t *index, uint64_t hash, size_t entry) {
+    int64_t slot = slots_find_free(index, hash);
+    assert(slot >= 0);
+    index_set(index, slot, entry);
+    set_ctrl(index, slot, hash_fragment(hash));
+}
+
+/*!
+ * Returns the capacity of the smallest index, minimum DICT_MIN_CAPACITY,
+ * that can hold the given number of entries.
+ */
+static size_t index_capacity(size_t length) {
+    size_t capacity = DICT_MIN_CAPACITY;
+    while (usable_entries(capacity) < length) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/*!
+ * Allocates an index of the given capacity and an entries array to match.
+ * Returns false and sets an exception if there is not enough memory.
+ */
+static bool make_tables(size_t capacity, reference_t *ref_index, reference_t *ref_entries) {
+    size_t num_entries = usable_entries(capacity);
+    *ref_entries = make_reference_dictentries(num_entries);
     if (exception_occurred()) {
-        return;
+        return false;
     }
-    reference_t ref_values = make_reference_refarray(new_capacity);
+    ROOT(*ref_entries);
+    *ref_index = make_reference_dictindex(capacity, entry_width(num_entries));
+    UNROOT(1);
     if (exception_occurred()) {
-        decref(ref_keys);
-        return;
+        decref(*ref_entries);
+        return false;
     }
+    return true;
+}
 
-    ref_array_value_t *new_keys = (ref_array_value_t *) deref(ref_keys);
-    ref_array_value_t *new_values = (ref_array_value_t *) deref(ref_values);
+/*!
+ * Moves the elements of a dict whose entries are all used into a larger
+ * entries array, leaving out the deleted ones, and rebuilds the index from
+ * the stored hashes. No keys are hashed or compared.
+ */
+static void dict_upsize(reference_t ref_dict) {
+    int64_t size = dict_coerce(deref(ref_dict))->size;
+
+    reference_t ref_index, ref_entries;
+    ROOT(ref_dict);
+    bool made = make_tables(index_capacity(size * 2), &ref_index, &ref_entries);
+    UNROOT(1);
+    if (!made) {
+        return;
+    }
 
-    for (int64_t idx = 0; idx < capacity; idx++) {
-        if (keys->values[idx] != TOMBSTONE_REF && keys->values[idx] != NULL_REF) {
-            reference_t key = keys->values[idx];
-            reference_t value = values->values[idx];
+    /* The allocations may have moved the dict, so only look it up now. */
+    dict_value_t *dict = dict_coerce(deref(ref_dict));
+    dict_entries_value_t *entries = dict_entries(dict);
+    dict_index_value_t *new_index = (dict_index_value_t *) deref(ref_index);
+    dict_entries_value_t *new_entries = (dict_entries_value_t *) deref(ref_entries);
 
-            uint64_t hash = ref_hash(key);
-            if (exception_occurred()) {
-                decref(ref_keys);
-                decref(ref_values);
-                return;
-            }
-            int64_t idx = keys_find(new_keys, hash, key, false);
-
-            /* Increment the counts for the key and value because the new
-             * reference arrays now refer to them. */
-            incref(key);
-            incref(value);
-            new_keys->values[idx] = key;
-            new_values->values[idx] = value;
+    size_t used = 0;
+    for (int64_t idx = 0; idx < dict->used; idx++) {
+        dict_entry_t *entry = &entries->entries[idx];
+        if (entry->key == NULL_REF) {
+            continue;
         }
+
+        /* Increment the counts for the key and value because the new
+         * entries array now refers to them. */
+        incref(entry->key);
+        incref(entry->value);
+        new_entries->entries[used] = *entry;
+        index_insert(new_index, entry->hash, used);
+        used++;
     }
 
-    /* Now replace the old key and value arrays. */
-    decref(dict->keys);
-    decref(dict->values);
-    dict->keys = ref_keys;
-    dict->values = ref_values;
+    /* Now replace the old index and entries. */
+    decref(dict->index);
+    decref(dict->entries);
+    dict->index = ref_index;
+    dict->entries = ref_entries;
 
-    /* This process removes all tombstones, so the number of occupied slots
-     * become equal to the number of elements in the dictionary. */
-    dict->occupied = dict->size;
+    /* This process removes all deleted entries, so the number of used entries
+     * becomes equal to the number of elements in the dictionary. */
+    assert(used == (size_t) dict->size);
+    dict->used = used;
 }
-static void dict_maybe_upsize(dict_value_t *dict) {
-    int64_t capacity = dict_keyarray(dict)->capacity;
-    if (dict->occupied * 2 >= capacity) {
-        dict_upsize(dict);
+
+reference_t dict_new(size_t length) {
+    reference_t ref_index, ref_entries;
+    if (!make_tables(index_capacity(length), &ref_index, &ref_entries)) {
+        return NULL_REF;
+    }
+
+    ROOT(ref_index);
+    ROOT(ref_entries);
+    reference_t ref_dict = make_reference_dict();
+    UNROOT(2);
+    if (exception_occurred()) {
+        decref(ref_index);
+        decref(ref_entries);
+        return NULL_REF;
     }
+
+    dict_value_t *dict = dict_coerce(deref(ref_dict));
+    dict->index = ref_index;
+    dict->entries = ref_entries;
+    return ref_dict;
 }
 
 bool dict_bool(value_t *obj) {
@@ -112,29 +315,39 @@ int64_t dict_len(value_t *obj) {
 
 reference_t dict_subscr_get(value_t *obj, reference_t subscr) {
     dict_value_t *dict = dict_coerce(obj);
-    ref_array_value_t *keys = dict_keyarray(dict);
-    ref_array_value_t *values = dict_valuearray(dict);
+    dict_index_value_t *index = dict_index(dict);
+    dict_entries_value_t *entries = dict_entries(dict);
 
     uint64_t hash = ref_hash(subscr);
     if (exception_occurred()) {
         return NULL_REF;
     }
 
-    int64_t idx = keys_find(keys, hash, subscr, true);
+    int64_t slot = keys_find(index, entries, hash, subscr);
 
-    if (idx >= 0 && keys->values[idx] != NULL_REF) {
-        incref(values->values[idx]);
-        return values->values[idx];
+    if (slot >= 0) {
+        reference_t value = entries->entries[index_get(index, slot)].value;
+        incref(value);
+        return value;
     } else {
         exception_set(EXC_KEY_ERROR, "no value found for key in dictionary");
         return NULL_REF;
     }
 }
 
-void dict_subscr_set(value_t *obj, reference_t subscr, reference_t value) {
-    dict_value_t *dict = dict_coerce(obj);
-    ref_array_value_t *keys = dict_keyarray(dict);
-    ref_array_value_t *values = dict_valuearray(dict);
+void dict_subscr_set(reference_t obj, reference_t subscr, reference_t value) {
+    /* Dicts don't hold string builders; see string_builder_value_t.
+     * Flattening them may move values, so it has to come first. */
+    string_flatten(subscr);
+    if (exception_occurred()) {
+        return;
+    }
+    string_flatten(value);
+    if (exception_occurred()) {
+        return;
+    }
+
+    dict_value_t *dict = dict_coerce(deref(obj));
 
     uint64_t hash = ref_hash(subscr);
     if (exception_occurred()) {
@@ -142,53 +355,70 @@ void dict_subscr_set(value_t *obj, reference_t subscr, reference_t value) {
     }
 
     /* Look for an existing entry with this key. */
-    int64_t idx = keys_find(keys, hash, subscr, true);
-    if (idx >= 0 && keys->values[idx] != NULL_REF) {
+    dict_index_value_t *index = dict_index(dict);
+    dict_entries_value_t *entries = dict_entries(dict);
+    int64_t slot = keys_find(index, entries, hash, subscr);
+    if (slot >= 0) {
         /* If the keys match, just overwrite the value. */
-        decref(values->values[idx]);
+        dict_entry_t *entry = &entries->entries[index_get(index, slot)];
+        decref(entry->value);
         incref(value);
-        values->values[idx] = value;
+        entry->value = value;
         return;
     }
 
-    /* Otherwise, look for a new slot to set. */
-    idx = keys_find(keys, hash, subscr, false);
-    if (idx >= 0) {
-        assert(keys->values[idx] == NULL_REF || keys->values[idx] == TOMBSTONE_REF);
-        dict->size++;
-        if (keys->values[idx] == NULL_REF) {
-            dict->occupied++;
+    /* Otherwise, append a new entry, making room for it first if needed. */
+    if ((size_t) dict->used == entries->capacity) {
+        ROOT(obj);
+        ROOT(subscr);
+        ROOT(value);
+        dict_upsize(obj);
+        UNROOT(3);
+        if (exception_occurred()) {
+            return;
         }
+        dict = dict_coerce(deref(obj));
+        index = dict_index(dict);
+        entries = dict_entries(dict);
+    }
 
-        keys->values[idx] = subscr;
-        values->values[idx] = value;
-        incref(subscr);
-        incref(value);
-
-        dict_maybe_upsize(dict);
+    /* String keys are interned, so lookups with literals usually find
+     * them by identity. Interning doesn't allocate, so nothing moves. */
+    if (ref_type(subscr) == VAL_STRING) {
+        subscr = intern_string(subscr);
     } else {
-        dict_upsize(dict);
-        dict_subscr_set(obj, subscr, value);
+        incref(subscr);
     }
+    incref(value);
+
+    dict_entry_t *entry = &entries->entries[dict->used];
+    entry->hash = hash;
+    entry->key = subscr;
+    entry->value = value;
+    index_insert(index, hash, dict->used);
+    dict->used++;
+    dict->size++;
 }
 
 void dict_subscr_del(value_t *obj, reference_t subscr) {
     dict_value_t *dict = dict_coerce(obj);
-    ref_array_value_t *keys = dict_keyarray(dict);
-    ref_array_value_t *values = dict_valuearray(dict);
+    dict_index_value_t *index = dict_index(dict);
+    dict_entries_value_t *entries = dict_entries(dict);
 
     uint64_t hash = ref_hash(subscr);
     if (exception_occurred()) {
         return;
     }
 
-    int64_t idx = keys_find(keys, hash, subscr, true);
-    if (idx >= 0 && keys->values[idx] != NULL_REF) {
+    int64_t slot = keys_find(index, entries, hash, subscr);
+    if (slot >= 0) {
+        dict_entry_t *entry = &entries->entries[index_get(index, slot)];
         dict->size--;
-        decref(keys->values[idx]);
-        decref(values->values[idx]);
-        keys->values[idx] = TOMBSTONE_REF;
-        values->values[idx] = NULL_REF;
+        decref(entry->key);
+        decref(entry->value);
+        entry->key = NULL_REF;
+        entry->value = NULL_REF;
+        set_ctrl(index, slot, CTRL_DELETED);
     } else {
         exception_set(EXC_KEY_ERROR, "can't delete nonexistant key in dictionary");
     }
@@ -202,20 +432,19 @@ bool dict_eq(value_t *l, value_t *r) {
         return false;
     }
 
-    ref_array_value_t *lkeys = dict_keyarray(ldict);
-    ref_array_value_t *lvalues = dict_valuearray(ldict);
-    ref_array_value_t *rkeys = dict_keyarray(rdict);
-    ref_array_value_t *rvalues = dict_valuearray(rdict);
+    dict_entries_value_t *lentries = dict_entries(ldict);
+    dict_index_value_t *rindex = dict_index(rdict);
+    dict_entries_value_t *rentries = dict_entries(rdict);
 
-    for (size_t idx = 0; idx < lkeys->capacity; idx++) {
-        reference_t key = lkeys->values[idx];
-        if (key == NULL_REF || key == TOMBSTONE_REF) {
+    for (int64_t idx = 0; idx < ldict->used; idx++) {
+        dict_entry_t *entry = &lentries->entries[idx];
+        if (entry->key == NULL_REF) {
             continue;
         }
 
-        int64_t ridx = keys_find(rkeys, ref_hash(key), key, true);
-        bool equals = ridx >= 0 && rkeys->values[ridx] != NULL_REF &&
-            ref_eq(lvalues->values[idx], rvalues->values[ridx]);
+        int64_t rslot = keys_find(rindex, rentries, entry->hash, entry->key);
+        bool equals = rslot >= 0 && ref_eq(entry->value,
+                rentries->entries[index_get(rindex, rslot)].value);
         if (exception_occurred() || !equals) {
             return false;
         }
@@ -233,14 +462,14 @@ void dict_print(value_t *obj, FILE *stream, size_t depth) {
 
     /* Then make sure that we are dealing with a dictionary. */
     dict_value_t *dict = dict_coerce(obj);
-    ref_array_value_t *keys = dict_keyarray(dict);
-    ref_array_value_t *values = dict_valuearray(dict);
+    dict_entries_value_t *entries = dict_entries(dict);
 
+    /* Elements are printed in the order they were inserted. */
     bool comma = false;
     fprintf(stream, "{");
-    for (size_t idx = 0; idx < keys->capacity; idx++) {
-        reference_t key = keys->values[idx];
-        if (key == NULL_REF || key == TOMBSTONE_REF) {
+    for (int64_t idx = 0; idx < dict->used; idx++) {
+        dict_entry_t *entry = &entries->entries[idx];
+        if (entry->key == NULL_REF) {
             continue;
         }
 
@@ -248,9 +477,9 @@ void dict_print(value_t *obj, FILE *stream, size_t depth) {
             fprintf(stream, ", ");
         }
 
-        ref_print_repr(key, stream, depth - 1);
+        ref_print_repr(entry->key, stream, depth - 1);
         fprintf(stream, ": ");
-        ref_print_repr(values->values[idx], stream, depth - 1);
+        ref_print_repr(entry->value, stream, depth - 1);
 
         comma = true;
     }
@@ -1,6 +1,7 @@
 #include "eval_list.h"
 
 #include <assert.h>
+#include "eval_refs.h"
 #include "eval_types.h"
 #include "exception.h"
 #include "refs.h"
@@ -89,7 +90,8 @@ reference_t list_subscr_get(value_t *obj, reference_t subscr) {
     list_value_t *list = list_coerce(obj);
 
     /* Then check to make sure that the subscript is an integer. */
-    int64_t idx = list_coerce_subscript(list, deref(subscr));
+    integer_value_t box;
+    int64_t idx = list_coerce_subscript(list, deref_boxed(subscr, &box));
     if (exception_occurred()) {
         return NULL_REF;
     }
@@ -101,12 +103,20 @@ reference_t list_subscr_get(value_t *obj, reference_t subscr) {
 }
 
 /*! Implements subscript assignment for list types. */
-void list_subscr_set(value_t *obj, reference_t subscr, reference_t value) {
+void list_subscr_set(reference_t obj, reference_t subscr, reference_t value) {
+    /* Lists don't hold string builders; see string_builder_value_t.
+     * Flattening one may move values, so it has to come first. */
+    string_flatten(value);
+    if (exception_occurred()) {
+        return;
+    }
+
     /* First ensure that this is actually a list_value_t. */
-    list_value_t *list = list_coerce(obj);
+    list_value_t *list = list_coerce(deref(obj));
 
     /* Then check to make sure that the subscript is an integer. */
-    int64_t idx = list_coerce_subscript(list, deref(subscr));
+    integer_value_t box;
+    int64_t idx = list_coerce_subscript(list, deref_boxed(subscr, &box));
     if (exception_occurred()) {
         return;
     }
@@ -123,7 +133,8 @@ void list_subscr_del(value_t *obj, reference_t subscr) {
     list_value_t *list = list_coerce(obj);
 
     /* Then check to make sure that the subscript is an integer. */
-    int64_t idx = list_coerce_subscript(list, deref(subscr));
+    integer_value_t box;
+    int64_t idx = list_coerce_subscript(list, deref_boxed(subscr, &box));
     if (exception_occurred()) {
         return;
     }
@@ -1,8 +1,13 @@
 #include "eval_refs.h"
 #include "eval_types.h"
 
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "config.h"
+#include "exception.h"
 #include "refs.h"
 
 //// GLOBAL VARIABLE DECLARATIONS ////
@@ -11,6 +16,19 @@ reference_t NONE_REF;
 reference_t TRUE_REF;
 reference_t FALSE_REF;
 
+/*!
+ * The table of interned strings, an open-addressing hash table of references
+ * to string values, indexed by their hash. The table does not own the strings
+ * it refers to: an entry may go stale when its string is freed, and its
+ * reference may even be reused by another value. Stale entries are detected
+ * on lookup and their slots are reused by later insertions.
+ */
+static reference_t *interned;
+static size_t interned_capacity;
+static size_t interned_used;
+
+#define INTERNED_INITIAL_CAPACITY 64
+
 //// NEW REFERENCE FUNCTIONS ////
 
 /*! Creates a new None reference. This should only be called once. */
@@ -23,8 +41,14 @@ reference_t make_reference_bool(void) {
     return make_ref(VAL_BOOL, sizeof(value_t));
 }
 
-/*! Assigns a long int to a new reference in the ref_table. */
+/*!
+ * Assigns a long int to a new reference in the ref_table,
+ * or returns it as a tagged integer if those are enabled and it fits.
+ */
 reference_t make_reference_int(int64_t i) {
+    if (tagged_ints && fits_tagged_int(i)) {
+        return make_tagged_int(i);
+    }
     reference_t ref = make_ref(VAL_INTEGER, sizeof(integer_value_t));
     if (ref != NULL_REF) {
         ((integer_value_t *) deref(ref))->integer_value = i;
@@ -33,28 +57,439 @@ reference_t make_reference_int(int64_t i) {
 }
 
 
+/*!
+ * Continues hashing a string with more characters, starting from the hash of
+ * the characters before them, so that the hash of a concatenation can be found
+ * from the hash of its first part.
+ */
+static uint64_t hash_more_chars(uint64_t hash, const char *sp) {
+    for (; *sp; sp++) {
+        hash = 31 * hash + *sp;
+    }
+    return hash;
+}
+
+/*! Hashes the characters of a string. Adapted from Java's String.hashCode(). */
+static uint64_t hash_chars(const char *sp) {
+    return hash_more_chars(1125899906842597UL, sp); // prime
+}
+
+/*!
+ * Returns the string value at an interned table entry,
+ * or NULL if the entry is empty or stale.
+ */
+static string_value_t *interned_string_at(size_t idx) {
+    reference_t ref = interned[idx];
+    if (!is_live_ref(ref)) {
+        return NULL;
+    }
+    value_t *value = deref(ref);
+    return value->type == VAL_STRING ? (string_value_t *) value : NULL;
+}
+
+/*!
+ * Finds the slot of the interned string with the given hash and characters.
+ * If there is no such string, returns the first empty or stale slot in its
+ * probe sequence instead, so the caller should check the slot's contents.
+ */
+static size_t interned_find(uint64_t hash, const char *chars) {
+    size_t mask = interned_capacity - 1;
+    size_t free_idx = SIZE_MAX;
+    for (size_t i = 0; i < interned_capacity; i++) {
+        size_t idx = (hash + i) & mask;
+        if (interned[idx] == NULL_REF) {
+            return free_idx != SIZE_MAX ? free_idx : idx;
+        }
+        string_value_t *str = interned_string_at(idx);
+        if (str == NULL) {
+            if (free_idx == SIZE_MAX) {
+                free_idx = idx;
+            }
+        } else if (str->hash == hash && strcmp(str->string_value, chars) == 0) {
+            return idx;
+        }
+    }
+    assert(free_idx != SIZE_MAX);
+    return free_idx;
+}
+
+/*! Doubles the interned table, dropping stale entries along the way. */
+static void interned_grow(void) {
+    reference_t *old = interned;
+    size_t old_capacity = interned_capacity;
+
+    interned_capacity = old_capacity == 0 ? INTERNED_INITIAL_CAPACITY : old_capacity * 2;
+    interned = malloc(interned_capacity * sizeof(reference_t));
+    if (interned == NULL) {
+        fprintf(stderr, "Fatal error: could not grow the interned string table");
+        exit(1);
+    }
+    for (size_t i = 0; i < interned_capacity; i++) {
+        interned[i] = NULL_REF;
+    }
+
+    interned_used = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (!is_live_ref(old[i]) || deref(old[i])->type != VAL_STRING) {
+            continue;
+        }
+        string_value_t *str = (string_value_t *) deref(old[i]);
+        interned[interned_find(str->hash, str->string_value)] = old[i];
+        interned_used++;
+    }
+    free(old);
+}
+
+/*!
+ * Returns the slot for a string in the interned table, growing the table
+ * first if it is getting full. Stale slots count as used until the table
+ * is grown, which keeps probe sequences short.
+ */
+static size_t interned_slot(uint64_t hash, const char *chars) {
+    if ((interned_used + 1) * 2 > interned_capacity) {
+        interned_grow();
+    }
+    return interned_find(hash, chars);
+}
+
+/*! Records ref as the interned string for a slot returned by interned_slot(). */
+static void interned_set(size_t idx, reference_t ref) {
+    if (interned[idx] == NULL_REF) {
+        interned_used++;
+    }
+    interned[idx] = ref;
+}
+
 /*! Makes a reference for a new string of the given length. */
 static reference_t make_reference_string_length(size_t len) {
     return make_ref(VAL_STRING, sizeof(string_value_t) + sizeof(char[len + 1]));
 }
 
-/*! Assigns a string to a new reference in the ref_table. */
+/*!
+ * Returns a reference to the interned string with the given value,
+ * assigning it to a new reference in the ref_table if there is none.
+ */
 reference_t make_reference_string(const char *value) {
+    uint64_t hash = hash_chars(value);
+    size_t idx = interned_slot(hash, value);
+    if (interned_string_at(idx) != NULL) {
+        incref(interned[idx]);
+        return interned[idx];
+    }
+
     reference_t ref = make_reference_string_length(strlen(value));
     if (ref != NULL_REF) {
-        strcpy(((string_value_t *) deref(ref))->string_value, value);
+        string_value_t *str = (string_value_t *) deref(ref);
+        str->hash = hash;
+        strcpy(str->string_value, value);
+
+        /* The slot is still valid, since allocating only moves values. */
+        interned_set(idx, ref);
+    }
+    return ref;
+}
+
+/*!
+ * Returns a new reference to the interned string equal to the string at ref.
+ * If there is none, the string at ref becomes the interned one.
+ * This never allocates from the pool, so values don't move.
+ */
+reference_t intern_string(reference_t ref) {
+    string_value_t *str = (string_value_t *) deref(ref);
+    assert(str->base.type == VAL_STRING);
+
+    size_t idx = interned_slot(str->hash, str->string_value);
+    if (interned_string_at(idx) == NULL) {
+        interned_set(idx, ref);
+    }
+    incref(interned[idx]);
+    return interned[idx];
+}
+
+#ifdef DIRECT_REFS
+
+/*!
+ * With DIRECT_REFS, a stale entry could point into the middle of another
+ * value, so entries are removed as soon as their strings are freed. A removed
+ * entry becomes INTERNED_REMOVED rather than NULL_REF, so that probe sequences
+ * through it still reach the entries after it, as a stale entry would.
+ */
+#define INTERNED_REMOVED ((reference_t) (-2))
+
+/*! Removes the entry of a string that is about to be freed, if it has one. */
+void forget_interned_string(reference_t ref) {
+    if (interned_capacity == 0) {
+        return;
+    }
+    size_t mask = interned_capacity - 1;
+    uint64_t hash = ((string_value_t *) deref(ref))->hash;
+    for (size_t i = 0; i < interned_capacity; i++) {
+        size_t idx = (hash + i) & mask;
+        if (interned[idx] == NULL_REF) {
+            return;
+        }
+        if (interned[idx] == ref) {
+            interned[idx] = INTERNED_REMOVED;
+            return;
+        }
+    }
+}
+
+/*!
+ * Updates the entries after a collection has moved the strings, given where
+ * each one went. Strings that moved nowhere were garbage, so their entries
+ * are removed.
+ */
+void update_interned_strings(reference_t (*moved)(reference_t ref)) {
+    for (size_t i = 0; i < interned_capacity; i++) {
+        if (is_value_ref(interned[i])) {
+            reference_t ref = moved(interned[i]);
+            interned[i] = ref == NULL_REF ? INTERNED_REMOVED : ref;
+        }
+    }
+}
+
+#endif /* DIRECT_REFS */
+
+/*! Frees the interned string table. The strings themselves live in the pool. */
+void close_interned_strings(void) {
+    free(interned);
+    interned = NULL;
+    interned_capacity = 0;
+    interned_used = 0;
+}
+
+/*!
+ * Appends the string at r2 to the string at r1, if r1 can be grown in place
+ * to hold the result. Returns whether it was appended.
+ */
+static bool string_append_in_place(reference_t r1, reference_t r2, size_t len1, size_t len2) {
+    if (!grow_ref(r1, sizeof(string_value_t) + sizeof(char[len1 + len2 + 1]))) {
+        return false;
+    }
+
+#ifdef DIRECT_REFS
+    /* Its entry would be filed under the old hash, where it can't be found
+     * to be removed once the string is freed. */
+    forget_interned_string(r1);
+#endif
+
+    string_value_t *str = (string_value_t *) deref(r1);
+    char *tail = str->string_value + len1;
+    memcpy(tail, ((string_value_t *) deref(r2))->string_value, len2 + 1);
+    str->hash = hash_more_chars(str->hash, tail);
+    return true;
+}
+
+/*!
+ * Concatenations at least this long make a string builder, unless the first
+ * string can be grown in place. Shorter ones are copied, since a builder and
+ * its chunks array would take up more room than the string itself.
+ */
+#define STRING_BUILDER_MIN_LENGTH 64
+
+/*! The number of chunks that a new string builder has room for. */
+#define STRING_BUILDER_INITIAL_CHUNKS 8
+
+static inline string_builder_value_t *builder_at(reference_t ref) {
+    value_t *obj = deref(ref);
+    assert(obj->type == VAL_STRING_BUILDER);
+    return (string_builder_value_t *) obj;
+}
+
+static inline reference_t *chunks_at(reference_t ref) {
+    return ((ref_array_value_t *) deref(ref))->values;
+}
+
+#ifndef DIRECT_REFS
+
+/*! Makes a builder for the concatenation of two flat strings. */
+static reference_t make_string_builder(reference_t r1, reference_t r2, size_t length) {
+    reference_t chunks = make_reference_refarray(STRING_BUILDER_INITIAL_CHUNKS);
+    if (chunks == NULL_REF) {
+        return NULL_REF;
+    }
+    reference_t ref = make_ref(VAL_STRING_BUILDER, sizeof(string_builder_value_t));
+    if (ref == NULL_REF) {
+        decref(chunks);
+        return NULL_REF;
+    }
+
+    reference_t *values = chunks_at(chunks);
+    values[0] = r1;
+    values[1] = r2;
+    incref(r1);
+    incref(r2);
+
+    string_builder_value_t *builder = builder_at(ref);
+    builder->length = length;
+    builder->num_chunks = 2;
+    builder->chunks = chunks;
+    return ref;
+}
+
+/*! Copies the first count chunks of a chunks array into a new one. */
+static reference_t copy_chunks(reference_t old, size_t count, size_t capacity) {
+    reference_t ref = make_reference_refarray(capacity);
+    if (ref != NULL_REF) {
+        reference_t *from = chunks_at(old);
+        reference_t *to = chunks_at(ref);
+        for (size_t i = 0; i < count; i++) {
+            to[i] = from[i];
+            incref(to[i]);
+        }
     }
     return ref;
 }
 
-/*! Assigns a concatenated string to a new reference in the ref_table. */
-reference_t make_reference_string_concat(const char *v1, const char *v2) {
-    size_t len1 = strlen(v1), len2 = strlen(v2);
+/*!
+ * Appends the flat string at r2 to the builder at r1. If the caller's
+ * reference to r1 is its only one, r1 is reused for the result. Otherwise
+ * the result is a new builder, which shares the chunks array of r1 if no
+ * other string has appended to it yet: builders that share an array agree
+ * on the chunks they have in common, so the next slot is free to take.
+ * When the array is full, a copy twice as big is made, so that appending
+ * takes amortized O(1) time.
+ */
+static reference_t string_builder_append(reference_t r1, reference_t r2, size_t len2) {
+    string_builder_value_t *builder = builder_at(r1);
+    size_t length = builder->length + len2;
+    size_t count = builder->num_chunks;
+    reference_t chunks = builder->chunks;
+
+    /* If nothing else can see the last chunk, and it would stay short,
+     * append r2 to it instead, so that short appends don't cost a chunk each. */
+    reference_t last = chunks_at(chunks)[count - 1];
+    if (is_unique_ref(r1) && is_unique_ref(chunks) &&
+            strlen(((string_value_t *) deref(last))->string_value) + len2 <
+            STRING_BUILDER_MIN_LENGTH) {
+        last = make_reference_string_concat(last, r2);
+        if (last == NULL_REF) {
+            return NULL_REF;
+        }
+        builder = builder_at(r1);
+        reference_t *values = chunks_at(builder->chunks);
+        decref(values[count - 1]);
+        values[count - 1] = last;
+        builder->length = length;
+        incref(r1);
+        return r1;
+    }
+
+    ref_array_value_t *array = (ref_array_value_t *) deref(chunks);
+    if (count < array->capacity && array->values[count] == NULL_REF) {
+        incref(chunks);
+    } else {
+        chunks = copy_chunks(chunks, count, 2 * count);
+        if (chunks == NULL_REF) {
+            return NULL_REF;
+        }
+    }
+    chunks_at(chunks)[count] = r2;
+    incref(r2);
+
+    reference_t ref = r1;
+    if (is_unique_ref(r1)) {
+        incref(r1);
+        decref(builder_at(r1)->chunks);
+    } else {
+        ref = make_ref(VAL_STRING_BUILDER, sizeof(string_builder_value_t));
+        if (ref == NULL_REF) {
+            decref(chunks);
+            return NULL_REF;
+        }
+    }
+
+    builder = builder_at(ref);
+    builder->length = length;
+    builder->num_chunks = count + 1;
+    builder->chunks = chunks;
+    return ref;
+}
+
+#endif /* DIRECT_REFS */
+
+/*!
+ * Replaces the value of a string builder with the flat string it stands for,
+ * keeping its reference. Does nothing to other values, so any reference the
+ * caller holds may be passed. Values may move, as in any allocation.
+ */
+void string_flatten(reference_t ref) {
+    if (!is_value_ref(ref) || deref(ref)->type != VAL_STRING_BUILDER) {
+        return;
+    }
+
+    reference_t flat = make_reference_string_length(builder_at(ref)->length);
+    if (flat == NULL_REF) {
+        return;
+    }
+
+    string_builder_value_t *builder = builder_at(ref);
+    reference_t *chunks = chunks_at(builder->chunks);
+    string_value_t *str = (string_value_t *) deref(flat);
+    char *end = str->string_value;
+    for (size_t i = 0; i < builder->num_chunks; i++) {
+        const char *chunk = ((string_value_t *) deref(chunks[i]))->string_value;
+        size_t len = strlen(chunk);
+        memcpy(end, chunk, len);
+        end += len;
+    }
+    *end = '\0';
+    str->hash = hash_chars(str->string_value);
+
+    replace_ref(ref, flat);
+}
+
+/*!
+ * Assigns the concatenation of two strings to a new reference in the ref_table.
+ * The strings are passed by reference because the allocation may move them.
+ * If the caller's reference to r1 is its only one, r1 would be freed right
+ * after this anyway, so r2 is appended to it in place when there is room,
+ * and a new reference to r1 is returned instead.
+ * Long results are string builders, which string_flatten() turns into
+ * flat strings once they are used. Builders rely on replace_ref(), so there
+ * are none with DIRECT_REFS, and string_flatten() does nothing.
+ */
+reference_t make_reference_string_concat(reference_t r1, reference_t r2) {
+#ifndef DIRECT_REFS
+    /* Builders are only made of flat strings. */
+    string_flatten(r2);
+    if (exception_occurred()) {
+        return NULL_REF;
+    }
+#endif
+    size_t len2 = strlen(((string_value_t *) deref(r2))->string_value);
+#ifndef DIRECT_REFS
+    if (deref(r1)->type == VAL_STRING_BUILDER) {
+        return string_builder_append(r1, r2, len2);
+    }
+#endif
+    size_t len1 = strlen(((string_value_t *) deref(r1))->string_value);
+
+    /* A string with no other references may still be in the interned table,
+     * but the table checks the hash and characters of every entry it finds,
+     * so changing the string just makes it stop matching. */
+    if (r1 != r2 && is_unique_ref(r1) && string_append_in_place(r1, r2, len1, len2)) {
+        incref(r1);
+        return r1;
+    }
+
+#ifndef DIRECT_REFS
+    if (len1 + len2 >= STRING_BUILDER_MIN_LENGTH) {
+        return make_string_builder(r1, r2, len1 + len2);
+    }
+#endif
+
+    ROOT(r1);
+    ROOT(r2);
     reference_t ref = make_reference_string_length(len1 + len2);
+    UNROOT(2);
     if (ref != NULL_REF) {
-        char *string_value = ((string_value_t *) deref(ref))->string_value;
-        strcpy(string_value, v1);
-        strcpy(string_value + len1, v2);
+        string_value_t *str1 = (string_value_t *) deref(r1);
+        string_value_t *str = (string_value_t *) deref(ref);
+        memcpy(str->string_value, str1->string_value, len1);
+        strcpy(str->string_value + len1, ((string_value_t *) deref(r2))->string_value);
+        str->hash = hash_more_chars(str1->hash, str->string_value + len1);
     }
     return ref;
 }
@@ -76,9 +511,9 @@ reference_t make_reference_dict() {
     if (ref != NULL_REF) {
         dict_value_t *dv = (dict_value_t *) deref(ref);
         dv->size = 0;
-        dv->occupied = 0;
-        dv->keys = NULL_REF;
-        dv->values = NULL_REF;
+        dv->used = 0;
+        dv->index = NULL_REF;
+        dv->entries = NULL_REF;
     }
     return ref;
 }
@@ -98,3 +533,39 @@ reference_t make_reference_refarray(size_t capacity) {
     }
     return ref;
 }
+
+/*!
+ * DictIndex allocation helper. All of the slots start out empty.
+ * The width of the entry numbers must be 1, 2 or 4 bytes.
+ */
+reference_t make_reference_dictindex(size_t capacity, size_t width) {
+    size_t num_ctrl = capacity + DICT_GROUP_WIDTH;
+    reference_t ref = make_ref(
+        VAL_DICT_INDEX,
+        sizeof(dict_index_value_t) + num_ctrl + capacity * width
+    );
+    if (ref != NULL_REF) {
+        dict_index_value_t *div = (dict_index_value_t *) deref(ref);
+        div->capacity = capacity;
+        div->width = width;
+        memset(div->ctrl, CTRL_EMPTY, num_ctrl);
+    }
+    return ref;
+}
+
+/*! DictEntries allocation helper. */
+reference_t make_reference_dictentries(size_t capacity) {
+    reference_t ref = make_ref(
+        VAL_DICT_ENTRIES,
+        sizeof(dict_entries_value_t) + sizeof(dict_entry_t[capacity])
+    );
+    if (ref != NULL_REF) {
+        dict_entries_value_t *dev = (dict_entries_value_t *) deref(ref);
+        dev->capacity = capacity;
+        for (size_t i = 0; i < capacity; i++) {
+            dev->entries[i].key = NULL_REF;
+            dev->entries[i].value = NULL_REF;
+        }
+    }
+    return ref;
+}
@@ -18,9 +18,18 @@ reference_t make_reference_bool(void);
 reference_t make_reference_int(int64_t v);
 reference_t make_reference_float(double f);
 reference_t make_reference_string(const char *value);
-reference_t make_reference_string_concat(const char *v1, const char *v2);
+reference_t make_reference_string_concat(reference_t r1, reference_t r2);
+void string_flatten(reference_t ref);
+reference_t intern_string(reference_t ref);
+void close_interned_strings(void);
+#ifdef DIRECT_REFS
+void forget_interned_string(reference_t ref);
+void update_interned_strings(reference_t (*moved)(reference_t ref));
+#endif
 reference_t make_reference_list(void);
 reference_t make_reference_dict(void);
 reference_t make_reference_refarray(size_t capacity);
+reference_t make_reference_dictindex(size_t capacity, size_t width);
+reference_t make_reference_dictentries(size_t capacity);
 
 #endif /* EVAL_REFS_H */
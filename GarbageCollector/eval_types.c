@@ -52,7 +52,8 @@ static bool singleton_bool(value_t *obj) {
 }
 
 static uint64_t singleton_hash(value_t *obj) {
-    return obj->type == VAL_NONE ? NONE_REF : bool_ref(singleton_bool(obj));
+    /* Not the references, which change when values move with DIRECT_REFS. */
+    return obj->type == VAL_NONE ? 0 : singleton_bool(obj) ? 1 : 2;
 }
 
 static int singleton_cmp(value_t *l, value_t *r) {
@@ -104,6 +105,14 @@ static inline integer_value_t *integer_coerce(value_t *obj) {
     return (integer_value_t *) obj;
 }
 
+/*! Returns the integer at a reference, which may be a tagged integer. */
+static inline int64_t integer_at(reference_t r) {
+    if (is_tagged_int(r)) {
+        return tagged_int_value(r);
+    }
+    return integer_coerce(deref(r))->integer_value;
+}
+
 static bool integer_bool(value_t *obj) {
     /* First ensure that this is actually and integer_value_t. */
     integer_value_t *integer = integer_coerce(obj);
@@ -116,13 +125,29 @@ static uint64_t integer_hash(value_t *obj) {
     return integer_coerce(obj)->integer_value;
 }
 
-static reference_t integer_unaryop_negate(value_t *l, value_t *r) {
-    (void) r;
-    return make_reference_int(-integer_coerce(l)->integer_value);
+/*!
+ * Returns a reference to the integer result of an operation on l and r.
+ * If the caller's reference to a boxed operand is its only one, the operand
+ * would be freed right after the operation, so the result is stored in it
+ * instead of a newly allocated value.
+ */
+static reference_t integer_result(reference_t l, reference_t r, int64_t value) {
+    if (!(tagged_ints && fits_tagged_int(value))) {
+        reference_t reuse = is_unique_ref(l) ? l : is_unique_ref(r) ? r : NULL_REF;
+        if (reuse != NULL_REF) {
+            integer_coerce(deref(reuse))->integer_value = value;
+            incref(reuse);
+            return reuse;
+        }
+    }
+    return make_reference_int(value);
+}
+
+static reference_t integer_unaryop_negate(reference_t l, reference_t r) {
+    return integer_result(l, r, -integer_at(l));
 }
-static reference_t integer_unaryop_identity(value_t *l, value_t *r) {
-    (void) r;
-    return make_reference_int(+integer_coerce(l)->integer_value);
+static reference_t integer_unaryop_identity(reference_t l, reference_t r) {
+    return integer_result(l, r, +integer_at(l));
 }
 
 static int integer_cmp(value_t *l, value_t *r) {
@@ -134,25 +159,20 @@ static bool integer_eq(value_t *l, value_t *r) {
     return integer_cmp(l, r) == 0;
 }
 
-static reference_t integer_binop_add(value_t *l, value_t *r) {
-    return make_reference_int(
-            integer_coerce(l)->integer_value + integer_coerce(r)->integer_value);
+static reference_t integer_binop_add(reference_t l, reference_t r) {
+    return integer_result(l, r, integer_at(l) + integer_at(r));
 }
-static reference_t integer_binop_subtract(value_t *l, value_t *r) {
-    return make_reference_int(
-            integer_coerce(l)->integer_value - integer_coerce(r)->integer_value);
+static reference_t integer_binop_subtract(reference_t l, reference_t r) {
+    return integer_result(l, r, integer_at(l) - integer_at(r));
 }
-static reference_t integer_binop_multiply(value_t *l, value_t *r) {
-    return make_reference_int(
-            integer_coerce(l)->integer_value * integer_coerce(r)->integer_value);
+static reference_t integer_binop_multiply(reference_t l, reference_t r) {
+    return integer_result(l, r, integer_at(l) * integer_at(r));
 }
-static reference_t integer_binop_divide(value_t *l, value_t *r) {
-    return make_reference_int(
-            integer_coerce(l)->integer_value / integer_coerce(r)->integer_value);
+static reference_t integer_binop_divide(reference_t l, reference_t r) {
+    return integer_result(l, r, integer_at(l) / integer_at(r));
 }
-static reference_t integer_binop_modulo(value_t *l, value_t *r) {
-    return make_reference_int(
-            integer_coerce(l)->integer_value % integer_coerce(r)->integer_value);
+static reference_t integer_binop_modulo(reference_t l, reference_t r) {
+    return integer_result(l, r, integer_at(l) % integer_at(r));
 }
 
 /*! Implements printing for integers. */
@@ -177,36 +197,46 @@ static inline string_value_t *string_coerce(value_t *obj) {
     return (string_value_t *) obj;
 }
 
-static bool string_bool(value_t *obj) {
-    return string_coerce(obj)->string_value[0] != '\0';
+/*!
+ * Returns the length of a string. Builders know their length, so unlike the
+ * other string operations, this doesn't need them to be flattened first.
+ */
+static int64_t string_len(value_t *obj) {
+    if (obj->type == VAL_STRING_BUILDER) {
+        return ((string_builder_value_t *) obj)->length;
+    }
+    return strlen(string_coerce(obj)->string_value);
 }
 
-static uint64_t string_hash(value_t *obj) {
-    /* Adapted from Java's String.hashCode(). */
-    string_value_t *str = string_coerce(obj);
-
-    uint64_t hash = 1125899906842597UL; // prime
-    for (const char *sp = str->string_value; *sp; sp++) {
-        hash = 31 * hash + *sp;
+static bool string_bool(value_t *obj) {
+    if (obj->type == VAL_STRING_BUILDER) {
+        return string_len(obj) != 0;
     }
-    return hash;
+    return string_coerce(obj)->string_value[0] != '\0';
 }
 
-static int64_t string_len(value_t *obj) {
-    return strlen(string_coerce(obj)->string_value);
+static uint64_t string_hash(value_t *obj) {
+    /* The hash is computed when the string is made; see eval_refs.c. */
+    return string_coerce(obj)->hash;
 }
 
 static int string_cmp(value_t *l, value_t *r) {
     return strcmp(string_coerce(l)->string_value, string_coerce(r)->string_value);
 }
 static bool string_eq(value_t *l, value_t *r) {
+    /* Interned strings are usually identical, and unequal strings usually
+     * have different hashes, so the comparison is rarely needed. */
+    if (l == r) {
+        return true;
+    }
+    if (string_coerce(l)->hash != string_coerce(r)->hash) {
+        return false;
+    }
     return string_cmp(l, r) == 0;
 }
 
-static reference_t string_binop_add(value_t *l, value_t *r) {
-    return make_reference_string_concat(
-            string_coerce(l)->string_value,
-            string_coerce(r)->string_value);
+static reference_t string_binop_add(reference_t l, reference_t r) {
+    return make_reference_string_concat(l, r);
 }
 
 static void string_print_gen(const char *format, value_t *obj, FILE *stream, size_t depth) {
@@ -234,20 +264,21 @@ static void string_print(value_t *obj, FILE *stream, size_t depth) {
 
 /*!
  * This is a union that holds information about the available builtin
- * operations for a particular type.
+ * operations for a particular type. The operations take references rather
+ * than values, since allocating the result may move the operands.
  */
 typedef union builtin_table {
     struct {
-        reference_t (*u_negate  )(value_t *l, value_t *r);
-        reference_t (*u_identity)(value_t *l, value_t *r);
-
-        reference_t (*b_add     )(value_t *l, value_t *r);
-        reference_t (*b_subtract)(value_t *l, value_t *r);
-        reference_t (*b_multiply)(value_t *l, value_t *r);
-        reference_t (*b_divide  )(value_t *l, value_t *r);
-        reference_t (*b_modulo  )(value_t *l, value_t *r);
+        reference_t (*u_negate  )(reference_t l, reference_t r);
+        reference_t (*u_identity)(reference_t l, reference_t r);
+
+        reference_t (*b_add     )(reference_t l, reference_t r);
+        reference_t (*b_subtract)(reference_t l, reference_t r);
+        reference_t (*b_multiply)(reference_t l, reference_t r);
+        reference_t (*b_divide  )(reference_t l, reference_t r);
+        reference_t (*b_modulo  )(reference_t l, reference_t r);
     };
-    reference_t (*f_table[OP_MODULO + 1])(value_t *l, value_t *r);
+    reference_t (*f_table[OP_MODULO + 1])(reference_t l, reference_t r);
 } builtin_table_t;
 
 typedef struct func_table {
@@ -261,7 +292,7 @@ typedef struct func_table {
     builtin_table_t f_builtins;
 
     reference_t (*f_subscr_get)(value_t *obj, reference_t subscript);
-    void        (*f_subscr_set)(value_t *obj, reference_t subscript, reference_t value);
+    void        (*f_subscr_set)(reference_t obj, reference_t subscript, reference_t value);
     void        (*f_subscr_del)(value_t *obj, reference_t subscript);
 
     void        (*f_print_repr)(value_t *obj, FILE *stream, size_t depth);
@@ -353,25 +384,34 @@ bool ref_is_false(reference_t r) {
     return r == FALSE_REF;
 }
 
+/*!
+ * Returns the type of a value as far as the program can tell: a string
+ * builder is a string that hasn't been flattened yet.
+ */
+static inline value_type_t value_type(value_t *obj) {
+    return obj->type == VAL_STRING_BUILDER ? VAL_STRING : obj->type;
+}
+
 /*! Return the type of the value pointed to by the provided reference. */
 value_type_t ref_type(reference_t r) {
-    return deref(r)->type;
+    return is_tagged_int(r) ? VAL_INTEGER : value_type(deref(r));
 }
 
 /*! Return the result of coercing the reference to a bool. */
 bool ref_bool(reference_t r) {
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the bool function is not set, then error out. */
-    if (table[obj->type].f_bool == NULL) {
+    if (table[value_type(obj)].f_bool == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "object of type '%s' has no bool()", type_to_str(obj->type));
+                "object of type '%s' has no bool()", type_to_str(value_type(obj)));
         return NULL_REF;
     }
 
     /* Otherwise, dispatch to function. */
-    return table[obj->type].f_bool(obj);
+    return table[value_type(obj)].f_bool(obj);
 }
 
 /*!
@@ -379,37 +419,46 @@ bool ref_bool(reference_t r) {
  */
 int64_t ref_len(reference_t r) {
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the function table is not set for this type or the print function
      * is not set, then error out. */
-    if (table[obj->type].f_len == NULL) {
+    if (table[value_type(obj)].f_len == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "object of type '%s' has no len()", type_to_str(obj->type));
+                "object of type '%s' has no len()", type_to_str(value_type(obj)));
         return NULL_REF;
     }
 
     /* Otherwise, dispatch to function. */
-    return table[obj->type].f_len(obj);
+    return table[value_type(obj)].f_len(obj);
 }
 
 /*!
  * Return the result of calling hash() on the provided reference.
  */
 uint64_t ref_hash(reference_t r) {
+    /* Hashing a string needs its characters, so flatten it if it is a
+     * builder. This may move values, so it has to come first. */
+    string_flatten(r);
+    if (exception_occurred()) {
+        return 0;
+    }
+
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the function table is not set for this type or the print function
      * is not set, then error out. */
-    if (table[obj->type].f_hash == NULL) {
+    if (table[value_type(obj)].f_hash == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "unhashable type: '%s'", type_to_str(obj->type));
+                "unhashable type: '%s'", type_to_str(value_type(obj)));
         return NULL_REF;
     }
 
     /* Otherwise, dispatch to function. */
-    return table[obj->type].f_hash(obj);
+    return table[value_type(obj)].f_hash(obj);
 }
 
 static const char *builtin_to_str(NodeExprBuiltinType type) {
@@ -435,31 +484,34 @@ static const char *builtin_to_str(NodeExprBuiltinType type) {
 
 /*!
  * Return the result of executing the specified builtin operation.
+ * The result may be stored in an operand that the caller holds the only
+ * reference to, in which case a new reference to that operand is returned.
  */
 reference_t ref_builtin(NodeExprBuiltinType type, reference_t l, reference_t r) {
     /* Attempt to dereference the provided references. */
-    value_t *lobj = deref(l);
-    value_t *robj = deref(r);
+    integer_value_t lbox, rbox;
+    value_t *lobj = deref_boxed(l, &lbox);
+    value_t *robj = deref_boxed(r, &rbox);
 
     /* First, we make the simplifying assumption that the two values must have
      * the same type, which holds for all operations current available in
      * Subpython. Then, if the appropriate builtin function is not set for this
      * type, error out. */
-    if (lobj->type != robj->type || table[lobj->type].f_builtins.f_table[type] == NULL) {
+    if (value_type(lobj) != value_type(robj) || table[value_type(lobj)].f_builtins.f_table[type] == NULL) {
         if (is_unary_builtin(type)) {
             exception_set_format(EXC_TYPE_ERROR,
                     "bad operand type for unary %s: '%s'",
-                    builtin_to_str(type), type_to_str(lobj->type));
+                    builtin_to_str(type), type_to_str(value_type(lobj)));
         } else {
             exception_set_format(EXC_TYPE_ERROR,
                     "unsupported operand type(s) for %s: '%s' and '%s'",
-                    builtin_to_str(type), type_to_str(lobj->type), type_to_str(robj->type));
+                    builtin_to_str(type), type_to_str(value_type(lobj)), type_to_str(value_type(robj)));
         }
         return NULL_REF;
     }
 
     /* Otherwise, dispatch to function. */
-    return table[lobj->type].f_builtins.f_table[type](lobj, robj);
+    return table[value_type(lobj)].f_builtins.f_table[type](l, r);
 }
 
 /*!
@@ -468,16 +520,27 @@ reference_t ref_builtin(NodeExprBuiltinType type, reference_t l, reference_t r)
  * positive if the first is greater, and 0 if they are equal.
  */
 int compare(reference_t l, reference_t r) {
+    /* Flatten string builders before dereferencing anything, as in ref_hash(). */
+    string_flatten(l);
+    if (exception_occurred()) {
+        return 0;
+    }
+    string_flatten(r);
+    if (exception_occurred()) {
+        return 0;
+    }
+
     /* Attempt to dereference the provided references. */
-    value_t *lobj = deref(l);
-    value_t *robj = deref(r);
+    integer_value_t lbox, rbox;
+    value_t *lobj = deref_boxed(l, &lbox);
+    value_t *robj = deref_boxed(r, &rbox);
 
     /* If the operands have different types or can't be compared, error out. */
-    int (*f_cmp)(value_t *, value_t *) = table[lobj->type].f_cmp;
-    if (f_cmp == NULL || lobj->type != robj->type) {
+    int (*f_cmp)(value_t *, value_t *) = table[value_type(lobj)].f_cmp;
+    if (f_cmp == NULL || value_type(lobj) != value_type(robj)) {
         exception_set_format(EXC_TYPE_ERROR,
                 "type(s) are not comparable: '%s' and '%s'",
-                type_to_str(lobj->type), type_to_str(robj->type));
+                type_to_str(value_type(lobj)), type_to_str(value_type(robj)));
         return 0;
     }
 
@@ -509,43 +572,61 @@ reference_t ref_compare(NodeExprBuiltinType type, reference_t l, reference_t r)
 
 /*! Returns the result of comparing two objects for equality. */
 bool ref_eq(reference_t l, reference_t r) {
+    /* Flatten string builders before dereferencing anything, as in ref_hash(). */
+    string_flatten(l);
+    if (exception_occurred()) {
+        return false;
+    }
+    string_flatten(r);
+    if (exception_occurred()) {
+        return false;
+    }
+
     /* Attempt to dereference the provided references. */
-    value_t *lobj = deref(l);
-    value_t *robj = deref(r);
+    integer_value_t lbox, rbox;
+    value_t *lobj = deref_boxed(l, &lbox);
+    value_t *robj = deref_boxed(r, &rbox);
 
     /* If the operands have different types, then return false. */
-    if (lobj->type != robj->type) {
+    if (value_type(lobj) != value_type(robj)) {
         return false;
     }
 
     /* If the object type doesn't support equality comparison, then error
      * out. */
-    if (table[lobj->type].f_eq == NULL) {
+    if (table[value_type(lobj)].f_eq == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
                 "unsupported operand types for '==': '%s' and '%s'",
-                type_to_str(lobj->type), type_to_str(robj->type));
+                type_to_str(value_type(lobj)), type_to_str(value_type(robj)));
         return false;
     }
 
-    return table[lobj->type].f_eq(lobj, robj);
+    return table[value_type(lobj)].f_eq(lobj, robj);
 }
 
 /*!
  * Return the result of a subscript access to an object.
  */
 reference_t ref_subscr_get(reference_t r, reference_t subscr) {
+    /* A string subscript will be hashed or compared; see ref_hash(). */
+    string_flatten(subscr);
+    if (exception_occurred()) {
+        return NULL_REF;
+    }
+
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the subscript get function is not set, then error out. */
-    if (table[obj->type].f_subscr_get == NULL) {
+    if (table[value_type(obj)].f_subscr_get == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "'%s' object is not subscriptable", type_to_str(obj->type));
+                "'%s' object is not subscriptable", type_to_str(value_type(obj)));
         return NULL_REF;
     }
 
     /* Otherwise, dispatch to function. */
-    return table[obj->type].f_subscr_get(obj, subscr);
+    return table[value_type(obj)].f_subscr_get(obj, subscr);
 }
 
 /*!
@@ -553,35 +634,43 @@ reference_t ref_subscr_get(reference_t r, reference_t subscr) {
  */
 void ref_subscr_set(reference_t r, reference_t subscr, reference_t value) {
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the subscript set function is not set, then error out. */
-    if (table[obj->type].f_subscr_set == NULL) {
+    if (table[value_type(obj)].f_subscr_set == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "'%s' object does not support item assignment", type_to_str(obj->type));
+                "'%s' object does not support item assignment", type_to_str(value_type(obj)));
         return;
     }
 
     /* Otherwise, dispatch to function. */
-    table[obj->type].f_subscr_set(obj, subscr, value);
+    table[value_type(obj)].f_subscr_set(r, subscr, value);
 }
 
 /*!
  * Execute the deletion of an item from an object.
  */
 void ref_subscr_del(reference_t r, reference_t subscr) {
+    /* A string subscript will be hashed or compared; see ref_hash(). */
+    string_flatten(subscr);
+    if (exception_occurred()) {
+        return;
+    }
+
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the subscript del function is not set, then error out. */
-    if (table[obj->type].f_subscr_del == NULL) {
+    if (table[value_type(obj)].f_subscr_del == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "'%s' object does not support item deletion", type_to_str(obj->type));
+                "'%s' object does not support item deletion", type_to_str(value_type(obj)));
         return;
     }
 
     /* Otherwise, dispatch to function. */
-    table[obj->type].f_subscr_del(obj, subscr);
+    table[value_type(obj)].f_subscr_del(obj, subscr);
 }
 
 /*!
@@ -589,19 +678,26 @@ void ref_subscr_del(reference_t r, reference_t subscr) {
  * limited depth.
  */
 void ref_print_repr(reference_t r, FILE *stream, size_t depth) {
+    /* Printing a string needs its characters; see ref_hash(). */
+    string_flatten(r);
+    if (exception_occurred()) {
+        return;
+    }
+
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the function table is not set for this type or the print function
      * is not set, then error out. */
-    if (table[obj->type].f_print_repr == NULL) {
+    if (table[value_type(obj)].f_print_repr == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "cannot print value of type '%s'", type_to_str(obj->type));
+                "cannot print value of type '%s'", type_to_str(value_type(obj)));
         return;
     }
 
     /* Otherwise, dispatch to function. */
-    table[obj->type].f_print_repr(obj, stream, depth);
+    table[value_type(obj)].f_print_repr(obj, stream, depth);
 }
 
 /*!
@@ -609,19 +705,26 @@ void ref_print_repr(reference_t r, FILE *stream, size_t depth) {
  * limited depth.
  */
 void ref_print(reference_t r, FILE *stream, size_t depth) {
+    /* Printing a string needs its characters; see ref_hash(). */
+    string_flatten(r);
+    if (exception_occurred()) {
+        return;
+    }
+
     /* Attempt to dereference the provided reference. */
-    value_t *obj = deref(r);
+    integer_value_t box;
+    value_t *obj = deref_boxed(r, &box);
 
     /* If the function table is not set for this type or the print function
      * is not set, then error out. */
-    if (table[obj->type].f_print == NULL) {
+    if (table[value_type(obj)].f_print == NULL) {
         exception_set_format(EXC_TYPE_ERROR,
-                "cannot print value of type '%s'", type_to_str(obj->type));
+                "cannot print value of type '%s'", type_to_str(value_type(obj)));
         return;
     }
 
     /* Otherwise, dispatch to function. */
-    table[obj->type].f_print(obj, stream, depth);
+    table[value_type(obj)].f_print(obj, stream, depth);
 }
 
 /*! Print as in ref_print_repr but with an additional newline. */
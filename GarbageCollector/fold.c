@@ -0,0 +1,272 @@
+/*! \file
+ * Folds constant expressions in the AST before it is evaluated.
+ *
+ * Builtin operations, `not`, `and` and `or` whose operands are literals are
+ * replaced by the literal they evaluate to, so that they are not recomputed
+ * (and their intermediate values not allocated) every time they are reached.
+ * Operations that would raise an exception, such as dividing by zero or
+ * adding a string to an integer, are left alone so they still raise it when
+ * they are evaluated.
+ */
+
+#include "fold.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+
+static void fold_nodelist(ast_t *ast, NodeList *list) {
+    if (list == NULL) {
+        return;
+    }
+    for (NodeListEntry *entry = list->head; entry; entry = entry->next) {
+        entry->node = fold_constants(ast, entry->node);
+    }
+}
+
+static bool is_literal(Node *node) {
+    return node->type == EXPR_LITERAL_INTEGER ||
+           node->type == EXPR_LITERAL_STRING ||
+           node->type == EXPR_LITERAL_SINGLETON;
+}
+
+static int64_t integer_of(Node *node) {
+    return ((NodeExprLiteralInteger *) node)->value;
+}
+static const char *string_of(Node *node) {
+    return ((NodeExprLiteralString *) node)->value;
+}
+
+/*! Returns the truth value of a literal, as ref_bool() would. */
+static bool literal_bool(Node *node) {
+    switch (node->type) {
+        case EXPR_LITERAL_INTEGER:
+            return integer_of(node) != 0;
+        case EXPR_LITERAL_STRING:
+            return string_of(node)[0] != '\0';
+        default:
+            return ((NodeExprLiteralSingleton *) node)->singleton == S_TRUE;
+    }
+}
+
+/*!
+ * Returns whether two literals have the same type when evaluated.
+ * None and the booleans are different types.
+ */
+static bool same_type(Node *l, Node *r) {
+    if (l->type != r->type) {
+        return false;
+    }
+    if (l->type == EXPR_LITERAL_SINGLETON) {
+        return (((NodeExprLiteralSingleton *) l)->singleton == S_NONE) ==
+               (((NodeExprLiteralSingleton *) r)->singleton == S_NONE);
+    }
+    return true;
+}
+
+static Node *bool_literal(ast_t *ast, bool value, Node *otherwise) {
+    Node *node = ast_alloc_literal_singleton(ast, value ? S_TRUE : S_FALSE);
+    return node ? node : otherwise;
+}
+
+/*!
+ * Folds arithmetic on two integers. Overflow wraps around, as it does when
+ * the operation is evaluated. Returns false if the operation must be left to
+ * raise its error at run time.
+ */
+static bool fold_integer_binop(NodeExprBuiltinType type, int64_t l, int64_t r, int64_t *result) {
+    switch (type) {
+        case OP_ADD:
+            *result = (int64_t) ((uint64_t) l + (uint64_t) r);
+            return true;
+        case OP_SUBTRACT:
+            *result = (int64_t) ((uint64_t) l - (uint64_t) r);
+            return true;
+        case OP_MULTIPLY:
+            *result = (int64_t) ((uint64_t) l * (uint64_t) r);
+            return true;
+        case OP_DIVIDE:
+        case OP_MODULO:
+            if (r == 0 || (l == INT64_MIN && r == -1)) {
+                return false;
+            }
+            *result = type == OP_DIVIDE ? l / r : l % r;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Node *fold_builtin(ast_t *ast, NodeExprBuiltin *builtin) {
+    Node *node = (Node *) builtin;
+    Node *left = builtin->left;
+    Node *right = builtin->right;
+    NodeExprBuiltinType type = builtin->builtin_type;
+
+    if (!is_literal(left) || (right != NULL && !is_literal(right))) {
+        return node;
+    }
+
+    /* Unary operations are only defined on integers. */
+    if (right == NULL) {
+        if (left->type != EXPR_LITERAL_INTEGER) {
+            return node;
+        }
+        int64_t value = integer_of(left);
+        if (type == UOP_NEGATE) {
+            value = (int64_t) (0 - (uint64_t) value);
+        }
+        Node *folded = ast_alloc_literal_integer(ast, value);
+        return folded ? folded : node;
+    }
+
+    /* Values of different types are never equal, and can't be ordered. */
+    if (!same_type(left, right)) {
+        return type == COMP_EQUALS ? bool_literal(ast, false, node) : node;
+    }
+
+    if (left->type == EXPR_LITERAL_INTEGER) {
+        int64_t l = integer_of(left), r = integer_of(right);
+        switch (type) {
+            case COMP_EQUALS: return bool_literal(ast, l == r, node);
+            case COMP_LT:     return bool_literal(ast, l < r, node);
+            case COMP_GT:     return bool_literal(ast, l > r, node);
+            case COMP_LE:     return bool_literal(ast, l <= r, node);
+            case COMP_GE:     return bool_literal(ast, l >= r, node);
+            default:          break;
+        }
+
+        int64_t result;
+        if (!fold_integer_binop(type, l, r, &result)) {
+            return node;
+        }
+        Node *folded = ast_alloc_literal_integer(ast, result);
+        return folded ? folded : node;
+    }
+
+    if (left->type == EXPR_LITERAL_STRING) {
+        int cmp = strcmp(string_of(left), string_of(right));
+        switch (type) {
+            case COMP_EQUALS: return bool_literal(ast, cmp == 0, node);
+            case COMP_LT:     return bool_literal(ast, cmp < 0, node);
+            case COMP_GT:     return bool_literal(ast, cmp > 0, node);
+            case COMP_LE:     return bool_literal(ast, cmp <= 0, node);
+            case COMP_GE:     return bool_literal(ast, cmp >= 0, node);
+            default:          break;
+        }
+
+        /* Strings only support concatenation. */
+        if (type != OP_ADD) {
+            return node;
+        }
+        size_t len1 = strlen(string_of(left));
+        char *value = arena_malloc(ast->arena, len1 + strlen(string_of(right)) + 1);
+        if (value == NULL) {
+            return node;
+        }
+        strcpy(value, string_of(left));
+        strcpy(value + len1, string_of(right));
+        Node *folded = ast_alloc_literal_string(ast, value);
+        return folded ? folded : node;
+    }
+
+    /* The singletons only support equality. */
+    if (type == COMP_EQUALS) {
+        return bool_literal(ast,
+                ((NodeExprLiteralSingleton *) left)->singleton ==
+                ((NodeExprLiteralSingleton *) right)->singleton, node);
+    }
+    return node;
+}
+
+/*!
+ * Folds the constant expressions within an AST node, and returns the node
+ * to use in its place. The node itself may be updated in place.
+ */
+Node *fold_constants(ast_t *ast, Node *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+
+    switch (node->type) {
+        case STMT_SEQUENCE:
+            fold_nodelist(ast, ((NodeStmtSequence *) node)->statements);
+            break;
+        case STMT_ASSIGN: {
+            NodeStmtAssign *assign = (NodeStmtAssign *) node;
+            assign->right = fold_constants(ast, assign->right);
+            break;
+        }
+        case STMT_IF: {
+            NodeStmtIf *ifn = (NodeStmtIf *) node;
+            ifn->cond = fold_constants(ast, ifn->cond);
+            ifn->left = fold_constants(ast, ifn->left);
+            ifn->right = fold_constants(ast, ifn->right);
+            break;
+        }
+        case STMT_WHILE: {
+            NodeStmtWhile *whilen = (NodeStmtWhile *) node;
+            whilen->cond = fold_constants(ast, whilen->cond);
+            whilen->body = fold_constants(ast, whilen->body);
+            break;
+        }
+
+        case EXPR_LITERAL_LIST:
+            fold_nodelist(ast, ((NodeExprLiteralList *) node)->values);
+            break;
+        case EXPR_LITERAL_DICT:
+            fold_nodelist(ast, ((NodeExprLiteralDict *) node)->keys);
+            fold_nodelist(ast, ((NodeExprLiteralDict *) node)->values);
+            break;
+
+        case EXPR_NOT_TEST: {
+            NodeExprNotTest *test = (NodeExprNotTest *) node;
+            test->operand = fold_constants(ast, test->operand);
+            if (is_literal(test->operand)) {
+                return bool_literal(ast, !literal_bool(test->operand), node);
+            }
+            break;
+        }
+        case EXPR_AND_TEST: {
+            /* A literal left operand decides which operand is the result. */
+            NodeExprAndTest *test = (NodeExprAndTest *) node;
+            test->left = fold_constants(ast, test->left);
+            test->right = fold_constants(ast, test->right);
+            if (is_literal(test->left)) {
+                return literal_bool(test->left) ? test->right : test->left;
+            }
+            break;
+        }
+        case EXPR_OR_TEST: {
+            NodeExprOrTest *test = (NodeExprOrTest *) node;
+            test->left = fold_constants(ast, test->left);
+            test->right = fold_constants(ast, test->right);
+            if (is_literal(test->left)) {
+                return literal_bool(test->left) ? test->left : test->right;
+            }
+            break;
+        }
+
+        case EXPR_BUILTIN: {
+            NodeExprBuiltin *builtin = (NodeExprBuiltin *) node;
+            builtin->left = fold_constants(ast, builtin->left);
+            builtin->right = fold_constants(ast, builtin->right);
+            return fold_builtin(ast, builtin);
+        }
+        case EXPR_CALL:
+            fold_nodelist(ast, ((NodeExprCall *) node)->args);
+            break;
+        case EXPR_SUBSCRIPT: {
+            NodeExprSubscript *subscript = (NodeExprSubscript *) node;
+            subscript->obj = fold_constants(ast, subscript->obj);
+            subscript->index = fold_constants(ast, subscript->index);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return node;
+}
@@ -0,0 +1,8 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.h"
+
+Node *fold_constants(ast_t *ast, Node *node);
+
+#endif /* FOLD_H */
@@ -1,7 +1,11 @@
 /*! \file
  * Implements a simple memory allocator for a region of memory.
- * The allocator uses a singly-linked explicit free list
- * and can perform splits but not coalesces.
+ * Fresh memory is handed out by bumping a pointer through the untouched
+ * end of the pool. Values freed by reference counting go on a
+ * singly-linked explicit free list, which can perform splits but not
+ * coalesces. Semispaces only fall back on it once the bump pointer runs
+ * out, since the next copying collection reclaims the freed values anyway. Large values may instead go in a large-object space made of
+ * whole pages, which are tracked in a page map.
  */
 
 #include "mm.h"
@@ -9,6 +13,7 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "refs.h"
 #include "eval.h"
@@ -20,12 +25,67 @@ static size_t memory_size;
 /*! The start of the memory pool. */
 static uint8_t *memory_pool;
 
+/*!
+ * The bump pointer: everything from here up to the end of the pool has
+ * never been allocated since the last mm_init(). After a copying collection
+ * the live values are packed below it, so new values and copies are placed
+ * with a pointer increment and a limit check.
+ */
+static uint8_t *bump;
+
+/*! The end of the memory pool, which bounds the bump pointer. */
+static uint8_t *limit;
+
+/*!
+ * Whether to allocate at the bump pointer whenever the value fits there,
+ * instead of looking for the best fit in the free list first.
+ */
+static bool bump_first;
+
+/*!
+ * The number of bytes in allocated values, kept up to date so that the
+ * occupancy check on every allocation does not have to walk the free list.
+ */
+static size_t bytes_used;
+
+/*!
+ * The nursery, an optional second region where new values are allocated by
+ * the generational collector. It is only ever bump-allocated; freed values
+ * stay in place until the survivors are promoted and the nursery is emptied.
+ * nursery_top is the nursery's bump pointer.
+ */
+static uint8_t *nursery_start, *nursery_top, *nursery_end;
+
+/*! The number of bytes in allocated values in the nursery. */
+static size_t nursery_bytes_used;
+
+/*!
+ * The large-object space, an optional third region for values that are too
+ * big to be worth copying. Each value takes up a run of whole pages from
+ * large_start on. The page map, stored in the first pages of the region, has
+ * one entry per page, and the first page of a value also carries its mark.
+ */
+static uint8_t *large_start, *large_end;
+static uint8_t *large_pages;
+static size_t num_large_pages;
+
+/*! The number of bytes in pages that hold large values. */
+static size_t large_bytes_used;
+
+/*! The entries of the large-object space's page map. */
+enum {
+    PAGE_FREE = 0,
+    PAGE_FIRST = 1,   /*!< The first page of a value. */
+    PAGE_REST = 2,    /*!< A later page of a value. */
+    PAGE_MARKED = 4   /*!< Set along with PAGE_FIRST if the value is marked. */
+};
+
 /*!
  * The payloads of free values, used to construct an explicit free list.
  * The allocator performs splits but not coalesces,
  * so the free list doesn't need to be doubly-linked.
- * The allocator tries to satisfy requests with the best-fit block in the list,
- * and expands the end of the heap if no block is large enough.
+ * The allocator tries to satisfy requests with the best-fit block in the list
+ * or the unallocated end of the pool, which is treated like one more block.
  * Hopefully this looks familiar from the malloc assignment!
  */
 typedef struct free_value free_value_t;
@@ -51,15 +111,56 @@ void mm_init(size_t size, void *pool) {
     memory_size = size;
     memory_pool = pool;
 
-    /* Make the entire pool a free value. */
-    free_list = pool;
-    free_list->type = VAL_FREE;
-    free_list->next = NULL;
-    free_list->value_size = size;
+    /* The entire pool is unallocated, so there are no free values yet. */
+    bump = memory_pool;
+    limit = memory_pool + memory_size;
+    free_list = NULL;
+    bytes_used = 0;
+}
+
+void mm_prefer_bump(bool prefer) {
+    bump_first = prefer;
+}
+
+void mm_resize(size_t size) {
+    assert(__atomic_load_n(&bump, __ATOMIC_RELAXED) <= memory_pool + size);
+    memory_size = size;
+    __atomic_store_n(&limit, memory_pool + memory_size, __ATOMIC_RELAXED);
+}
+
+/*!
+ * Allocates a value of the given size at the bump pointer.
+ * If the rest of the pool would be too small to hold another value,
+ * it is included in this value, just like a free value that is not split.
+ */
+static value_t *bump_malloc(size_t size) {
+    value_t *value = (value_t *) bump;
+    size_t remaining_size = (size_t) (limit - bump) - size;
+    if (remaining_size > sizeof(value_t)) {
+        bump += size;
+    }
+    else {
+        size += remaining_size;
+        bump = limit;
+    }
+    value->type = VAL_FREE;
+    value->value_size = size;
+    bytes_used += size;
+    return value;
 }
 
 value_t *mm_malloc(size_t size) {
-    /* Use a best-fit algorithm to search for a free value to use. */
+    /* Without any freed values to reuse, or if they are left to the next
+     * collection, allocation is just a pointer increment. */
+    size_t tail_size = (size_t) (limit - bump);
+    if ((bump_first || free_list == NULL) && size <= tail_size) {
+        return bump_malloc(size);
+    }
+
+    /*
+     * Use a best-fit algorithm to search for a free value to use,
+     * treating the unallocated end of the pool as one more candidate.
+     */
     free_value_t **best_fit = NULL;
     size_t smallest_size = SIZE_MAX;
     for (
@@ -71,8 +172,16 @@ value_t *mm_malloc(size_t size) {
         if (free_size >= size && free_size < smallest_size) {
             smallest_size = free_size;
             best_fit = free_value;
+            /* Nothing fits better than an exact fit. Most values have one of
+             * a few sizes, so this usually ends the search early. */
+            if (free_size == size) {
+                break;
+            }
         }
     }
+    if (tail_size >= size && tail_size < smallest_size) {
+        return bump_malloc(size);
+    }
     /* Report an error if there is no remaining space. */
     if (best_fit == NULL) {
         exception_set_format(EXC_MEMORY_ERROR,
@@ -96,12 +205,247 @@ value_t *mm_malloc(size_t size) {
         /* Otherwise, just remove this value from the free list. */
         *best_fit = (*best_fit)->next;
     }
+    bytes_used += value->value_size;
     /* Return the best-fit block. */
     return value;
 }
 
+bool mm_grow(value_t *value, size_t size) {
+    assert(size >= value->value_size);
+    size_t extra = size - value->value_size;
+    uint8_t *end = (uint8_t *) value + value->value_size;
+
+    /* The large-object space may end where the pool begins. */
+    if (is_large_address(value)) {
+        return false;
+    }
+    if (end == nursery_top && extra <= (size_t) (nursery_end - nursery_top)) {
+        nursery_top += extra;
+        nursery_bytes_used += extra;
+    } else if (end == bump && extra <= (size_t) (limit - bump)) {
+        /* Like bump_malloc(), don't leave a tail too small to hold a value. */
+        if ((size_t) (limit - bump) - extra <= sizeof(value_t)) {
+            extra = limit - bump;
+        }
+        bump += extra;
+        bytes_used += extra;
+    } else {
+        return false;
+    }
+
+    value->value_size += extra;
+    return true;
+}
+
+value_t *mm_copy(value_t *value) {
+    size_t size = value->value_size;
+    if (size > (size_t) (limit - bump)) {
+        return NULL;
+    }
+    value_t *copy = (value_t *) bump;
+    memmove(copy, value, size);
+    bump += size;
+    bytes_used += size;
+    return copy;
+}
+
+void *mm_reserve(size_t min_size, size_t *size) {
+    /* Several threads may reserve at once, so the bump pointer is claimed
+     * with a compare-and-swap. */
+    uint8_t *start = __atomic_load_n(&bump, __ATOMIC_RELAXED);
+    size_t reserved;
+    do {
+        size_t tail_size = (size_t) (__atomic_load_n(&limit, __ATOMIC_RELAXED) - start);
+        if (tail_size < min_size) {
+            return NULL;
+        }
+        reserved = *size < tail_size ? *size : tail_size;
+        if (reserved > min_size && reserved - min_size < sizeof(value_t)) {
+            reserved = min_size;
+        }
+    } while (!__atomic_compare_exchange_n(&bump, &start, start + reserved, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&bytes_used, reserved, __ATOMIC_RELAXED);
+    *size = reserved;
+    return start;
+}
+
+void mm_unreserve(void *start, size_t size) {
+    if ((uint8_t *) start + size == bump) {
+        bump = start;
+        bytes_used -= size;
+        return;
+    }
+    value_t *value = start;
+    value->value_size = size;
+    mm_free(value);
+}
+
+void *mm_top(void) {
+    return bump;
+}
+
+size_t mm_unallocated(void) {
+    return limit - bump;
+}
+
+void mm_init_nursery(size_t size, void *region) {
+    nursery_start = region;
+    nursery_top = region;
+    nursery_end = nursery_start + size;
+    nursery_bytes_used = 0;
+}
+
+value_t *mm_nursery_malloc(size_t size) {
+    if (size > (size_t) (nursery_end - nursery_top)) {
+        return NULL;
+    }
+    value_t *value = (value_t *) nursery_top;
+    nursery_top += size;
+    nursery_bytes_used += size;
+    value->type = VAL_FREE;
+    value->value_size = size;
+    return value;
+}
+
+size_t mm_nursery_allocated(void) {
+    return nursery_top - nursery_start;
+}
+
+void mm_nursery_reset(void) {
+    nursery_top = nursery_start;
+    nursery_bytes_used = 0;
+}
+
+bool is_nursery_address(void *addr) {
+    return (uint8_t *) addr >= nursery_start &&
+           (uint8_t *) addr <  nursery_top;
+}
+
+bool is_nursery_region(void *addr) {
+    return (uint8_t *) addr >= nursery_start &&
+           (uint8_t *) addr <  nursery_end;
+}
+
+void mm_init_large(size_t size, void *region) {
+    /* The page map takes one byte per page from the front of the region. */
+    size_t pages = size / MM_PAGE_SIZE;
+    size_t map_pages = (pages + MM_PAGE_SIZE) / (MM_PAGE_SIZE + 1);
+    large_pages = region;
+    num_large_pages = pages - map_pages;
+    large_start = (uint8_t *) region + map_pages * MM_PAGE_SIZE;
+    large_end = large_start + num_large_pages * MM_PAGE_SIZE;
+    large_bytes_used = 0;
+    if (num_large_pages > 0) {
+        memset(large_pages, PAGE_FREE, num_large_pages);
+    }
+}
+
+/*! Returns the number of pages that a large value of the given size takes up. */
+static size_t large_value_pages(size_t size) {
+    return (size + MM_PAGE_SIZE - 1) / MM_PAGE_SIZE;
+}
+
+/*! Returns the page map entry for the first page of a large value. */
+static uint8_t *large_page_entry(value_t *value) {
+    return &large_pages[((uint8_t *) value - large_start) / MM_PAGE_SIZE];
+}
+
+value_t *mm_large_malloc(size_t size) {
+    /* Use the first run of free pages that is long enough. */
+    size_t pages = large_value_pages(size);
+    size_t run = 0;
+    for (size_t i = 0; i < num_large_pages; i++) {
+        run = large_pages[i] == PAGE_FREE ? run + 1 : 0;
+        if (run == pages) {
+            size_t first = i + 1 - pages;
+            large_pages[first] = PAGE_FIRST;
+            memset(&large_pages[first + 1], PAGE_REST, pages - 1);
+            large_bytes_used += pages * MM_PAGE_SIZE;
+
+            value_t *value = (value_t *) (large_start + first * MM_PAGE_SIZE);
+            value->type = VAL_FREE;
+            value->value_size = size;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+bool is_large_address(void *addr) {
+    return (uint8_t *) addr >= large_start &&
+           (uint8_t *) addr <  large_end;
+}
+
+bool mm_mark_large(value_t *value) {
+    uint8_t old = __atomic_fetch_or(large_page_entry(value), PAGE_MARKED,
+            __ATOMIC_RELAXED);
+    return !(old & PAGE_MARKED);
+}
+
+bool mm_is_large_marked(value_t *value) {
+    return *large_page_entry(value) & PAGE_MARKED;
+}
+
+/*! Returns the pages of a large value to the large-object space. */
+static void large_free(value_t *value) {
+    size_t pages = large_value_pages(value->value_size);
+    memset(large_page_entry(value), PAGE_FREE, pages);
+    large_bytes_used -= pages * MM_PAGE_SIZE;
+    value->type = VAL_FREE;
+}
+
+void mm_sweep_large(void (*f)(value_t *value)) {
+    for (size_t i = 0; i < num_large_pages; i++) {
+        if (large_pages[i] == (PAGE_FIRST | PAGE_MARKED)) {
+            large_pages[i] = PAGE_FIRST;
+        } else if (large_pages[i] == PAGE_FIRST) {
+            value_t *value = (value_t *) (large_start + i * MM_PAGE_SIZE);
+            if (f != NULL) {
+                f(value);
+            }
+            large_free(value);
+        }
+    }
+}
+
+/*! Calls f on each allocated value between start and end. */
+static void foreach_value_in(uint8_t *start, uint8_t *end, void (*f)(value_t *value)) {
+    for (uint8_t *p = start; p < end; p += ((value_t *) p)->value_size) {
+        if (((value_t *) p)->type != VAL_FREE) {
+            f((value_t *) p);
+        }
+    }
+}
+
+void mm_foreach_value(void (*f)(value_t *value)) {
+    foreach_value_in(memory_pool, bump, f);
+    foreach_value_in(nursery_start, nursery_top, f);
+    for (size_t i = 0; i < num_large_pages; i++) {
+        if (large_pages[i] & PAGE_FIRST) {
+            f((value_t *) (large_start + i * MM_PAGE_SIZE));
+        }
+    }
+}
+
+void mm_foreach_nursery_value(void (*f)(value_t *value)) {
+    foreach_value_in(nursery_start, nursery_top, f);
+}
+
 void mm_free(value_t *value) {
+    /* Nursery values are reclaimed all at once when the nursery is emptied. */
+    if (is_nursery_address(value)) {
+        value->type = VAL_FREE;
+        nursery_bytes_used -= value->value_size;
+        return;
+    }
+    if (is_large_address(value)) {
+        large_free(value);
+        return;
+    }
+
     value->type = VAL_FREE;
+    bytes_used -= value->value_size;
     free_value_t *free_value = (free_value_t *) value;
     free_value->next = free_list;
     free_list = free_value;
@@ -115,83 +459,144 @@ bool is_pool_address(void *addr) {
            (uint8_t *) addr <  memory_pool + memory_size;
 }
 
+size_t mm_pool_used(void) {
+    return bytes_used;
+}
+
 size_t mem_used() {
-    /* Subtract each free block from the total memory size. */
-    size_t used = memory_size;
-    for (
-        free_value_t *free_value = free_list;
-        free_value != NULL;
-        free_value = free_value->next
-    ) {
-        used -= free_value->value_size;
-    }
-    return used;
+    return bytes_used + nursery_bytes_used + large_bytes_used;
 }
 
-void mem_dump() {
-    for (size_t offset = 0, value_size; offset < memory_size; offset += value_size) {
-        value_t *value = (value_t *) (memory_pool + offset);
-        value_size = value->value_size;
+/*! Prints an allocated value, which is at the given offset in its region. */
+static void dump_value(value_t *value, size_t offset) {
+    size_t value_size = value->value_size;
+    reference_t ref = get_ref(value);
+    fprintf(stdout, "Value 0x%08zx; size %zu; ref %d; refcnt: %zu; ",
+        offset, value_size, ref, value->ref_count);
 
-        /* If this is a free value, continue to the next one. */
-        if (value->type == VAL_FREE) {
-            fprintf(stdout, "Free  0x%08zx; size %zu\n", offset, value_size);
-            continue;
-        }
+    switch (value->type) {
+        case VAL_NONE:
+            fprintf(stdout, "type = VAL_NONE; value = None\n");
+            break;
 
-        reference_t ref = get_ref(value);
-        fprintf(stdout, "Value 0x%08zx; size %zu; ref %d; refcnt: %zu; ",
-            offset, value_size, ref, value->ref_count);
+        case VAL_BOOL:
+            fprintf(stdout, "type = VAL_BOOL; value = %s\n",
+                        ref_is_true(ref) ? "True" : "False");
+            break;
 
-        switch (value->type) {
-            case VAL_NONE:
-                fprintf(stdout, "type = VAL_NONE; value = None\n");
-                break;
+        case VAL_INTEGER:
+            fprintf(stdout, "type = VAL_INTEGER: value = %" PRIi64 "\n",
+                ((integer_value_t *) value)->integer_value);
+            break;
 
-            case VAL_BOOL:
-                fprintf(stdout, "type = VAL_BOOL; value = %s\n",
-                            ref_is_true(ref) ? "True" : "False");
-                break;
+        case VAL_STRING:
+            fprintf(stdout, "type = VAL_STRING; value = \"%s\"\n",
+                ((string_value_t *) value)->string_value);
+            break;
 
-            case VAL_INTEGER:
-                fprintf(stdout, "type = VAL_INTEGER: value = %" PRIi64 "\n",
-                    ((integer_value_t *) value)->integer_value);
-                break;
+        case VAL_STRING_BUILDER: {
+            string_builder_value_t *sbv = (string_builder_value_t *) value;
+            fprintf(stdout,
+                "type = VAL_STRING_BUILDER; length = %zu; chunks = %d (%zu used)\n",
+                sbv->length, sbv->chunks, sbv->num_chunks);
+            break;
+        }
 
-            case VAL_STRING:
-                fprintf(stdout, "type = VAL_STRING; value = \"%s\"\n",
-                    ((string_value_t *) value)->string_value);
-                break;
+        case VAL_LIST:
+            fprintf(stdout, "type = VAL_LIST; values = %d\n",
+                ((list_value_t *) value)->values);
+            break;
 
-            case VAL_LIST:
-                fprintf(stdout, "type = VAL_LIST; values = %d\n",
-                    ((list_value_t *) value)->values);
-                break;
+        case VAL_DICT: {
+            dict_value_t *dict = (dict_value_t *) value;
+            fprintf(stdout,
+                "type = VAL_DICT; index = %d; entries = %d\n",
+                dict->index, dict->entries);
+            break;
+        }
 
-            case VAL_DICT: {
-                dict_value_t *dict = (dict_value_t *) value;
-                fprintf(stdout,
-                    "type = VAL_DICT; keys = %d; values = %d\n",
-                    dict->keys, dict->values);
-                break;
+        case VAL_REF_ARRAY: {
+            ref_array_value_t *rav = (ref_array_value_t *) value;
+            fprintf(stdout, "type = VAL_REF_ARRAY; values = [");
+            for (size_t i = 0; i < rav->capacity; i++) {
+                if (i > 0) {
+                    fprintf(stdout, ", ");
+                }
+                fprintf(stdout, "%d", rav->values[i]);
             }
+            fprintf(stdout, "]\n");
+            break;
+        }
 
-            case VAL_REF_ARRAY: {
-                ref_array_value_t *rav = (ref_array_value_t *) value;
-                fprintf(stdout, "type = VAL_REF_ARRAY; values = [");
-                for (size_t i = 0; i < rav->capacity; i++) {
-                    if (i > 0) {
-                        fprintf(stdout, ", ");
-                    }
-                    fprintf(stdout, "%d", rav->values[i]);
+        case VAL_DICT_INDEX: {
+            dict_index_value_t *div = (dict_index_value_t *) value;
+            fprintf(stdout, "type = VAL_DICT_INDEX; capacity = %zu; width = %zu\n",
+                div->capacity, div->width);
+            break;
+        }
+
+        case VAL_DICT_ENTRIES: {
+            dict_entries_value_t *dev = (dict_entries_value_t *) value;
+            fprintf(stdout, "type = VAL_DICT_ENTRIES; entries = [");
+            for (size_t i = 0; i < dev->capacity; i++) {
+                if (i > 0) {
+                    fprintf(stdout, ", ");
                 }
-                fprintf(stdout, "]\n");
-                break;
+                fprintf(stdout, "%d: %d", dev->entries[i].key, dev->entries[i].value);
             }
+            fprintf(stdout, "]\n");
+            break;
+        }
 
-            default:
-                fprintf(stdout,
-                        "type = UNKNOWN; the memory pool is probably corrupt\n");
+        default:
+            fprintf(stdout,
+                    "type = UNKNOWN; the memory pool is probably corrupt\n");
+    }
+}
+
+/*! Prints the values between start and end, at offsets relative to start. */
+static void dump_region(uint8_t *start, uint8_t *end) {
+    size_t allocated = end - start;
+    for (size_t offset = 0, value_size; offset < allocated; offset += value_size) {
+        value_t *value = (value_t *) (start + offset);
+        value_size = value->value_size;
+
+        /* If this is a free value, continue to the next one. */
+        if (value->type == VAL_FREE) {
+            fprintf(stdout, "Free  0x%08zx; size %zu\n", offset, value_size);
+            continue;
+        }
+        dump_value(value, offset);
+    }
+}
+
+void mem_dump() {
+    dump_region(memory_pool, bump);
+
+    /* The unallocated end of the pool is printed as one free region. */
+    size_t allocated = bump - memory_pool;
+    if (allocated < memory_size) {
+        fprintf(stdout, "Free  0x%08zx; size %zu\n",
+            allocated, memory_size - allocated);
+    }
+
+    if (nursery_end > nursery_start) {
+        fprintf(stdout, "Nursery:\n");
+        dump_region(nursery_start, nursery_top);
+        if (nursery_top < nursery_end) {
+            fprintf(stdout, "Free  0x%08zx; size %zu\n",
+                (size_t) (nursery_top - nursery_start),
+                (size_t) (nursery_end - nursery_top));
+        }
+    }
+
+    if (large_bytes_used > 0) {
+        fprintf(stdout, "Large objects:\n");
+        for (size_t i = 0; i < num_large_pages; i++) {
+            if (large_pages[i] & PAGE_FIRST) {
+                dump_value((value_t *) (large_start + i * MM_PAGE_SIZE),
+                    i * MM_PAGE_SIZE);
+            }
         }
     }
 }
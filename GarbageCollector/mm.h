@@ -8,12 +8,136 @@
 /*! Initializes a memory pool in the given region of the given size in bytes. */
 void mm_init(size_t size, void *pool);
 
+/*!
+ * Makes mm_malloc() allocate at the bump pointer whenever there is room,
+ * and only look in the free list when there isn't. This suits pools whose
+ * free values are reclaimed by copying collections. Otherwise the free list
+ * is searched first for the best fit.
+ */
+void mm_prefer_bump(bool prefer);
+
+/*!
+ * Changes the size of the memory pool, which stays in the same region. The
+ * region must be big enough, and everything allocated must fit in the new size.
+ * The pool may grow while other threads call mm_reserve().
+ */
+void mm_resize(size_t size);
+
 /*!
  * Allocates and returns a block of the given size.
  * Returns NULL and sets a subpython exception if out of memory.
  */
 value_t *mm_malloc(size_t size);
 
+/*!
+ * Grows a value in place to the given size, which must be a multiple of the
+ * alignment. This only works for the value most recently placed at the bump
+ * pointer of the pool or the nursery, and only if there is room after it.
+ * Returns whether the value was grown.
+ */
+bool mm_grow(value_t *value, size_t size);
+
+/*!
+ * Copies a value to the bump pointer and returns the copy,
+ * or NULL if the unallocated end of the pool is too small.
+ * Consecutive copies are placed back to back, so a collector can scan them.
+ * The value may overlap its copy, so a compacting collector can slide
+ * values down within the pool after re-initializing it.
+ */
+value_t *mm_copy(value_t *value);
+
+/*!
+ * Reserves between min_size and *size bytes at the bump pointer, and stores
+ * the number reserved in *size. Returns NULL if fewer than min_size are left.
+ * Any bytes reserved beyond min_size are enough to hold a value.
+ * Unlike the other functions here, this may be called from several threads
+ * at once, so that each can copy values into a buffer of its own.
+ */
+void *mm_reserve(size_t min_size, size_t *size);
+
+/*!
+ * Returns the unused end of a reserved region, which must be able to hold a
+ * value. It is freed, or handed back to the bump pointer if it ends there.
+ */
+void mm_unreserve(void *start, size_t size);
+
+/*!
+ * Returns the current bump pointer. The values allocated since mm_init()
+ * lie back to back from the start of the pool up to this address.
+ */
+void *mm_top(void);
+
+/*! Returns the number of bytes between the bump pointer and the end of the pool. */
+size_t mm_unallocated(void);
+
+/*!
+ * Uses the given region of the given size in bytes as a nursery for new values,
+ * separate from the memory pool. mm_free() and mem_used() cover it as well.
+ */
+void mm_init_nursery(size_t size, void *region);
+
+/*! Allocates a value in the nursery, or returns NULL if the nursery is full. */
+value_t *mm_nursery_malloc(size_t size);
+
+/*! Returns the number of bytes handed out by the nursery since it was emptied. */
+size_t mm_nursery_allocated(void);
+
+/*!
+ * Empties the nursery once its survivors have been moved elsewhere.
+ * The old values stay readable until the nursery is used again.
+ */
+void mm_nursery_reset(void);
+
+/*! Returns whether the specified address is within an allocated part of the nursery. */
+bool is_nursery_address(void *addr);
+
+/*! Returns whether the specified address is anywhere within the nursery. */
+bool is_nursery_region(void *addr);
+
+/*! The size of the pages that the large-object space is divided into. */
+#define MM_PAGE_SIZE 4096
+
+/*!
+ * Uses the given page-aligned region of the given size in bytes as a
+ * large-object space, separate from the memory pool. Each value in it takes
+ * up whole pages and never moves, so collectors mark it in place instead of
+ * copying it. mm_free(), mem_used() and mm_foreach_value() cover it as well.
+ */
+void mm_init_large(size_t size, void *region);
+
+/*!
+ * Allocates a value in the large-object space. Returns NULL, without setting
+ * an exception, if there are not enough free pages in a row.
+ */
+value_t *mm_large_malloc(size_t size);
+
+/*! Returns whether the specified address is within the large-object space. */
+bool is_large_address(void *addr);
+
+/*!
+ * Marks a value in the large-object space as live, and returns whether it
+ * was unmarked. Like mm_reserve(), this may be called from several threads.
+ */
+bool mm_mark_large(value_t *value);
+
+/*! Returns whether a value in the large-object space is marked. */
+bool mm_is_large_marked(value_t *value);
+
+/*!
+ * Frees the unmarked values in the large-object space, calling f on each one
+ * first unless f is NULL, and unmarks the rest.
+ */
+void mm_sweep_large(void (*f)(value_t *value));
+
+/*!
+ * Calls f on every allocated value in the memory pool, the nursery and the
+ * large-object space.
+ */
+void mm_foreach_value(void (*f)(value_t *value));
+
+/*! Calls f on every allocated value in the nursery. */
+void mm_foreach_nursery_value(void (*f)(value_t *value));
+
 /*!
  * Adds a value to the free list so it can be used for future allocations.
  * The value's type is also set to VAL_FREE.
@@ -23,6 +147,9 @@ void mm_free(value_t *value);
 /*! Returns whether the specified address is within the memory pool. */
 bool is_pool_address(void *addr);
 
+/*! Returns the number of bytes in allocated values in the memory pool alone. */
+size_t mm_pool_used(void);
+
 /*! Returns the number of bytes of used memory. */
 size_t mem_used(void);
 
@@ -1,5 +1,6 @@
 #include "parser.h"
 
+#include "fold.h"
 #include "grammar.h"
 
 static void parser_init(parser_t *obj, bool interactive, FILE *stream) {
@@ -44,6 +45,11 @@ parse_result_t parse(bool interactive, FILE *stream) {
         .ast = parser.ast
     };
 
+    /* Simplify the program before anyone evaluates it. */
+    if (result.type == RESULT_SUCCESS) {
+        result.ast.root = fold_constants(&result.ast, result.ast.root);
+    }
+
     parser_destroy(&parser);
     return result;
 }
@@ -2,6 +2,12 @@
  * Manages references to values allocated in a memory pool.
  * Implements reference counting and garbage collection.
  *
+ * Minor collections of the nursery have no write barrier or remembered set.
+ * They count the references that nursery values hold to each other, and
+ * treat any nursery value with a larger reference count as a root: the
+ * surplus comes from old values, globals or the evaluator. So storing a
+ * reference never needs to tell the collector.
+ *
  * Adapted from Andre DeHon's CS24 2004, 2006 material.
  * Copyright (C) California Institute of Technology, 2004-2010.
  * All rights reserved.
@@ -10,11 +16,16 @@
 #include "refs.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "config.h"
 #include "eval.h"
+#include "exception.h"
 #include "mm.h"
 
 /*! The alignment of value_t structs in the memory pool. */
@@ -24,15 +35,70 @@
 //// MODULE-LOCAL STATE ////
 
 /*!
- * The start of the allocated memory pool.
- * Stored so that it can be free()d when the interpreter exits.
+ * The start of the memory pool, a mapping whose pages are only committed when
+ * they are first used. Stored so that it can be unmapped when the interpreter
+ * exits.
  */
 static void *pool;
+static size_t reserved_size;
 
 static void *from_space = NULL;
 static void *to_space = NULL;
 static size_t pool_size = 0;
 
+/*!
+ * The bounds on pool_size. The -M maximum is reserved once for the whole
+ * pool, and what is left after the large-object space and the nursery is
+ * split between the semispaces. So each has max_pool_size bytes reserved, and
+ * can grow in place, and it shrinks no further than its initial size.
+ */
+static size_t min_pool_size = 0;
+static size_t max_pool_size = 0;
+
+/*!
+ * After a collection, the semispaces double if more than this percentage of
+ * them is still in use, and halve if less than POOL_SHRINK_PERCENT is.
+ */
+#define POOL_GROW_PERCENT 50
+#define POOL_SHRINK_PERCENT 10
+
+/*!
+ * The algorithm used by collect_garbage. The compacting collector has no
+ * to_space and uses the whole pool as from_space.
+ */
+static collector_t collector;
+
+/*!
+ * The size of the nursery, or 0 if new values are allocated directly in the
+ * semispaces. With a nursery, the semispaces hold the old generation:
+ * values that survived a minor collection of the nursery are promoted there.
+ */
+static size_t nursery_size = 0;
+
+/*!
+ * Values at least this large are allocated directly in the old generation,
+ * so that a few big arrays do not force a minor collection on their own.
+ */
+#define NURSERY_LARGE_FRACTION 4
+
+/*!
+ * The size of the large-object space, or 0 if there is none. It takes up the
+ * start of the memory pool, and holds the values of at least LARGE_VALUE_SIZE
+ * bytes. Collections mark them in place and sweep the garbage instead of
+ * copying or sliding them.
+ */
+static size_t large_size = 0;
+
+#define LARGE_VALUE_SIZE (2 * MM_PAGE_SIZE)
+
+/*!
+ * During a copying collection, the marked large values whose children have
+ * not been copied yet. They are not in the to space, so the Cheney scan
+ * would miss them. Its capacity is num_refs.
+ */
+static reference_t *large_stack;
+static reference_t large_top;
+
 
 /*!
  * This is the "reference table", which maps references to value_t pointers.
@@ -41,6 +107,9 @@ static size_t pool_size = 0;
  */
 static value_t **ref_table;
 
+/*! The read-only view of ref_table that deref() uses; see refs.h. */
+value_t *const *ref_values;
+
 /*!
  * This is the number of references currently in the table, including unused ones.
  * Valid entries are in the range 0 .. num_refs - 1.
@@ -53,6 +122,165 @@ static reference_t num_refs;
  */
 static reference_t max_refs;
 
+/*!
+ * A stack of the unused references below num_refs, so that assigning and
+ * releasing a reference is O(1). The top of the stack is the last entry;
+ * it is rebuilt in descending order after each collection so that the
+ * lowest unused references are handed out first. Its capacity is max_refs.
+ */
+static reference_t *free_refs;
+
+/*! The number of references currently on the free_refs stack. */
+static reference_t num_free_refs;
+
+/*!
+ * The references that were given a nursery value since the nursery was last
+ * emptied, so that a minor collection looks at these instead of the whole
+ * ref_table. Some may have been freed or moved out of the nursery since.
+ * Each reference appears at most once, so the capacity is max_refs.
+ */
+static reference_t *nursery_refs;
+
+/*! The number of references in nursery_refs. */
+static reference_t num_nursery_refs;
+
+/*!
+ * The position of each reference in nursery_refs, indexed by reference. It is
+ * only meaningful if that position holds the reference, so emptying the list
+ * does not need to clear it.
+ */
+static reference_t *nursery_slots;
+
+/*!
+ * When mem_used() would exceed this many bytes, make_ref collects garbage
+ * before allocating. SIZE_MAX disables the occupancy trigger.
+ */
+static size_t gc_limit = SIZE_MAX;
+
+/*! The occupancy trigger as a percentage of the pool, or -1 if disabled. */
+static int gc_trigger = -1;
+
+/*! When init_refs() was called, to turn the bytes allocated into a rate. */
+static struct timespec start_time;
+
+/*!
+ * During a collection, the number of references to each value from other
+ * values in the pool and from globals. A value with a larger reference count
+ * is also held by the evaluator in a C local, so it must be kept alive.
+ */
+static size_t *internal_refs;
+
+/*! During a compacting collection, whether each reference is live. */
+static bool *marked;
+
+/*!
+ * During a compacting collection, the marked references whose children have
+ * not been marked yet. Afterwards it is reused to hold every live reference.
+ */
+static reference_t *mark_stack;
+
+/*! The number of references on the mark_stack. */
+static reference_t mark_top;
+
+/*! The phases of an incremental collection cycle; see incremental_step(). */
+typedef enum {
+    INC_IDLE,    /*!< No cycle is running. */
+    INC_MARK,    /*!< Marking the values reachable from the globals. */
+    INC_GATHER,  /*!< Collecting the unmarked values as candidates. */
+    INC_COUNT,   /*!< Counting the references between candidates. */
+    INC_RESCUE,  /*!< Keeping the candidates that are referenced from elsewhere. */
+    INC_FREE     /*!< Freeing the candidates that turned out to be garbage. */
+} inc_phase_t;
+
+/*! The colors of references during an incremental cycle, in inc_colors. */
+enum {
+    COLOR_WHITE,      /*!< Not marked (yet). */
+    COLOR_BLACK,      /*!< Marked, rescued or allocated during the cycle. */
+    COLOR_CANDIDATE,  /*!< Unmarked when gathered; garbage once INC_FREE starts. */
+    COLOR_FREED       /*!< Garbage that has been freed, whose reference is held back. */
+};
+
+/*!
+ * The bytes of values that each allocation scans or frees during an
+ * incremental cycle, or 0 if collections are not incremental.
+ */
+static size_t inc_budget = 0;
+
+static inc_phase_t inc_phase = INC_IDLE;
+
+/*! The color of each reference during an incremental cycle. Its capacity is max_refs. */
+static uint8_t *inc_colors;
+
+/*!
+ * The marked references whose children have not been marked yet, and later
+ * the candidates and the garbage. Its capacity is max_refs.
+ */
+static reference_t *inc_stack;
+static reference_t inc_top;
+
+/*!
+ * The next reference for INC_GATHER to look at, or the index in inc_stack of
+ * the next candidate for INC_COUNT, INC_RESCUE or INC_FREE.
+ */
+static reference_t inc_cursor;
+
+/*!
+ * During INC_COUNT and INC_RESCUE, the rescued candidates whose children have
+ * not been rescued yet. Its capacity is max_refs.
+ */
+static reference_t *inc_rescued;
+static reference_t inc_rescued_top;
+
+/*!
+ * From INC_COUNT on, the number of references to each candidate from other
+ * candidates. It is all zeros otherwise. Its capacity is max_refs.
+ */
+static size_t *inc_counts;
+
+/*! The capacity of the incremental collector's arrays. */
+static reference_t inc_max_refs;
+
+/*! The colors of references during trial deletion, in cycle_colors. */
+enum {
+    CYCLE_BLACK,  /*!< In use, or not looked at. */
+    CYCLE_GRAY,   /*!< Reachable from a possible root; its count excludes them. */
+    CYCLE_WHITE   /*!< Only referenced by other gray or white values: garbage. */
+};
+
+/*!
+ * Once decref() has buffered this many possible roots of garbage cycles, the
+ * next allocation collects the cycles among them by trial deletion. 0 leaves
+ * cycles to the full collections.
+ */
+static size_t cycle_limit = 0;
+
+/*! The possible roots of garbage cycles. Its capacity is max_refs. */
+static reference_t *cycle_roots;
+static reference_t num_cycle_roots;
+
+/*! Whether each reference is in cycle_roots, indexed by reference. */
+static bool *buffered;
+
+/*!
+ * The color of each reference during trial deletion. It is all black
+ * otherwise. Its capacity is max_refs.
+ */
+static uint8_t *cycle_colors;
+
+/*! The references that trial deletion colored gray. Its capacity is max_refs. */
+static reference_t *cycle_grays;
+static reference_t num_cycle_grays;
+
+/*!
+ * During trial deletion, the values whose children have not been looked at
+ * yet. Its capacity is max_refs.
+ */
+static reference_t *cycle_stack;
+static reference_t cycle_top;
+
+/*! The capacity of the cycle collector's arrays. */
+static reference_t cycle_max_refs;
+
 
 //// FUNCTION DEFINITIONS ////
 
@@ -60,34 +288,98 @@ static reference_t max_refs;
 /*!
  * This function initializes the references and the memory pool.
  * It must be called before allocations can be served.
+ * If nursery_bytes is nonzero, that much of the pool is set aside as a nursery
+ * for generational collection, and the rest is split into the semispaces.
+ * Likewise, a nonzero large_bytes sets aside a large-object space, which must
+ * start at a page boundary, as the memory pool does.
+ * The pool starts out with memory_size bytes in use, and may grow to
+ * max_size bytes, which must all be mapped at memory_pool.
  */
-void init_refs(size_t memory_size, void *memory_pool) {
+void init_refs(size_t memory_size, size_t max_size, void *memory_pool,
+        size_t nursery_bytes, size_t large_bytes, collector_t collector_type) {
     /* Use the memory pool of the given size.
      * We round the size down to a multiple of ALIGNMENT so that values are aligned.
+     * The copying collector splits the pool in half, the compacting one doesn't.
      */
-    pool_size = (memory_size/2) / ALIGNMENT * ALIGNMENT;
-    mm_init(pool_size, memory_pool);
+    collector = collector_type;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    nursery_size = nursery_bytes / ALIGNMENT * ALIGNMENT;
+    large_size = large_bytes / MM_PAGE_SIZE * MM_PAGE_SIZE;
+    mm_init_large(large_size, memory_pool);
     pool = memory_pool;
+    reserved_size = max_size;
+    memory_pool = (char*)memory_pool + large_size;
+
+    size_t spaces = collector == COLLECTOR_COMPACT ? 1 : 2;
+    pool_size = ((memory_size - large_size - nursery_size)/spaces) / ALIGNMENT * ALIGNMENT;
+    min_pool_size = pool_size;
+    max_pool_size = ((max_size - large_size - nursery_size)/spaces) / ALIGNMENT * ALIGNMENT;
+    mm_init(pool_size, memory_pool);
+    mm_prefer_bump(collector != COLLECTOR_COMPACT);
     from_space = memory_pool;
 
-    to_space = (void*)((char*)memory_pool + (memory_size/2) / ALIGNMENT * ALIGNMENT);
+    to_space = spaces == 2 ? (void*)((char*)memory_pool + max_pool_size) : NULL;
+    mm_init_nursery(nursery_size, (char*)memory_pool + spaces * max_pool_size);
 
     /* Start out with no references in our reference-table. */
     ref_table = NULL;
+    ref_values = NULL;
     num_refs = 0;
     max_refs = 0;
+    free_refs = NULL;
+    num_free_refs = 0;
+    nursery_refs = NULL;
+    num_nursery_refs = 0;
+    nursery_slots = NULL;
+}
+
+
+/*! Resizes the incremental collector's state along with the ref_table. */
+static void grow_incremental_state(void) {
+    inc_colors = realloc(inc_colors, sizeof(uint8_t[max_refs]));
+    inc_stack = realloc(inc_stack, sizeof(reference_t[max_refs]));
+    inc_counts = realloc(inc_counts, sizeof(size_t[max_refs]));
+    inc_rescued = realloc(inc_rescued, sizeof(reference_t[max_refs]));
+    if (inc_colors == NULL || inc_stack == NULL || inc_counts == NULL ||
+            inc_rescued == NULL) {
+        fprintf(stderr, "could not resize reference table");
+        exit(1);
+    }
+    memset(inc_counts + inc_max_refs, 0, sizeof(size_t[max_refs - inc_max_refs]));
+    inc_max_refs = max_refs;
 }
 
+/*! Resizes the cycle collector's state along with the ref_table. */
+static void grow_cycle_state(void) {
+    cycle_roots = realloc(cycle_roots, sizeof(reference_t[max_refs]));
+    buffered = realloc(buffered, sizeof(bool[max_refs]));
+    cycle_colors = realloc(cycle_colors, sizeof(uint8_t[max_refs]));
+    cycle_grays = realloc(cycle_grays, sizeof(reference_t[max_refs]));
+    cycle_stack = realloc(cycle_stack, sizeof(reference_t[max_refs]));
+    if (cycle_roots == NULL || buffered == NULL || cycle_colors == NULL ||
+            cycle_grays == NULL || cycle_stack == NULL) {
+        fprintf(stderr, "could not resize reference table");
+        exit(1);
+    }
+    memset(buffered + cycle_max_refs, 0, sizeof(bool[max_refs - cycle_max_refs]));
+    memset(cycle_colors + cycle_max_refs, CYCLE_BLACK, max_refs - cycle_max_refs);
+    cycle_max_refs = max_refs;
+}
 
-/*! Allocates an available reference in the ref_table. */
+/*!
+ * Allocates an available reference in the ref_table. References allocated
+ * during an incremental cycle are black, so the cycle never frees them.
+ */
 static reference_t assign_reference(value_t *value) {
-    /* Scan through the reference table to see if we have any unused slots
-     * that can store this value. */
-    for (reference_t i = 0; i < num_refs; i++) {
-        if (ref_table[i] == NULL) {
-            ref_table[i] = value;
-            return i;
+    /* Reuse the most recently released slot, if there is one. */
+    if (num_free_refs > 0) {
+        reference_t ref = free_refs[--num_free_refs];
+        assert(ref_table[ref] == NULL);
+        ref_table[ref] = value;
+        if (inc_phase != INC_IDLE) {
+            inc_colors[ref] = COLOR_BLACK;
         }
+        return ref;
     }
 
     /* If we are out of slots, increase the size of the reference table. */
@@ -95,182 +387,1839 @@ static reference_t assign_reference(value_t *value) {
         /* Double the size of the reference table, unless it was 0 before. */
         max_refs = max_refs == 0 ? INITIAL_SIZE : max_refs * 2;
         ref_table = realloc(ref_table, sizeof(value_t *[max_refs]));
-        if (ref_table == NULL) {
+        ref_values = ref_table;
+        free_refs = realloc(free_refs, sizeof(reference_t[max_refs]));
+        nursery_refs = realloc(nursery_refs, sizeof(reference_t[max_refs]));
+        nursery_slots = realloc(nursery_slots, sizeof(reference_t[max_refs]));
+        if (ref_table == NULL || free_refs == NULL ||
+                nursery_refs == NULL || nursery_slots == NULL) {
             fprintf(stderr, "could not resize reference table");
             exit(1);
         }
+        memset(nursery_slots + num_refs, 0, sizeof(reference_t[max_refs - num_refs]));
+        if (inc_budget > 0) {
+            grow_incremental_state();
+        }
+        if (cycle_limit > 0) {
+            grow_cycle_state();
+        }
     }
 
-    /* No existing references were unused, so use the next available one. */
+    /* No existing references were unused, so use the next available one.
+     * The references with TAGGED_INT_BIT set are reserved for integers. */
+    if (num_refs == TAGGED_INT_BIT) {
+        fprintf(stderr, "too many references");
+        exit(1);
+    }
     reference_t ref = num_refs;
     num_refs++;
     ref_table[ref] = value;
+    if (inc_phase != INC_IDLE) {
+        inc_colors[ref] = COLOR_BLACK;
+    }
     return ref;
 }
 
+/*! Marks a reference as unused so that assign_reference can hand it out again. */
+static void release_reference(reference_t ref) {
+    ref_table[ref] = NULL;
+    free_refs[num_free_refs++] = ref;
+}
 
-/*! Attempts to allocate a value from the memory pool and assign it a reference. */
-reference_t make_ref(value_type_t type, size_t size) {
-    /* Force alignment of data size to ALIGNMENT. */
-    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+/*!
+ * Releases the reference of a value that a collection found to be garbage.
+ * Garbage that an incremental cycle is still freeing may refer to it, so then
+ * it is held back until the cycle ends, as in rebuild_free_refs().
+ */
+static void release_garbage_reference(reference_t ref) {
+    if (inc_phase == INC_FREE && inc_colors[ref] >= COLOR_CANDIDATE) {
+        ref_table[ref] = NULL;
+        inc_colors[ref] = COLOR_FREED;
+        return;
+    }
+    release_reference(ref);
+}
 
-    /* Find a (free) location to store the value. */
-    value_t *value = mm_malloc(size);
+/*! Adds a reference that maps to a nursery value to nursery_refs, unless it is there already. */
+static void list_nursery_ref(reference_t ref) {
+    reference_t slot = nursery_slots[ref];
+    if (slot < num_nursery_refs && nursery_refs[slot] == ref) {
+        return;
+    }
+    nursery_slots[ref] = num_nursery_refs;
+    nursery_refs[num_nursery_refs++] = ref;
+}
 
-    /* If there was no space, then fail. */
-    if (value == NULL) {
-        return NULL_REF;
+/*!
+ * Rebuilds the free_refs stack from the NULL entries of the ref_table,
+ * pushing the highest references first so the lowest are reused first.
+ */
+static void rebuild_free_refs(void) {
+    num_free_refs = 0;
+    for (reference_t i = num_refs - 1; i >= 0; i--) {
+        if (ref_table[i] == NULL) {
+            /* Garbage that an incremental cycle is still freeing may refer to
+             * these, so they are only released when the cycle ends. */
+            if (inc_phase == INC_FREE && inc_colors[i] >= COLOR_CANDIDATE) {
+                inc_colors[i] = COLOR_FREED;
+                continue;
+            }
+            free_refs[num_free_refs++] = i;
+        }
     }
+}
 
-    /* Initialize the value. */
-    assert(value->type == VAL_FREE);
-    value->type = type;
-    value->ref_count = 1; // this is the first reference to the value
 
-    /* Set the data area to a pattern so that it's easier to debug. */
-    memset(value + 1, 0xCC, value->value_size - sizeof(value_t));
+//// PAUSE TIMES ////
 
-    /* Assign a reference_t to it. */
-    return assign_reference(value);
-}
+/*!
+ * The pauses of the garbage collector are counted in a histogram with this
+ * many buckets for each doubling of the pause, so the reported percentiles
+ * are within about 9% of the actual ones.
+ */
+#define PAUSE_BUCKETS_PER_OCTAVE 8
 
+/*! Enough buckets for pauses of up to 2^64 nanoseconds. */
+#define PAUSE_BUCKETS (64 * PAUSE_BUCKETS_PER_OCTAVE)
 
-/*! Dereferences a reference_t into a pointer to the underlying value_t. */
-value_t *deref(reference_t ref) {
-    /* Make sure the reference is actually a valid index. */
-    assert(ref >= 0 && ref < num_refs);
+static size_t pause_counts[PAUSE_BUCKETS];
+static size_t num_pauses;
+static uint64_t longest_pause;
+static uint64_t total_pause;
 
-    value_t *value = ref_table[ref];
+/*! The start of the current pause, and how many pause_begin()s it has. */
+static struct timespec pause_start;
+static int pause_depth;
 
-    /* Make sure the reference's value is within the pool!
-     * Also ensure that the value is not NULL, indicating an unused reference. */
-    assert(is_pool_address(value));
+static uint64_t nanoseconds_since(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) (now.tv_sec - start->tv_sec) * 1000000000 +
+        (uint64_t) now.tv_nsec - (uint64_t) start->tv_nsec;
+}
 
-    return value;
+/*! Returns the histogram bucket of a pause: its highest bits, in effect. */
+static size_t pause_bucket(uint64_t ns) {
+    if (ns < PAUSE_BUCKETS_PER_OCTAVE) {
+        return ns;
+    }
+    int octave = 63 - __builtin_clzll(ns);
+    return octave * PAUSE_BUCKETS_PER_OCTAVE +
+        ((ns >> (octave - 3)) & (PAUSE_BUCKETS_PER_OCTAVE - 1));
 }
 
-/*! Returns the reference that maps to the given value. */
-reference_t get_ref(value_t *value) {
-    for (reference_t i = 0; i < num_refs; i++) {
-        if (ref_table[i] == value) {
-            return i;
-        }
+/*! Returns the smallest pause that falls in the bucket after the given one. */
+static uint64_t pause_bucket_limit(size_t bucket) {
+    bucket++;
+    if (bucket < 3 * PAUSE_BUCKETS_PER_OCTAVE) {
+        return bucket < PAUSE_BUCKETS_PER_OCTAVE ? bucket : PAUSE_BUCKETS_PER_OCTAVE;
     }
-    assert(!"Value has no reference");
+    size_t octave = bucket / PAUSE_BUCKETS_PER_OCTAVE;
+    return (uint64_t) (PAUSE_BUCKETS_PER_OCTAVE + bucket % PAUSE_BUCKETS_PER_OCTAVE)
+        << (octave - 3);
 }
 
+/*!
+ * Marks the start and end of a pause of the program for garbage collection.
+ * Pauses may nest, e.g. when a minor collection turns into a full one, and
+ * then only the outermost one counts.
+ */
+static void pause_begin(void) {
+    if (pause_depth++ == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &pause_start);
+    }
+}
 
-/*! Returns the number of values in the memory pool. */
-size_t refs_used() {
-    size_t values = 0;
-    for (reference_t i = 0; i < num_refs; i++) {
-        if (ref_table[i] != NULL) {
-            values++;
+static void pause_end(void) {
+    if (--pause_depth > 0) {
+        return;
+    }
+    uint64_t ns = nanoseconds_since(&pause_start);
+    pause_counts[pause_bucket(ns)]++;
+    num_pauses++;
+    total_pause += ns;
+    if (ns > longest_pause) {
+        longest_pause = ns;
+    }
+}
+
+/*! Returns an upper bound on the given fraction of the pauses. */
+static uint64_t pause_percentile(double fraction) {
+    size_t rank = (size_t) (fraction * num_pauses);
+    size_t seen = 0;
+    for (size_t i = 0; i < PAUSE_BUCKETS; i++) {
+        seen += pause_counts[i];
+        if (seen > rank) {
+            uint64_t limit = pause_bucket_limit(i);
+            return limit < longest_pause ? limit : longest_pause;
         }
     }
-    return values;
+    return longest_pause;
 }
 
+/*! Prints the distribution of the garbage collector's pauses so far. */
+void print_gc_pauses(FILE *stream) {
+    if (num_pauses == 0) {
+        fprintf(stream, "No garbage collection pauses.\n");
+        return;
+    }
+    fprintf(stream, "%zu garbage collection pauses: median %.3f ms, "
+            "99th percentile %.3f ms, longest %.3f ms\n", num_pauses,
+            pause_percentile(0.5) / 1e6, pause_percentile(0.99) / 1e6,
+            longest_pause / 1e6);
+}
 
-//// REFERENCE COUNTING ////
+//// END PAUSE TIMES ////
 
-/*! Increases the reference count of the value at the given reference. */
-void incref(reference_t ref){
-    value_t *value = deref(ref);
-    value->ref_count++;
+
+//// STATISTICS ////
+
+//Counters for gc_stats() and the -s option. Each allocation and copy only
+//adds to one of them; everything else is counted once per collection.
+
+static size_t full_collections;
+static size_t minor_collections;
+static size_t incremental_cycles;
+static size_t cycle_collections;
+static size_t bytes_allocated;
+static size_t bytes_copied;
+
+//The percentage of the bytes that survived the last collection, and the sum
+//of the percentages over all collections so far
+static size_t last_survival;
+static size_t total_survival;
+
+//Records how many of the bytes that a collection looked at survived it
+static void record_survival(size_t before, size_t after){
+    last_survival = before == 0 ? 100 : after * 100 / before;
+    total_survival += last_survival;
 }
 
-// Traversal function used in decref to decrease the values of all further
-// references. Also used in the garbage collector when deleting garbage
-void traverse_decref(value_t *value){
-    if(value->type == VAL_LIST){
-        decref(((list_value_t*)value)->values);
-    } else if(value->type == VAL_DICT){
-        decref(((dict_value_t*)value)->keys);
-        decref(((dict_value_t*)value)->values);
-    } else if(value->type == VAL_REF_ARRAY){
-        ref_array_value_t *arr = (ref_array_value_t*)value;
-        for(size_t i = 0; i < arr->capacity; i++){
-            reference_t ref = arr->values[i];
-            if(ref != NULL_REF && ref != TOMBSTONE_REF){
-                decref(ref);
-            }
+static gc_stats_t *counting_stats;
+
+static void count_live_value(value_t *value){
+    counting_stats->live_values[value->type]++;
+    counting_stats->live_bytes[value->type] += value->value_size;
+}
+
+/*! Fills in the garbage collector's statistics so far. */
+void get_gc_stats(gc_stats_t *stats){
+    memset(stats, 0, sizeof(gc_stats_t));
+    stats->full_collections = full_collections;
+    stats->minor_collections = minor_collections;
+    stats->incremental_cycles = incremental_cycles;
+    stats->cycle_collections = cycle_collections;
+    stats->pauses = num_pauses;
+    stats->total_pause_ns = total_pause;
+    stats->longest_pause_ns = longest_pause;
+    stats->bytes_allocated = bytes_allocated;
+    stats->bytes_copied = bytes_copied;
+    stats->elapsed_ns = nanoseconds_since(&start_time);
+    size_t collections = full_collections + minor_collections;
+    stats->last_survival = last_survival;
+    stats->mean_survival = collections == 0 ? 0 : total_survival / collections;
+    stats->pool_size = pool_size;
+    stats->max_pool_size = max_pool_size;
+    stats->refs = num_refs;
+    stats->free_refs = num_free_refs;
+
+    counting_stats = stats;
+    mm_foreach_value(count_live_value);
+    counting_stats = NULL;
+}
+
+/*! Returns the name of a value type in the statistics. */
+const char *gc_stats_type_name(value_type_t type){
+    switch(type){
+        case VAL_NONE:           return "NoneType";
+        case VAL_BOOL:           return "bool";
+        case VAL_INTEGER:        return "int";
+        case VAL_STRING:         return "str";
+        case VAL_LIST:           return "list";
+        case VAL_DICT:           return "dict";
+        case VAL_REF_ARRAY:      return "ref_array";
+        case VAL_DICT_INDEX:     return "dict_index";
+        case VAL_DICT_ENTRIES:   return "dict_entries";
+        case VAL_STRING_BUILDER: return "str_builder";
+        default:                 return NULL;
+    }
+}
+
+/*! Prints the garbage collector's statistics so far. */
+void print_gc_stats(FILE *stream){
+    gc_stats_t stats;
+    get_gc_stats(&stats);
+    double seconds = stats.elapsed_ns / 1e9;
+
+    fprintf(stream, "Garbage collector statistics:\n");
+    fprintf(stream, "  collections: %zu full, %zu minor, %zu incremental cycles, "
+            "%zu of garbage cycles\n", stats.full_collections, stats.minor_collections,
+            stats.incremental_cycles, stats.cycle_collections);
+    fprintf(stream, "  pauses: %zu, total %.3f ms, longest %.3f ms\n", stats.pauses,
+            stats.total_pause_ns / 1e6, stats.longest_pause_ns / 1e6);
+    fprintf(stream, "  allocated: %zu bytes in %.3f s (%.0f bytes/s)\n",
+            stats.bytes_allocated, seconds,
+            seconds > 0 ? stats.bytes_allocated / seconds : 0.0);
+    fprintf(stream, "  copied: %zu bytes\n", stats.bytes_copied);
+    fprintf(stream, "  survival: %zu%% in the last collection, %zu%% on average\n",
+            stats.last_survival, stats.mean_survival);
+    fprintf(stream, "  pool: %zu of at most %zu bytes in each space\n",
+            stats.pool_size, stats.max_pool_size);
+    fprintf(stream, "  references: %zu in the table, %zu free\n",
+            stats.refs, stats.free_refs);
+    fprintf(stream, "  live values:");
+    for(value_type_t type = 0; type < VAL_FREE; type++){
+        if(stats.live_values[type] > 0){
+            fprintf(stream, " %s %zu (%zu bytes)", gc_stats_type_name(type),
+                    stats.live_values[type], stats.live_bytes[type]);
         }
     }
+    fprintf(stream, "\n");
 }
 
+//// END STATISTICS ////
+
+
 /*!
- * Decreases the reference count of the value at the given reference.
- * If the reference count reaches 0, the value is definitely garbage and should be freed.
+ * Collects garbage automatically once more than the given percentage of the
+ * pool is in use. A negative percentage disables the trigger, so collections
+ * only happen on gc() and when an allocation would otherwise fail.
  */
-void decref(reference_t ref) {
-    if(is_pool_address(ref_table[ref])){
-        value_t *value = deref(ref);
-        value->ref_count--;
-        if(value->ref_count > 0){
-            return;
+void set_gc_trigger(int percent) {
+    gc_trigger = percent;
+    gc_limit = percent < 0 ? SIZE_MAX : (pool_size + large_size) / 100 * percent;
+}
+
+/*!
+ * Leaves room for the pool to fill up again before the next automatic
+ * collection, even if most of it is still live.
+ */
+static void update_gc_limit(void) {
+    if (gc_trigger >= 0) {
+        size_t capacity = pool_size + large_size;
+        size_t trigger_limit = capacity / 100 * gc_trigger;
+        size_t headroom = mem_used() + (capacity - mem_used()) / 2;
+        gc_limit = headroom > trigger_limit ? headroom : trigger_limit;
+    }
+}
+
+/*! Gives the pages between start and end back to the system. */
+static void release_pages(uint8_t *start, uint8_t *end) {
+    uintptr_t first = ((uintptr_t) start + MM_PAGE_SIZE - 1) / MM_PAGE_SIZE * MM_PAGE_SIZE;
+    uintptr_t last = (uintptr_t) end / MM_PAGE_SIZE * MM_PAGE_SIZE;
+    if (first < last) {
+        madvise((void *) first, last - first, MADV_DONTNEED);
+    }
+}
+
+/*!
+ * Changes the size of the semispaces. The values in the from space must fit
+ * in the new size. When they shrink, the pages past their new end are given
+ * back to the system, to be committed again if they grow.
+ */
+static void set_pool_size(size_t size) {
+    size = size / ALIGNMENT * ALIGNMENT;
+    if (size < pool_size) {
+        release_pages((uint8_t *) from_space + size, (uint8_t *) from_space + pool_size);
+        if (to_space != NULL) {
+            release_pages((uint8_t *) to_space + size, (uint8_t *) to_space + pool_size);
         }
-        ref_table[ref] = NULL;
-        traverse_decref(value);
-        mm_free(value);
+    }
+    pool_size = size;
+    mm_resize(pool_size);
+    set_gc_trigger(gc_trigger);
+}
+
+/*!
+ * Grows the semispaces if little of them is free after a collection, and
+ * shrinks them if most of them is, within min_pool_size and max_pool_size.
+ * They only shrink as far as the bump pointer, which the full collectors
+ * leave right after the live values.
+ */
+static void resize_pool(void) {
+    size_t used = mm_pool_used();
+    size_t extent = pool_size - mm_unallocated();
+    size_t size = pool_size;
+    while (used * 100 > size * POOL_GROW_PERCENT && size < max_pool_size) {
+        size = size * 2 < max_pool_size ? size * 2 : max_pool_size;
+    }
+    while (size == pool_size && used * 100 < size * POOL_SHRINK_PERCENT &&
+            size / 2 >= min_pool_size && size / 2 >= extent) {
+        size /= 2;
+    }
+    if (size != pool_size) {
+        set_pool_size(size);
     }
 }
 
+/*!
+ * Grows the semispaces so that at least size more bytes fit at the bump
+ * pointer, if they may grow that far. Returns whether they grew.
+ */
+static bool grow_pool(size_t size) {
+    size_t needed = pool_size - mm_unallocated() + size;
+    if (pool_size == max_pool_size || needed > max_pool_size) {
+        return false;
+    }
+    size_t new_size = pool_size;
+    while (new_size < needed) {
+        new_size = new_size * 2 < max_pool_size ? new_size * 2 : max_pool_size;
+    }
+    set_pool_size(new_size);
+    return true;
+}
 
-//// END REFERENCE COUNTING ////
+/*!
+ * Grows the semispaces before a full collection if they might not have room
+ * for everything in the from space and the nursery, so that the collection
+ * does not run out of room while the pool may still grow. The values are
+ * about to be copied or slid to the start of a semispace, so only pool_size
+ * needs to change.
+ */
+static void grow_for_collection(void) {
+    size_t needed = pool_size - mm_unallocated() + mm_nursery_allocated();
+    size_t size = pool_size;
+    while (size < needed && size < max_pool_size) {
+        size = size * 2 < max_pool_size ? size * 2 : max_pool_size;
+    }
+    pool_size = size;
+}
 
+static void collect_nursery(void);
+static void incremental_step(size_t size);
+static void inc_touch(reference_t ref);
+static bool collect_cycles(void);
+static void buffer_possible_root(reference_t ref, value_t *value);
 
-//// GARBAGE COLLECTOR ////
+/*!
+ * Allocates a value in the nursery, running a minor collection if it is full.
+ * Returns NULL if the value should go in the old generation instead.
+ */
+static value_t *nursery_malloc(size_t size) {
+    if (size * NURSERY_LARGE_FRACTION > nursery_size) {
+        return NULL;
+    }
+    value_t *value = mm_nursery_malloc(size);
+    if (value == NULL) {
+        pause_begin();
+        collect_nursery();
+        pause_end();
+        value = mm_nursery_malloc(size);
+    }
+    return value;
+}
 
-//Copies the reference_t ref to the first available spot in memory in the newly
-//initialized pool. Also copies contents of all references contained inside ref
-void copy_contents(const char *name, reference_t ref){
-    (void)name;
-    if(!is_pool_address(ref_table[ref])){
-        value_t *old_value = ref_table[ref];
-        value_t *value = mm_malloc(old_value->value_size);
-        memcpy(value, old_value, old_value->value_size);
-        ref_table[ref] = value;
-        if(value->type == VAL_LIST){
-            list_value_t *list_value = (list_value_t*)value;
-            copy_contents(NULL, list_value->values);
-        } else if (value->type == VAL_DICT){
-            dict_value_t *dict_value = (dict_value_t*)value;
-            copy_contents(NULL, dict_value->keys);
-            copy_contents(NULL, dict_value->values);
-        } else if (value->type == VAL_REF_ARRAY){
-            ref_array_value_t *ref_array = (ref_array_value_t*)value;
-            for(size_t i = 0; i < ref_array->capacity; i++){
-                reference_t ref = ref_array->values[i];
-                if(ref != NULL_REF && ref != TOMBSTONE_REF){
-                    copy_contents(NULL, ref);
-                }
-            }
+/*!
+ * Allocates a value in the old generation: in the large-object space if it is
+ * large and there is room, and in the semispaces otherwise.
+ */
+static value_t *pool_malloc(size_t size) {
+    if (large_size > 0 && size >= LARGE_VALUE_SIZE) {
+        value_t *value = mm_large_malloc(size);
+        if (value != NULL) {
+            return value;
         }
     }
+    return mm_malloc(size);
 }
 
+/*! Attempts to allocate a value from the memory pool and assign it a reference. */
+reference_t make_ref(value_type_t type, size_t size) {
+    /* Force alignment of data size to ALIGNMENT. */
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
 
-void collect_garbage(void) {
-    if (interactive) {
-        fprintf(stderr, "Collecting garbage.\n");
+    /* An incremental collector does a little work on every allocation. */
+    if (inc_budget > 0) {
+        incremental_step(size);
     }
-    size_t old_use = mem_used();
 
-    // Start by initializing to space and swapping the spaces
-    mm_init(pool_size, to_space);
-    foreach_global(copy_contents);
-    void *temp = from_space;
-    from_space = to_space;
-    to_space = temp;
+    /* Collect the garbage cycles once enough of them might have formed. */
+    if (cycle_limit > 0 && (size_t) num_cycle_roots >= cycle_limit) {
+        collect_cycles();
+    }
 
-    //Delete old structures which are now garbage from the ref table
-    for(reference_t i = 0; i < num_refs; i++){
-        if(!is_pool_address(ref_table[i]) && ref_table[i] != NULL){
-            traverse_decref(ref_table[i]);
+    /* Small values start out in the nursery, if there is one. */
+    value_t *value = nursery_size > 0 ? nursery_malloc(size) : NULL;
+
+    if (value == NULL) {
+        /* Collect first if this allocation would pass the occupancy trigger,
+         * unless an incremental cycle takes care of that. Freeing the garbage
+         * cycles may be enough, and only takes time in proportion to them. */
+        if (inc_budget == 0 && mem_used() + size > gc_limit &&
+                (!collect_cycles() || mem_used() + size > gc_limit)) {
+            collect_garbage();
+        }
+
+        /* Find a (free) location to store the value. */
+        value = pool_malloc(size);
+
+        /* If there was no space, free the garbage cycles, or failing that,
+         * collect garbage and try once more. */
+        if (value == NULL && collect_cycles()) {
+            exception_clear();
+            value = pool_malloc(size);
+        }
+        if (value == NULL) {
+            exception_clear();
+            collect_garbage();
+            value = pool_malloc(size);
+        }
+
+        /* Failing that, make room by growing the pool, if it may grow. */
+        if (value == NULL && grow_pool(size)) {
+            exception_clear();
+            value = pool_malloc(size);
+        }
+
+        /* If there is still no space, then fail. */
+        if (value == NULL) {
+            return NULL_REF;
+        }
+    }
+
+    /* Initialize the value. */
+    assert(value->type == VAL_FREE);
+    value->type = type;
+    value->ref_count = 1; // this is the first reference to the value
+    bytes_allocated += value->value_size;
+
+    /* Set the data area to a pattern so that it's easier to debug. */
+    memset(value + 1, 0xCC, value->value_size - sizeof(value_t));
+
+    /* Assign a reference_t to it, and list it for minor collections. */
+    reference_t ref = assign_reference(value);
+    if (is_nursery_address(value)) {
+        list_nursery_ref(ref);
+    }
+    return ref;
+}
+
+
+/*!
+ * Returns whether a value is within the pool, the nursery or the large-object
+ * space. This is not the case for NULL, which indicates an unused reference.
+ */
+bool is_allocated_value(value_t *value) {
+    return is_pool_address(value) || is_nursery_address(value) ||
+        is_large_address(value);
+}
+
+/*! Returns the number of references in the table, including unused ones. */
+reference_t refs_count(void) {
+    return num_refs;
+}
+
+/*!
+ * Returns whether the reference currently maps to a value. Unlike deref(),
+ * this accepts references that have been released and possibly reused.
+ */
+bool is_live_ref(reference_t ref) {
+    return is_value_ref(ref) && ref < num_refs && ref_table[ref] != NULL;
+}
+
+/*! Returns whether the caller's reference to a value is its only one. */
+bool is_unique_ref(reference_t ref) {
+    return is_value_ref(ref) && deref(ref)->ref_count == 1;
+}
+
+/*!
+ * Grows a value in place if it was the last one allocated. Values in the pool
+ * are only grown up to the occupancy trigger, since the collection that the
+ * trigger asks for is left to the next allocation.
+ */
+bool grow_ref(reference_t ref, size_t size) {
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    value_t *value = deref(ref);
+    if (size <= value->value_size) {
+        return true;
+    }
+    if (!is_nursery_address(value) && mem_used() + (size - value->value_size) > gc_limit) {
+        return false;
+    }
+    return mm_grow(value, size);
+}
+
+/*!
+ * Moves the value of replacement to ref, and frees the value ref had. The
+ * caller's reference to replacement is used up. ref keeps its reference
+ * count, so everything that referred to it now sees the new value.
+ *
+ * The new value may be in the nursery even if the old one wasn't. A minor
+ * collection only looks at the references in nursery_refs, so ref is added
+ * to it.
+ */
+void replace_ref(reference_t ref, reference_t replacement) {
+    value_t *old_value = deref(ref);
+    value_t *new_value = deref(replacement);
+    assert(new_value->ref_count == 1);
+
+    new_value->ref_count = old_value->ref_count;
+    old_value->ref_count = 1;
+    ref_table[ref] = new_value;
+    ref_table[replacement] = old_value;
+    if (is_nursery_address(new_value)) {
+        list_nursery_ref(ref);
+    }
+    decref(replacement);
+}
+
+/*! Returns the reference that maps to the given value. */
+reference_t get_ref(value_t *value) {
+    for (reference_t i = 0; i < num_refs; i++) {
+        if (ref_table[i] == value) {
+            return i;
+        }
+    }
+    assert(!"Value has no reference");
+    abort();
+}
+
+
+/*! Returns the number of values in the memory pool. */
+size_t refs_used() {
+    size_t values = 0;
+    for (reference_t i = 0; i < num_refs; i++) {
+        if (ref_table[i] != NULL) {
+            values++;
+        }
+    }
+    return values;
+}
+
+
+//// REFERENCE COUNTING ////
+
+/*! Increases the reference count of the value at the given reference. */
+void incref(reference_t ref){
+    /* Tagged integers are not stored in the pool, so they aren't counted. */
+    if(is_tagged_int(ref)){
+        return;
+    }
+    value_t *value = deref(ref);
+    value->ref_count++;
+    inc_touch(ref);
+}
+
+// Calls f on every reference stored directly in value. This is the only
+// place that knows which value types contain references.
+static void foreach_child(value_t *value, void (*f)(reference_t ref)){
+    if(value->type == VAL_LIST){
+        f(((list_value_t*)value)->values);
+    } else if(value->type == VAL_DICT){
+        f(((dict_value_t*)value)->index);
+        f(((dict_value_t*)value)->entries);
+    } else if(value->type == VAL_STRING_BUILDER){
+        f(((string_builder_value_t*)value)->chunks);
+    } else if(value->type == VAL_REF_ARRAY){
+        ref_array_value_t *arr = (ref_array_value_t*)value;
+        for(size_t i = 0; i < arr->capacity; i++){
+            reference_t ref = arr->values[i];
+            if(is_value_ref(ref)){
+                f(ref);
+            }
+        }
+    } else if(value->type == VAL_DICT_ENTRIES){
+        dict_entries_value_t *arr = (dict_entries_value_t*)value;
+        for(size_t i = 0; i < arr->capacity; i++){
+            if(is_value_ref(arr->entries[i].key)){
+                f(arr->entries[i].key);
+            }
+            if(is_value_ref(arr->entries[i].value)){
+                f(arr->entries[i].value);
+            }
+        }
+    }
+}
+
+// Traversal function used in decref to decrease the values of all further
+// references. Also used in the garbage collector when deleting garbage
+void traverse_decref(value_t *value){
+    foreach_child(value, decref);
+}
+
+/*!
+ * Decreases the reference count of the value at the given reference.
+ * If the reference count reaches 0, the value is definitely garbage and should be freed.
+ */
+void decref(reference_t ref) {
+    if(is_tagged_int(ref)){
+        return;
+    }
+    if(is_allocated_value(ref_table[ref])){
+        value_t *value = deref(ref);
+        value->ref_count--;
+        inc_touch(ref);
+        if(value->ref_count > 0){
+            if(cycle_limit > 0){
+                buffer_possible_root(ref, value);
+            }
+            return;
+        }
+        release_reference(ref);
+        traverse_decref(value);
+        mm_free(value);
+    }
+}
+
+
+//// END REFERENCE COUNTING ////
+
+
+//// GARBAGE COLLECTOR ////
+
+//Copies the value at reference_t ref to the bump pointer of the newly
+//initialized pool, unless it has been copied already. The ref_table entry
+//then points into the new pool, so it doubles as the forwarding address.
+//Large values are marked in place instead.
+static void copy_ref(reference_t ref){
+    if(is_large_address(ref_table[ref])){
+        if(mm_mark_large(ref_table[ref])){
+            large_stack[large_top++] = ref;
+        }
+    } else if(!is_pool_address(ref_table[ref])){
+        ref_table[ref] = mm_copy(ref_table[ref]);
+        if(ref_table[ref] == NULL){
+            fprintf(stderr, "out of memory while collecting garbage\n");
+            exit(1);
+        }
+        bytes_copied += ref_table[ref]->value_size;
+    }
+}
+
+//Promotes a nursery value into the old generation, unless it has been
+//promoted already. collect_nursery makes sure that there is room.
+static void promote_ref(reference_t ref){
+    if(is_nursery_address(ref_table[ref])){
+        ref_table[ref] = mm_copy(ref_table[ref]);
+        assert(ref_table[ref] != NULL);
+        bytes_copied += ref_table[ref]->value_size;
+    }
+}
+
+//Copies a global root into the new pool; used with foreach_global
+void copy_contents(const char *name, reference_t ref){
+    (void)name;
+    if(is_value_ref(ref)){
+        copy_ref(ref);
+    }
+}
+
+static void count_internal_ref(reference_t ref){
+    internal_refs[ref]++;
+}
+
+static void count_global_ref(const char *name, reference_t ref){
+    (void)name;
+    if(is_value_ref(ref)){
+        count_internal_ref(ref);
+    }
+}
+
+static void count_children(value_t *value){
+    foreach_child(value, count_internal_ref);
+}
+
+//During a minor collection, internal_refs is indexed by the position in
+//nursery_refs instead, and only references to nursery values are counted
+static void count_nursery_ref(reference_t ref){
+    if(is_nursery_address(ref_table[ref])){
+        assert(nursery_refs[nursery_slots[ref]] == ref);
+        internal_refs[nursery_slots[ref]]++;
+    }
+}
+
+static void count_nursery_children(value_t *value){
+    foreach_child(value, count_nursery_ref);
+}
+
+//Allocates zeroed internal_refs counters for the given number of references
+static void alloc_internal_refs(size_t count){
+    internal_refs = calloc(count > 0 ? count : 1, sizeof(size_t));
+    if (internal_refs == NULL) {
+        fprintf(stderr, "could not allocate garbage collector state");
+        exit(1);
+    }
+}
+
+//Counts the references to each value from the from-space, the nursery and
+//globals
+static void count_internal_refs(void){
+    alloc_internal_refs(num_refs);
+    mm_foreach_value(count_children);
+    foreach_global(count_global_ref);
+}
+
+//Copies the values that the evaluator holds in C locals, e.g. operands and
+//partly built lists. Their reference counts include these holders, so they
+//are the values referenced more often than count_internal_refs found.
+static void copy_temporaries(void){
+    for(reference_t i = 0; i < num_refs; i++){
+        if(ref_table[i] != NULL && ref_table[i]->ref_count > internal_refs[i]){
+            copy_ref(i);
+        }
+    }
+    free(internal_refs);
+    internal_refs = NULL;
+}
+
+//Cheney scan: everything between the scan pointer and the bump pointer has
+//been copied but its children have not. Copying the children moves the bump
+//pointer further, so the scan stops once it catches up with it and no marked
+//large values are left to scan either.
+static void scan_copies(uint8_t *scan, void (*copy)(reference_t ref)){
+    for(;;){
+        if((void*)scan < mm_top()){
+            value_t *value = (value_t*)scan;
+            foreach_child(value, copy);
+            scan += value->value_size;
+        } else if(large_top > 0){
+            foreach_child(ref_table[large_stack[--large_top]], copy);
+        } else {
+            break;
+        }
+    }
+}
+
+//Minor collection: promotes the nursery values that are referenced from
+//outside the nursery, and everything they reach, then empties the nursery.
+//The promoted values are bump-allocated in the old generation, so they can be
+//scanned like a to-space.
+static void collect_nursery(void){
+    //Without room for every nursery value, promotion could fail halfway
+    if(mm_unallocated() < mm_nursery_allocated()){
+        collect_garbage();
+        return;
+    }
+    uint8_t *scan = mm_top();
+    size_t nursery_bytes = mm_nursery_allocated();
+
+    //Only the references in nursery_refs can map to the nursery. A nursery
+    //value with more references than the nursery holds to it is referenced
+    //by an old value, a global or the evaluator, so it is a root.
+    alloc_internal_refs(num_nursery_refs);
+    mm_foreach_nursery_value(count_nursery_children);
+    for(reference_t i = 0; i < num_nursery_refs; i++){
+        value_t *value = ref_table[nursery_refs[i]];
+        if(is_nursery_address(value) && value->ref_count > internal_refs[i]){
+            promote_ref(nursery_refs[i]);
+        }
+    }
+    free(internal_refs);
+    internal_refs = NULL;
+    scan_copies(scan, promote_ref);
+    minor_collections++;
+    record_survival(nursery_bytes, (uint8_t*)mm_top() - scan);
+
+    //Delete the nursery values that were not promoted. The nursery is emptied
+    //first so that decref skips references between them.
+    mm_nursery_reset();
+    for(reference_t i = 0; i < num_nursery_refs; i++){
+        reference_t ref = nursery_refs[i];
+        if(ref_table[ref] != NULL && is_nursery_region(ref_table[ref])){
+            traverse_decref(ref_table[ref]);
+            release_garbage_reference(ref);
+        }
+    }
+    num_nursery_refs = 0;
+
+    //With an incremental budget, the next allocation starts a cycle instead
+    if(inc_budget == 0 && mem_used() > gc_limit){
+        collect_garbage();
+    }
+}
+
+
+//Marks a reference as live, to have its children marked later
+static void mark_ref(reference_t ref){
+    if(!marked[ref]){
+        marked[ref] = true;
+        mark_stack[mark_top++] = ref;
+    }
+}
+
+static void mark_global(const char *name, reference_t ref){
+    (void)name;
+    if(is_value_ref(ref)){
+        mark_ref(ref);
+    }
+}
+
+//Drops a reference from a garbage value to a live value. References between
+//garbage values don't matter, since all of them are deleted.
+static void release_live_ref(reference_t ref){
+    if(marked[ref]){
+        ref_table[ref]->ref_count--;
+    }
+}
+
+static int compare_addresses(const void *a, const void *b){
+    value_t *x = ref_table[*(const reference_t*)a];
+    value_t *y = ref_table[*(const reference_t*)b];
+    return (x > y) - (x < y);
+}
+
+//Sliding mark-compact collection within a single pool: marks the values
+//reachable from the globals and temporaries, deletes the rest, and then
+//slides the live values down in address order. Values only move within the
+//ref_table, so no references inside values need updating.
+static void collect_compacting(void){
+    count_internal_refs();
+    marked = calloc(num_refs, sizeof(bool));
+    mark_stack = malloc(sizeof(reference_t[num_refs]));
+    if (marked == NULL || mark_stack == NULL) {
+        fprintf(stderr, "could not allocate garbage collector state");
+        exit(1);
+    }
+    mark_top = 0;
+
+    foreach_global(mark_global);
+    for(reference_t i = 0; i < num_refs; i++){
+        if(ref_table[i] != NULL && ref_table[i]->ref_count > internal_refs[i]){
+            mark_ref(i);
+        }
+    }
+    free(internal_refs);
+    internal_refs = NULL;
+    while(mark_top > 0){
+        foreach_child(ref_table[mark_stack[--mark_top]], mark_ref);
+    }
+
+    //Delete the garbage, and gather the live references for sliding. Large
+    //values stay where they are, so their garbage is freed right away.
+    for(reference_t i = 0; i < num_refs; i++){
+        value_t *value = ref_table[i];
+        if(value == NULL){
+            continue;
+        }
+        if(marked[i]){
+            if(!is_large_address(value)){
+                mark_stack[mark_top++] = i;
+            }
+        } else {
+            foreach_child(value, release_live_ref);
             ref_table[i] = NULL;
+            if(is_large_address(value)){
+                mm_free(value);
+            }
+        }
+    }
+
+    //The nursery lies after the pool, so its survivors are moved last
+    qsort(mark_stack, mark_top, sizeof(reference_t), compare_addresses);
+    mm_init(pool_size, from_space);
+    for(reference_t i = 0; i < mark_top; i++){
+        reference_t ref = mark_stack[i];
+        ref_table[ref] = mm_copy(ref_table[ref]);
+        if(ref_table[ref] == NULL){
+            fprintf(stderr, "out of memory while collecting garbage\n");
+            exit(1);
+        }
+        bytes_copied += ref_table[ref]->value_size;
+    }
+    mm_nursery_reset();
+
+    free(marked);
+    free(mark_stack);
+    marked = NULL;
+    mark_stack = NULL;
+}
+
+//Semispace copying collection: copies the values reachable from the globals
+//and temporaries into the to space, which then becomes the from space.
+static void collect_copying(void){
+    // Find the temporaries before initializing the to space, then copy the
+    // roots and everything reachable from them, and finally swap the spaces
+    count_internal_refs();
+    large_stack = malloc(sizeof(reference_t[num_refs]));
+    if (large_stack == NULL) {
+        fprintf(stderr, "could not allocate garbage collector state");
+        exit(1);
+    }
+    large_top = 0;
+    mm_init(pool_size, to_space);
+    foreach_global(copy_contents);
+    copy_temporaries();
+    scan_copies(to_space, copy_ref);
+    free(large_stack);
+    large_stack = NULL;
+    void *temp = from_space;
+    from_space = to_space;
+    to_space = temp;
+
+    //The unmarked large values are garbage. Their references go first, so
+    //that releasing the references in other garbage skips them.
+    for(reference_t i = 0; i < num_refs; i++){
+        if(is_large_address(ref_table[i]) && !mm_is_large_marked(ref_table[i])){
+            ref_table[i] = NULL;
+        }
+    }
+
+    //Delete old structures which are now garbage from the ref table. The
+    //nursery has been evacuated as well, so it is emptied first.
+    mm_nursery_reset();
+    for(reference_t i = 0; i < num_refs; i++){
+        value_t *value = ref_table[i];
+        if(value != NULL && !is_pool_address(value) && !is_large_address(value)){
+            traverse_decref(value);
+            ref_table[i] = NULL;
+        }
+    }
+    mm_sweep_large(traverse_decref);
+}
+
+
+//// PARALLEL COPYING COLLECTOR ////
+
+//With more than one GC thread, a copying collection is split between the
+//threads. Each counts the internal references and copies the roots in its
+//slice of the ref_table and the globals, then they trace everything reachable
+//together, and finally each deletes the garbage in its slice. A thread claims
+//a value by swapping its ref_table entry for copy_in_progress, so that each
+//value is copied by exactly one thread; references are indices, so the
+//children of a copy need no fixing up. The copies go into buffers that each
+//thread reserves from the to space, so that the threads rarely contend for
+//the bump pointer.
+
+//The most bytes that a GC thread reserves from the to space at a time
+#define GC_BUFFER_SIZE 16384
+
+//Stands in for a value in the ref_table while a thread copies it
+static value_t copy_in_progress;
+
+//A work-stealing deque (Chase and Lev) of the copies whose children have not
+//been copied yet. Its thread pushes and pops at the bottom, and the other
+//threads steal from the top. Each value is pushed once, so a capacity of
+//num_refs is enough and the array never wraps around.
+typedef struct {
+    int64_t top;
+    int64_t bottom;
+    reference_t *refs;
+} gc_deque_t;
+
+typedef struct {
+    size_t index;
+    pthread_t thread;
+    gc_deque_t deque;
+    uint8_t *buffer, *buffer_end;
+    size_t copied;
+} gc_worker_t;
+
+//An unused end of a buffer, returned to the pool once the threads are done
+typedef struct {
+    uint8_t *start;
+    size_t size;
+} gc_tail_t;
+
+static gc_tail_t *tails;
+static size_t num_tails, max_tails;
+static pthread_mutex_t tails_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//The bytes that a GC thread reserves from the to space at a time: at most
+//GC_BUFFER_SIZE, and small enough that the buffers waste little of a small pool
+static size_t gc_buffer_size;
+
+//The number of threads that share a copying collection
+static size_t gc_threads = 1;
+
+static gc_worker_t *workers;
+
+//The GC thread that is running, for the callbacks of foreach_child
+static _Thread_local gc_worker_t *current_worker;
+
+//The number of copies whose children have not been copied yet, on any deque
+//or being scanned. The threads are done tracing once it reaches 0.
+static int64_t pending_copies;
+
+static pthread_barrier_t gc_barrier;
+
+static void deque_push(gc_deque_t *deque, reference_t ref){
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->refs[bottom], ref, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+static bool deque_pop(gc_deque_t *deque, reference_t *ref){
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+    if(top > bottom){
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *ref = __atomic_load_n(&deque->refs[bottom], __ATOMIC_RELAXED);
+    if(top < bottom){
+        return true;
+    }
+    //Only one entry was left, so race the thieves for it
+    bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+static bool deque_steal(gc_deque_t *deque, reference_t *ref){
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+    if(top >= bottom){
+        return false;
+    }
+    *ref = __atomic_load_n(&deque->refs[top], __ATOMIC_RELAXED);
+    return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+//Sets aside the unused end of the current buffer, where it can still be used
+//by any thread that finds no more room at the bump pointer
+static void retire_buffer(gc_worker_t *worker){
+    if(worker->buffer == worker->buffer_end){
+        return;
+    }
+    pthread_mutex_lock(&tails_lock);
+    if(num_tails == max_tails){
+        max_tails = max_tails == 0 ? 16 : max_tails * 2;
+        tails = realloc(tails, sizeof(gc_tail_t[max_tails]));
+        if(tails == NULL){
+            fprintf(stderr, "could not allocate garbage collector state");
+            exit(1);
+        }
+    }
+    tails[num_tails].start = worker->buffer;
+    tails[num_tails].size = worker->buffer_end - worker->buffer;
+    num_tails++;
+    pthread_mutex_unlock(&tails_lock);
+    worker->buffer = worker->buffer_end;
+}
+
+//Returns whether a copy of the given size can go in room of the given size.
+//Copies keep their size, so the rest must be empty or able to hold a value,
+//which it becomes when it is returned to the pool.
+static bool copy_fits(size_t size, size_t room){
+    return size == room || size + sizeof(value_t) <= room;
+}
+
+//Takes size bytes from the first retired tail that they fit in, or returns NULL
+static uint8_t *reuse_tail(size_t size){
+    uint8_t *start = NULL;
+    pthread_mutex_lock(&tails_lock);
+    for(size_t i = 0; i < num_tails; i++){
+        if(copy_fits(size, tails[i].size)){
+            start = tails[i].start;
+            tails[i].start += size;
+            tails[i].size -= size;
+            if(tails[i].size == 0){
+                tails[i] = tails[--num_tails];
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&tails_lock);
+    return start;
+}
+
+//Doubles the to space if the pool may grow and no other thread has grown it
+//since its size was seen. Returns whether it is bigger than that now.
+static bool grow_to_space(size_t seen){
+    pthread_mutex_lock(&tails_lock);
+    if(pool_size == seen && pool_size < max_pool_size){
+        size_t size = pool_size * 2 < max_pool_size ? pool_size * 2 : max_pool_size;
+        mm_resize(size);
+        __atomic_store_n(&pool_size, size, __ATOMIC_RELAXED);
+    }
+    bool grown = pool_size != seen;
+    pthread_mutex_unlock(&tails_lock);
+    return grown;
+}
+
+//Finds room for a copy that doesn't fit in the rest of the buffer. It gets a
+//new buffer if little of the old one would be wasted, and room of its own
+//otherwise. When the to space runs out, the retired tails are tried as well,
+//and then the to space grows if the pool may grow.
+static uint8_t *reserve_copy(gc_worker_t *worker, size_t size){
+    size_t rest = worker->buffer_end - worker->buffer;
+    size_t wanted = rest * 8 <= gc_buffer_size && size < gc_buffer_size ?
+        gc_buffer_size : size;
+    size_t reserved = wanted;
+    uint8_t *start = mm_reserve(size, &reserved);
+    if(start == NULL){
+        start = reuse_tail(size);
+        if(start != NULL){
+            return start;
+        }
+        size_t seen;
+        do {
+            seen = __atomic_load_n(&pool_size, __ATOMIC_RELAXED);
+            reserved = wanted;
+            start = mm_reserve(size, &reserved);
+        } while(start == NULL && grow_to_space(seen));
+    }
+    if(start != NULL && reserved > size){
+        retire_buffer(worker);
+        worker->buffer = start + size;
+        worker->buffer_end = start + reserved;
+    }
+    if(start == NULL){
+        fprintf(stderr, "out of memory while collecting garbage\n");
+        exit(1);
+    }
+    return start;
+}
+
+//Copies a value into room reserved by the current thread
+static value_t *buffer_copy(value_t *value){
+    gc_worker_t *worker = current_worker;
+    size_t size = value->value_size;
+    uint8_t *start;
+    if(copy_fits(size, worker->buffer_end - worker->buffer)){
+        start = worker->buffer;
+        worker->buffer += size;
+    } else {
+        start = reserve_copy(worker, size);
+    }
+    value_t *copy = (value_t*)start;
+    memcpy(copy, value, size);
+    worker->copied += size;
+    return copy;
+}
+
+//Returns whether a value has been copied to the to space. Unlike
+//is_pool_address(), this doesn't change when the to space grows.
+static bool is_copy(value_t *value){
+    return (uint8_t*)value >= (uint8_t*)to_space &&
+        (uint8_t*)value < (uint8_t*)to_space + max_pool_size;
+}
+
+//The parallel copy_ref: claims the value, copies it and queues it to have its
+//children copied. Values that another thread has claimed are left to it.
+static void claim_ref(reference_t ref){
+    value_t *value = __atomic_load_n(&ref_table[ref], __ATOMIC_ACQUIRE);
+    if(value == &copy_in_progress || is_copy(value)){
+        return;
+    }
+    //Large values are claimed by marking them, and stay where they are
+    if(is_large_address(value)){
+        if(mm_mark_large(value)){
+            __atomic_add_fetch(&pending_copies, 1, __ATOMIC_SEQ_CST);
+            deque_push(&current_worker->deque, ref);
         }
+        return;
+    }
+    if(!__atomic_compare_exchange_n(&ref_table[ref], &value, &copy_in_progress,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        return;
+    }
+    __atomic_store_n(&ref_table[ref], buffer_copy(value), __ATOMIC_RELEASE);
+    __atomic_add_fetch(&pending_copies, 1, __ATOMIC_SEQ_CST);
+    deque_push(&current_worker->deque, ref);
+}
+
+static void claim_global(const char *name, reference_t ref){
+    (void)name;
+    if(is_value_ref(ref)){
+        claim_ref(ref);
+    }
+}
+
+static void count_internal_ref_atomic(reference_t ref){
+    __atomic_add_fetch(&internal_refs[ref], 1, __ATOMIC_RELAXED);
+}
+
+static void count_global_ref_atomic(const char *name, reference_t ref){
+    (void)name;
+    if(is_value_ref(ref)){
+        count_internal_ref_atomic(ref);
+    }
+}
+
+//Returns whether a value was copied or marked by the parallel collection
+static bool is_claimed(value_t *value){
+    return is_copy(value) ||
+        (is_large_address(value) && mm_is_large_marked(value));
+}
+
+//Like release_live_ref, for references from garbage to copied values
+static void release_copied_ref(reference_t ref){
+    value_t *value = __atomic_load_n(&ref_table[ref], __ATOMIC_RELAXED);
+    if(is_claimed(value)){
+        __atomic_sub_fetch(&value->ref_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+//Copies the children of queued copies until no thread has any left, stealing
+//from the other threads whenever the own deque is empty
+static void trace_copies(gc_worker_t *worker){
+    reference_t ref;
+    for(;;){
+        while(deque_pop(&worker->deque, &ref)){
+            foreach_child(ref_table[ref], claim_ref);
+            __atomic_sub_fetch(&pending_copies, 1, __ATOMIC_SEQ_CST);
+        }
+        if(__atomic_load_n(&pending_copies, __ATOMIC_SEQ_CST) == 0){
+            return;
+        }
+        for(size_t i = 1; i < gc_threads; i++){
+            gc_worker_t *victim = &workers[(worker->index + i) % gc_threads];
+            if(deque_steal(&victim->deque, &ref)){
+                foreach_child(ref_table[ref], claim_ref);
+                __atomic_sub_fetch(&pending_copies, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            if(i == gc_threads - 1){
+                sched_yield();
+            }
+        }
+    }
+}
+
+//The work of one GC thread. The barriers make sure that all internal
+//references are counted before temporaries are looked for, and that all
+//roots are queued before any thread concludes that tracing is done.
+static void *gc_worker_run(void *arg){
+    gc_worker_t *worker = arg;
+    current_worker = worker;
+    reference_t start = (reference_t)(num_refs * worker->index / gc_threads);
+    reference_t end = (reference_t)(num_refs * (worker->index + 1) / gc_threads);
+
+    for(reference_t i = start; i < end; i++){
+        if(ref_table[i] != NULL){
+            foreach_child(ref_table[i], count_internal_ref_atomic);
+        }
+    }
+    foreach_global_part(worker->index, gc_threads, count_global_ref_atomic);
+    pthread_barrier_wait(&gc_barrier);
+
+    foreach_global_part(worker->index, gc_threads, claim_global);
+    for(reference_t i = start; i < end; i++){
+        //Other threads may be copying this value already, but then it is
+        //no longer in the from space
+        value_t *value = __atomic_load_n(&ref_table[i], __ATOMIC_ACQUIRE);
+        if(value != NULL && value != &copy_in_progress && !is_claimed(value)
+                && value->ref_count > internal_refs[i]){
+            claim_ref(i);
+        }
+    }
+    pthread_barrier_wait(&gc_barrier);
+
+    trace_copies(worker);
+    pthread_barrier_wait(&gc_barrier);
+
+    for(reference_t i = start; i < end; i++){
+        value_t *value = ref_table[i];
+        if(value != NULL && !is_claimed(value)){
+            foreach_child(value, release_copied_ref);
+            __atomic_store_n(&ref_table[i], NULL, __ATOMIC_RELAXED);
+        }
+    }
+    retire_buffer(worker);
+    return NULL;
+}
+
+//collect_copying split between gc_threads threads. The calling thread does
+//the share of the first one.
+static void collect_copying_parallel(void){
+    alloc_internal_refs(num_refs);
+    workers = calloc(gc_threads, sizeof(gc_worker_t));
+    if(workers == NULL){
+        fprintf(stderr, "could not allocate garbage collector state");
+        exit(1);
+    }
+    for(size_t i = 0; i < gc_threads; i++){
+        workers[i].index = i;
+        workers[i].deque.refs = malloc(sizeof(reference_t[num_refs]));
+        if(workers[i].deque.refs == NULL){
+            fprintf(stderr, "could not allocate garbage collector state");
+            exit(1);
+        }
+    }
+    pending_copies = 0;
+    gc_buffer_size = pool_size / (gc_threads * 64) / ALIGNMENT * ALIGNMENT;
+    if(gc_buffer_size > GC_BUFFER_SIZE){
+        gc_buffer_size = GC_BUFFER_SIZE;
+    }
+    pthread_barrier_init(&gc_barrier, NULL, gc_threads);
+
+    //The values stay where they are until they are copied, so the to space
+    //can be initialized right away
+    mm_init(pool_size, to_space);
+    for(size_t i = 1; i < gc_threads; i++){
+        if(pthread_create(&workers[i].thread, NULL, gc_worker_run, &workers[i]) != 0){
+            fprintf(stderr, "could not start garbage collector thread");
+            exit(1);
+        }
+    }
+    gc_worker_run(&workers[0]);
+    for(size_t i = 1; i < gc_threads; i++){
+        pthread_join(workers[i].thread, NULL);
+    }
+    current_worker = NULL;
+    pthread_barrier_destroy(&gc_barrier);
+
+    //Give the unused ends of the buffers back, leaving free values in the gaps
+    for(size_t i = 0; i < num_tails; i++){
+        mm_unreserve(tails[i].start, tails[i].size);
+    }
+    free(tails);
+    tails = NULL;
+    num_tails = max_tails = 0;
+    for(size_t i = 0; i < gc_threads; i++){
+        bytes_copied += workers[i].copied;
+        free(workers[i].deque.refs);
+    }
+    free(workers);
+    workers = NULL;
+    free(internal_refs);
+    internal_refs = NULL;
+
+    //The garbage large values have had their references released already
+    mm_sweep_large(NULL);
+
+    void *temp = from_space;
+    from_space = to_space;
+    to_space = temp;
+    mm_nursery_reset();
+}
+
+/*!
+ * Sets the number of threads that share each copying collection. With 1,
+ * the default, collections run on the calling thread alone.
+ */
+void set_gc_threads(size_t threads){
+    gc_threads = threads > 0 ? threads : 1;
+}
+
+//// END PARALLEL COPYING COLLECTOR ////
+
+
+//// INCREMENTAL COLLECTOR ////
+
+//With an incremental budget, passing the occupancy trigger starts a cycle
+//instead of a full collection, and each allocation then does about
+//inc_budget bytes of its work, so the program never stops for long:
+//
+// - INC_MARK marks everything reachable from the globals.
+// - INC_GATHER makes the values that are still unmarked candidates.
+// - INC_COUNT counts the references between candidates.
+// - INC_RESCUE finds the candidates that are referenced from outside the
+//   candidates: by a global, a value allocated or marked during the cycle,
+//   or the evaluator. They are live, and so is every candidate they refer
+//   to. The rest is garbage that only refers to itself, which reference
+//   counting alone never frees.
+// - INC_FREE frees the garbage.
+//
+//Because the last two compare reference counts with the references between
+//candidates, a value that the program moved while it was being marked is
+//kept even if marking missed it, so stores need no write barrier. Once
+//counting has begun, a candidate whose reference count changes is rescued
+//right away.
+//
+//Values don't move, so the freed memory goes on the free list, and a full
+//collection is still needed when it gets too fragmented.
+
+//Marks a reference to have its children marked later
+static void inc_shade(reference_t ref){
+    if(is_value_ref(ref) && inc_colors[ref] == COLOR_WHITE){
+        inc_colors[ref] = COLOR_BLACK;
+        inc_stack[inc_top++] = ref;
+    }
+}
+
+static void inc_shade_global(const char *name, reference_t ref){
+    (void)name;
+    inc_shade(ref);
+}
+
+static void inc_start(void){
+    memset(inc_colors, COLOR_WHITE, num_refs);
+    inc_top = 0;
+    foreach_global(inc_shade_global);
+    inc_phase = INC_MARK;
+}
+
+//Marks the children of marked values until budget bytes of them are scanned.
+//Returns the number of bytes scanned.
+static size_t inc_mark(size_t budget){
+    size_t work = 0;
+    while(inc_top > 0 && work < budget){
+        value_t *value = ref_table[inc_stack[--inc_top]];
+        if(value != NULL){
+            foreach_child(value, inc_shade);
+            work += value->value_size;
+        }
+    }
+    if(inc_top == 0){
+        inc_cursor = 0;
+        inc_phase = INC_GATHER;
+    }
+    return work;
+}
+
+//Makes the unmarked values candidates, looking at one ref_table entry for
+//every pointer's worth of the budget. Returns the number of bytes looked at.
+static size_t inc_gather(size_t budget){
+    size_t work = 0;
+    while(inc_cursor < num_refs && work < budget){
+        reference_t ref = inc_cursor++;
+        if(ref_table[ref] != NULL && inc_colors[ref] == COLOR_WHITE){
+            inc_colors[ref] = COLOR_CANDIDATE;
+            inc_stack[inc_top++] = ref;
+        }
+        work += sizeof(value_t *);
+    }
+    if(inc_cursor == num_refs){
+        inc_cursor = 0;
+        inc_rescued_top = 0;
+        inc_phase = INC_COUNT;
+    }
+    return work;
+}
+
+static void count_candidate_ref(reference_t ref){
+    if(inc_colors[ref] == COLOR_CANDIDATE){
+        inc_counts[ref]++;
+    }
+}
+
+//Counts the references from candidates to candidates until budget bytes of
+//candidates are scanned. Candidates freed by reference counting since they
+//were gathered are dropped. Returns the number of bytes scanned.
+static size_t inc_count(size_t budget){
+    size_t work = 0;
+    while(inc_cursor < inc_top && work < budget){
+        reference_t ref = inc_stack[inc_cursor++];
+        value_t *value = ref_table[ref];
+        if(value == NULL){
+            inc_colors[ref] = COLOR_BLACK;
+            work += sizeof(value_t *);
+        } else if(inc_colors[ref] == COLOR_CANDIDATE){
+            foreach_child(value, count_candidate_ref);
+            work += value->value_size;
+        } else {
+            work += sizeof(value_t *);
+        }
+    }
+    if(inc_cursor == inc_top){
+        inc_cursor = 0;
+        inc_phase = INC_RESCUE;
+    }
+    return work;
+}
+
+static void rescue_ref(reference_t ref){
+    if(inc_colors[ref] == COLOR_CANDIDATE){
+        inc_colors[ref] = COLOR_BLACK;
+        inc_rescued[inc_rescued_top++] = ref;
+    }
+}
+
+//Rescues a candidate whose reference count changed after counting began.
+//The program can only reach a candidate through references it counts, so
+//one that it still uses is rescued here or by its own reference count.
+static void inc_touch(reference_t ref){
+    if(inc_phase == INC_COUNT || inc_phase == INC_RESCUE){
+        rescue_ref(ref);
+    }
+}
+
+//Keeps the candidates that are referenced from outside the candidates, and
+//those they refer to, until budget bytes of them are scanned. The rest is
+//garbage. Returns the number of bytes scanned.
+static size_t inc_rescue(size_t budget){
+    size_t work = 0;
+    while(work < budget){
+        if(inc_rescued_top > 0){
+            value_t *value = ref_table[inc_rescued[--inc_rescued_top]];
+            if(value != NULL){
+                foreach_child(value, rescue_ref);
+                work += value->value_size;
+            }
+        } else if(inc_cursor < inc_top){
+            reference_t ref = inc_stack[inc_cursor++];
+            value_t *value = ref_table[ref];
+            if(value == NULL){
+                inc_colors[ref] = COLOR_BLACK;
+            } else if(inc_colors[ref] == COLOR_CANDIDATE &&
+                    value->ref_count > inc_counts[ref]){
+                rescue_ref(ref);
+            }
+            work += sizeof(value_t *);
+        } else {
+            inc_cursor = 0;
+            inc_phase = INC_FREE;
+            break;
+        }
+    }
+    return work;
+}
+
+//Frees garbage until budget bytes of it are freed. Other garbage may still
+//refer to it, so its references are only released once all of it is freed.
+//Returns the number of bytes freed.
+static size_t inc_free(size_t budget){
+    size_t work = 0;
+    while(inc_cursor < inc_top && work < budget){
+        reference_t ref = inc_stack[inc_cursor++];
+        value_t *value = ref_table[ref];
+        inc_counts[ref] = 0;
+        if(value == NULL || inc_colors[ref] != COLOR_CANDIDATE){
+            work += sizeof(value_t *);
+            continue;
+        }
+        work += value->value_size;
+        ref_table[ref] = NULL;
+        inc_colors[ref] = COLOR_FREED;
+        traverse_decref(value);
+        mm_free(value);
+    }
+    return work;
+}
+
+//Releases the references of the freed garbage and ends the cycle
+static void inc_finish(void){
+    for(reference_t i = 0; i < inc_top; i++){
+        reference_t ref = inc_stack[i];
+        if(ref_table[ref] == NULL && inc_colors[ref] == COLOR_FREED){
+            free_refs[num_free_refs++] = ref;
+        }
+    }
+    inc_phase = INC_IDLE;
+    incremental_cycles++;
+    resize_pool();
+    update_gc_limit();
+}
+
+//Does up to inc_budget bytes of work on the incremental cycle, or starts one
+//if an allocation of the given size would pass the occupancy trigger
+static void incremental_step(size_t size){
+    if(inc_phase == INC_IDLE && mem_used() + size <= gc_limit){
+        return;
+    }
+    pause_begin();
+    size_t work = 0;
+    if(inc_phase == INC_IDLE){
+        inc_start();
+    }
+    if(inc_phase == INC_MARK){
+        work += inc_mark(inc_budget);
+    }
+    if(inc_phase == INC_GATHER && work < inc_budget){
+        work += inc_gather(inc_budget - work);
+    }
+    if(inc_phase == INC_COUNT && work < inc_budget){
+        work += inc_count(inc_budget - work);
+    }
+    if(inc_phase == INC_RESCUE && work < inc_budget){
+        work += inc_rescue(inc_budget - work);
+    }
+    if(inc_phase == INC_FREE && work < inc_budget){
+        inc_free(inc_budget - work);
+        if(inc_cursor == inc_top){
+            inc_finish();
+        }
+    }
+    pause_end();
+}
+
+//Abandons the incremental cycle, for a full collection
+static void inc_abort(void){
+    if(inc_phase >= INC_COUNT){
+        for(reference_t i = 0; i < inc_top; i++){
+            inc_counts[inc_stack[i]] = 0;
+        }
+    }
+    inc_phase = INC_IDLE;
+}
+
+/*!
+ * Makes garbage collection incremental, doing about the given number of bytes
+ * of work on each allocation once the occupancy trigger is passed. 0 turns
+ * incremental collection off.
+ */
+void set_gc_budget(size_t bytes){
+    inc_budget = bytes;
+    if(inc_budget > 0 && max_refs > inc_max_refs){
+        grow_incremental_state();
+    }
+}
+
+//// END INCREMENTAL COLLECTOR ////
+
+
+//// CYCLE COLLECTOR ////
+
+//With a cycle limit, garbage cycles are also freed by synchronous trial
+//deletion (Bacon and Rajan, "Concurrent Cycle Collection in Reference Counted
+//Systems"). A cycle can only become garbage when a reference to one of its
+//values is dropped and the value survives, so decref() buffers such values
+//as possible roots. Once there are cycle_limit of them, collect_cycles()
+//looks at just the values they reach:
+//
+// - mark_gray() subtracts the references between those values from their
+//   reference counts, coloring them gray. What is left of a count are the
+//   references from elsewhere: globals, other values and the evaluator.
+// - scan_black() restores the counts of the values that have such
+//   references, and of the values they refer to, coloring them black again.
+// - The values that are still gray only refer to each other, and to black
+//   values whose counts no longer include them. They are freed.
+//
+//So the work is proportional to the values near the garbage instead of the
+//whole heap. Values don't move, so the freed memory goes on the free list,
+//and a full collection is still needed when it gets too fragmented.
+
+//Only these values can refer back to themselves
+static bool may_be_cyclic(value_t *value){
+    return value->type == VAL_LIST || value->type == VAL_DICT ||
+        value->type == VAL_REF_ARRAY || value->type == VAL_DICT_ENTRIES;
+}
+
+//Buffers a value whose reference count was decreased but not to zero. A
+//buffered reference may be released and reused before the cycles are
+//collected, which only makes its new value a possible root.
+static void buffer_possible_root(reference_t ref, value_t *value){
+    if(!buffered[ref] && may_be_cyclic(value)){
+        buffered[ref] = true;
+        cycle_roots[num_cycle_roots++] = ref;
+    }
+}
+
+//Empties the buffer after a full collection, which freed every cycle
+static void clear_cycle_roots(void){
+    for(reference_t i = 0; i < num_cycle_roots; i++){
+        buffered[cycle_roots[i]] = false;
+    }
+    num_cycle_roots = 0;
+}
+
+//Subtracts a reference from a gray value, and colors its target gray
+static void mark_gray_child(reference_t ref){
+    ref_table[ref]->ref_count--;
+    if(cycle_colors[ref] == CYCLE_BLACK){
+        cycle_colors[ref] = CYCLE_GRAY;
+        cycle_grays[num_cycle_grays++] = ref;
+        cycle_stack[cycle_top++] = ref;
+    }
+}
+
+//Colors gray everything reachable from a possible root that isn't yet, and
+//subtracts the references between them from their counts
+static void mark_gray(reference_t root){
+    cycle_colors[root] = CYCLE_GRAY;
+    cycle_grays[num_cycle_grays++] = root;
+    cycle_stack[cycle_top++] = root;
+    while(cycle_top > 0){
+        foreach_child(ref_table[cycle_stack[--cycle_top]], mark_gray_child);
+    }
+}
+
+//Adds back a reference from a black value, and colors its target black
+static void scan_black_child(reference_t ref){
+    ref_table[ref]->ref_count++;
+    if(cycle_colors[ref] != CYCLE_BLACK){
+        cycle_colors[ref] = CYCLE_BLACK;
+        cycle_stack[cycle_top++] = ref;
+    }
+}
+
+//Colors a gray value black, along with everything gray it reaches, and adds
+//back the references from them
+static void scan_black(reference_t ref){
+    cycle_colors[ref] = CYCLE_BLACK;
+    cycle_stack[cycle_top++] = ref;
+    while(cycle_top > 0){
+        foreach_child(ref_table[cycle_stack[--cycle_top]], scan_black_child);
+    }
+}
+
+//Frees the garbage cycles among the values reachable from the possible
+//roots, and empties the buffer. Returns whether there were any roots to look
+//at; an incremental cycle has to finish first.
+static bool collect_cycles(void){
+    if(num_cycle_roots == 0 || inc_phase != INC_IDLE){
+        return false;
+    }
+    pause_begin();
+
+    num_cycle_grays = 0;
+    for(reference_t i = 0; i < num_cycle_roots; i++){
+        reference_t root = cycle_roots[i];
+        buffered[root] = false;
+        if(ref_table[root] != NULL && cycle_colors[root] == CYCLE_BLACK){
+            mark_gray(root);
+        }
+    }
+    num_cycle_roots = 0;
+
+    //The values with references from elsewhere are live, and so is
+    //everything they reach. Whatever is still gray after that is garbage.
+    for(reference_t i = 0; i < num_cycle_grays; i++){
+        reference_t ref = cycle_grays[i];
+        if(cycle_colors[ref] == CYCLE_GRAY && ref_table[ref]->ref_count > 0){
+            scan_black(ref);
+        }
+    }
+    for(reference_t i = 0; i < num_cycle_grays; i++){
+        if(cycle_colors[cycle_grays[i]] == CYCLE_GRAY){
+            cycle_colors[cycle_grays[i]] = CYCLE_WHITE;
+        }
+    }
+
+    //The references among the garbage are already subtracted, so it is
+    //freed without releasing them again
+    for(reference_t i = 0; i < num_cycle_grays; i++){
+        reference_t ref = cycle_grays[i];
+        if(cycle_colors[ref] == CYCLE_WHITE){
+            cycle_colors[ref] = CYCLE_BLACK;
+            value_t *value = ref_table[ref];
+            release_reference(ref);
+            mm_free(value);
+        }
+    }
+
+    cycle_collections++;
+    pause_end();
+    return true;
+}
+
+/*!
+ * Frees garbage cycles by trial deletion once decref() has found the given
+ * number of possible roots, instead of leaving them to the full collections.
+ * 0 turns the cycle collector off.
+ */
+void set_cycle_limit(size_t roots){
+    cycle_limit = roots;
+    if(cycle_limit > 0 && max_refs > cycle_max_refs){
+        grow_cycle_state();
+    }
+}
+
+//// END CYCLE COLLECTOR ////
+
+
+void collect_garbage(void) {
+    if (interactive) {
+        fprintf(stderr, "Collecting garbage.\n");
+    }
+    pause_begin();
+    size_t old_use = mem_used();
+
+    /* The full collection does whatever work an incremental cycle had left. */
+    inc_abort();
+    grow_for_collection();
+
+    if (collector == COLLECTOR_COMPACT) {
+        collect_compacting();
+    } else if (gc_threads > 1) {
+        collect_copying_parallel();
+    } else {
+        collect_copying();
     }
+    rebuild_free_refs();
+    num_nursery_refs = 0;
+    clear_cycle_roots();
+    resize_pool();
+    update_gc_limit();
+    full_collections++;
+    record_survival(old_use, mem_used());
+    pause_end();
 
     if (interactive) {
         // This will report how many bytes we were able to free in this garbage
@@ -286,10 +2235,22 @@ void collect_garbage(void) {
 
 /*!
  * Clean up the allocator state.
- * This requires freeing the memory pool and the reference table,
+ * This requires unmapping the memory pool and freeing the reference table,
  * so that the allocator doesn't leak memory.
  */
 void close_refs(void) {
-    free(pool);
+    munmap(pool, reserved_size);
     free(ref_table);
+    free(free_refs);
+    free(nursery_refs);
+    free(nursery_slots);
+    free(inc_colors);
+    free(inc_stack);
+    free(inc_counts);
+    free(inc_rescued);
+    free(cycle_roots);
+    free(buffered);
+    free(cycle_colors);
+    free(cycle_grays);
+    free(cycle_stack);
 }
@@ -10,17 +10,165 @@
 #ifndef REFS_H
 #define REFS_H
 
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include "types.h"
 
+/*!
+ * References with this bit set do not index the ref_table, or point into the
+ * pool with DIRECT_REFS. Instead, they hold a small integer directly
+ * ("tagged"), so it needs no value in the pool.
+ * Tagged integers are in the range [-TAGGED_INT_LIMIT, TAGGED_INT_LIMIT),
+ * stored in the low 30 bits as two's complement.
+ */
+#define TAGGED_INT_BIT ((reference_t) 0x40000000)
+#define TAGGED_INT_LIMIT ((int64_t) 1 << 29)
+
+/* Returns whether the reference is a tagged integer. */
+static inline bool is_tagged_int(reference_t ref) {
+    return ref >= 0 && (ref & TAGGED_INT_BIT) != 0;
+}
+
+/* Returns whether the reference refers to a value in the pool. */
+static inline bool is_value_ref(reference_t ref) {
+    return ref >= 0 && (ref & TAGGED_INT_BIT) == 0;
+}
+
+/* Returns whether an integer can be stored as a tagged integer. */
+static inline bool fits_tagged_int(int64_t i) {
+    return i >= -TAGGED_INT_LIMIT && i < TAGGED_INT_LIMIT;
+}
+
+/* Packs an integer that fits_tagged_int() into a tagged reference. */
+static inline reference_t make_tagged_int(int64_t i) {
+    return TAGGED_INT_BIT | (reference_t) (i & (TAGGED_INT_BIT - 1));
+}
+
+/* Unpacks the integer stored in a tagged reference. */
+static inline int64_t tagged_int_value(reference_t ref) {
+    int64_t i = ref & (TAGGED_INT_BIT - 1);
+    return i >= TAGGED_INT_LIMIT ? i - 2 * TAGGED_INT_LIMIT : i;
+}
 
-/* Initializes the references and the memory pool state. */
-void init_refs(size_t memory_size, void *memory_pool);
+
+/* The algorithms available for full garbage collections. */
+typedef enum {
+    COLLECTOR_COPYING,  /*!< Copy live values between two halves of the pool. */
+    COLLECTOR_COMPACT   /*!< Mark live values and slide them down in one pool. */
+} collector_t;
+
+/*
+ * Initializes the references and the memory pool state.
+ * The pool may grow from memory_size to max_size bytes, all mapped at memory_pool.
+ * A nonzero nursery_size enables generational collection with a nursery of that many bytes.
+ * A nonzero large_size sets aside that many bytes for a large-object space.
+ */
+void init_refs(size_t memory_size, size_t max_size, void *memory_pool,
+        size_t nursery_size, size_t large_size, collector_t collector);
 
 /* Attempts to allocate a value from the memory pool and assign it a reference. */
 reference_t make_ref(value_type_t type, size_t size);
 
+/* Returns whether a value is in the pool, the nursery or the large-object space. */
+bool is_allocated_value(value_t *value);
+
+#ifdef DIRECT_REFS
+
+/*!
+ * The start of the memory pool, which every reference is an offset from. It
+ * is set once by init_refs(), and covers both semispaces.
+ */
+extern uint8_t *ref_base;
+
 /* Dereference a reference_t into its corresponding value_t. */
-value_t *deref(reference_t ref);
+static inline value_t *deref(reference_t ref) {
+    /* Make sure the reference points at an allocated value in the current
+     * semispace, rather than one that a collection has moved away from. */
+    assert(is_value_ref(ref));
+    value_t *value = (value_t *) (ref_base + ref);
+    assert(is_allocated_value(value));
+    return value;
+}
+
+/*!
+ * A collection moves values and fixes up the references to them, but it can
+ * only find the references in C variables that are registered with it. Each
+ * function that uses a reference after something that may allocate registers
+ * the variable with ROOT() first, and unregisters it with UNROOT() before it
+ * returns. UNROOT(n) undoes the last n registrations.
+ */
+void push_root(reference_t *ref);
+void pop_roots(size_t count);
+
+#define ROOT(ref) push_root(&(ref))
+#define UNROOT(count) pop_roots(count)
+
+#else /* DIRECT_REFS */
+
+/*!
+ * A read-only view of the reference table, which maps each reference below
+ * refs_count() to its value, or to NULL if the reference is unused. It is
+ * declared here so that deref(), which the evaluator calls for nearly every
+ * operation, compiles down to a single load. Only refs.c may change the table.
+ */
+extern value_t *const *ref_values;
+
+/* Returns the number of references in the table, including unused ones. */
+reference_t refs_count(void);
+
+/* Dereference a reference_t into its corresponding value_t. */
+static inline value_t *deref(reference_t ref) {
+    /* Make sure the reference is actually a valid index, and that its value
+     * is allocated, which also means that the reference is in use. */
+    assert(ref >= 0 && ref < refs_count());
+    value_t *value = ref_values[ref];
+    assert(is_allocated_value(value));
+    return value;
+}
+
+/* References never change when values move, so they need no registering. */
+#define ROOT(ref) ((void) 0)
+#define UNROOT(count) ((void) 0)
+
+#endif /* DIRECT_REFS */
+
+/*
+ * Like deref(), but also accepts a tagged integer, which is unpacked into
+ * *box. The box is returned in that case, so it must outlive the result.
+ */
+static inline value_t *deref_boxed(reference_t ref, integer_value_t *box) {
+    if (!is_tagged_int(ref)) {
+        return deref(ref);
+    }
+    box->base.type = VAL_INTEGER;
+    box->base.ref_count = 1;
+    box->base.value_size = sizeof(integer_value_t);
+    box->integer_value = tagged_int_value(ref);
+    return (value_t *) box;
+}
+
+/* Returns whether the reference currently maps to a value. */
+bool is_live_ref(reference_t ref);
+
+/*!
+ * Returns whether the caller's reference to a value is its only one. The
+ * value would then be freed as soon as the caller is done with it, so its
+ * storage may be reused for a result instead.
+ */
+bool is_unique_ref(reference_t ref);
+
+/*!
+ * Tries to grow the value at the given reference in place to hold at least
+ * size bytes, without collecting garbage. Returns whether it is now that big.
+ */
+bool grow_ref(reference_t ref, size_t size);
+
+/*!
+ * Makes ref refer to the value of replacement instead of its own value,
+ * which is freed. The caller's reference to replacement is used up.
+ */
+void replace_ref(reference_t ref, reference_t replacement);
 
 /*!
  * Returns the reference that maps to the given value. This is the inverse of deref().
@@ -37,6 +185,59 @@ void incref(reference_t ref);
 /* Decreases the reference count of the value at the given reference. */
 void decref(reference_t ref);
 
+/* Sets the pool occupancy percentage that triggers a collection; -1 disables it. */
+void set_gc_trigger(int percent);
+
+/* Sets the number of threads that share each copying collection. */
+void set_gc_threads(size_t threads);
+
+/* Makes collections incremental, with about this many bytes of work per allocation. */
+void set_gc_budget(size_t bytes);
+
+/* Frees garbage cycles by trial deletion once this many possible roots are found. */
+void set_cycle_limit(size_t roots);
+
+/* Prints the distribution of the garbage collector's pause times. */
+void print_gc_pauses(FILE *stream);
+
+/* The garbage collector's statistics, as reported by gc_stats() and -s. */
+typedef struct {
+    size_t full_collections;
+    size_t minor_collections;
+    size_t incremental_cycles;
+    /*! The number of times trial deletion looked for garbage cycles. */
+    size_t cycle_collections;
+    size_t pauses;
+    uint64_t total_pause_ns;
+    uint64_t longest_pause_ns;
+    size_t bytes_allocated;
+    size_t bytes_copied;
+    /*! The time since init_refs(), for the allocation rate. */
+    uint64_t elapsed_ns;
+    /*! The percentage of bytes that survived the last full or minor collection. */
+    size_t last_survival;
+    /*! The mean of that percentage over all full and minor collections. */
+    size_t mean_survival;
+    /*! The current size of each semispace, which may grow up to its maximum. */
+    size_t pool_size;
+    size_t max_pool_size;
+    /*! The number of entries in the ref_table, and how many are free. */
+    size_t refs;
+    size_t free_refs;
+    /*! The number and total size of the values of each type in memory. */
+    size_t live_values[VAL_FREE];
+    size_t live_bytes[VAL_FREE];
+} gc_stats_t;
+
+/* Fills in the garbage collector's statistics so far. */
+void get_gc_stats(gc_stats_t *stats);
+
+/* Returns the name of a value type in the statistics, or NULL if there is none. */
+const char *gc_stats_type_name(value_type_t type);
+
+/* Prints the garbage collector's statistics so far. */
+void print_gc_stats(FILE *stream);
+
 /* Runs the garbage collector to reclaim unused space. */
 void collect_garbage(void);
 
@@ -0,0 +1,753 @@
+/*! \file
+ * Manages references to values allocated in a memory pool, for builds with
+ * DIRECT_REFS. This implements refs.h without the reference table: a
+ * reference is the offset of its value from the start of the pool, so
+ * deref() is a single addition and values need no table entries.
+ *
+ * The price is that a value's reference changes whenever a collection moves
+ * it. The copying collector leaves a forwarding word in the old copy of each
+ * value, and fixes up every reference it scans: those in the copied values,
+ * those that the evaluator keeps outside the pool (see foreach_root()), and
+ * those in C variables registered with ROOT(). Only the semispace copying
+ * collector works this way. The nursery, the large-object space and the
+ * compacting, parallel, incremental and cycle collectors all rely on the
+ * table, so repl.c refuses their options in this build.
+ */
+
+#include "refs.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "config.h"
+#include "eval.h"
+#include "eval_refs.h"
+#include "exception.h"
+#include "mm.h"
+
+/*! The alignment of value_t structs in the memory pool. */
+#define ALIGNMENT 8
+
+
+//// MODULE-LOCAL STATE ////
+
+/*!
+ * The start of the memory pool, a mapping whose pages are only committed when
+ * they are first used. Every reference is an offset from it.
+ */
+uint8_t *ref_base;
+static size_t reserved_size;
+
+static void *from_space = NULL;
+static void *to_space = NULL;
+static size_t pool_size = 0;
+
+/*!
+ * The bounds on pool_size. The -M maximum is reserved once for the whole
+ * pool and split between the semispaces, so each has max_pool_size bytes
+ * reserved and can grow in place. It shrinks no further than its initial size.
+ */
+static size_t min_pool_size = 0;
+static size_t max_pool_size = 0;
+
+/*!
+ * After a collection, the semispaces double if more than this percentage of
+ * them is still in use, and halve if less than POOL_SHRINK_PERCENT is.
+ */
+#define POOL_GROW_PERCENT 50
+#define POOL_SHRINK_PERCENT 10
+
+/*!
+ * When mem_used() would exceed this many bytes, make_ref collects garbage
+ * before allocating. SIZE_MAX disables the occupancy trigger.
+ */
+static size_t gc_limit = SIZE_MAX;
+
+/*! The occupancy trigger as a percentage of the pool, or -1 if disabled. */
+static int gc_trigger = -1;
+
+/*! When init_refs() was called, to turn the bytes allocated into a rate. */
+static struct timespec start_time;
+
+/*!
+ * The addresses of the C variables registered with ROOT(), in the order they
+ * were registered.
+ */
+static reference_t **roots;
+static size_t num_roots;
+static size_t max_roots;
+
+
+//// FUNCTION DEFINITIONS ////
+
+
+/*!
+ * This function initializes the memory pool. It must be called before
+ * allocations can be served. The pool is split into the two semispaces,
+ * which start out with memory_size bytes between them and may grow to
+ * max_size bytes, which must all be mapped at memory_pool. The nursery, the
+ * large-object space and the compacting collector are not supported.
+ */
+void init_refs(size_t memory_size, size_t max_size, void *memory_pool,
+        size_t nursery_bytes, size_t large_bytes, collector_t collector_type) {
+    assert(nursery_bytes == 0 && large_bytes == 0 &&
+            collector_type == COLLECTOR_COPYING);
+    (void) nursery_bytes;
+    (void) large_bytes;
+    (void) collector_type;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    ref_base = memory_pool;
+    reserved_size = max_size;
+    pool_size = memory_size / 2 / ALIGNMENT * ALIGNMENT;
+    min_pool_size = pool_size;
+    max_pool_size = max_size / 2 / ALIGNMENT * ALIGNMENT;
+
+    /* Every value in either semispace needs an offset below TAGGED_INT_BIT. */
+    if (2 * max_pool_size > (size_t) TAGGED_INT_BIT) {
+        fprintf(stderr, "memory pool is too large for direct references\n");
+        exit(1);
+    }
+
+    mm_init(pool_size, memory_pool);
+    mm_prefer_bump(true);
+    from_space = memory_pool;
+    to_space = ref_base + max_pool_size;
+}
+
+
+//// ROOTS ////
+
+/*! Registers a C variable that holds a reference; see ROOT() in refs.h. */
+void push_root(reference_t *ref) {
+    if (num_roots == max_roots) {
+        max_roots = max_roots == 0 ? INITIAL_SIZE : max_roots * 2;
+        roots = realloc(roots, sizeof(reference_t *[max_roots]));
+        if (roots == NULL) {
+            fprintf(stderr, "could not grow the roots");
+            exit(1);
+        }
+    }
+    roots[num_roots++] = ref;
+}
+
+/*! Unregisters the last count variables registered with push_root(). */
+void pop_roots(size_t count) {
+    assert(count <= num_roots);
+    num_roots -= count;
+}
+
+//// END ROOTS ////
+
+
+//// STATISTICS ////
+
+//Counters for gc_stats() and the -s option, as in refs.c. Every collection is
+//a full one that pauses the program.
+
+static size_t full_collections;
+static size_t num_pauses;
+static uint64_t total_pause;
+static uint64_t longest_pause;
+static size_t bytes_allocated;
+static size_t bytes_copied;
+
+//The percentage of the bytes that survived the last collection, and the sum
+//of the percentages over all collections so far
+static size_t last_survival;
+static size_t total_survival;
+
+static uint64_t nanoseconds_since(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) (now.tv_sec - start->tv_sec) * 1000000000 +
+        (uint64_t) now.tv_nsec - (uint64_t) start->tv_nsec;
+}
+
+/*! Prints the number and length of the garbage collector's pauses so far. */
+void print_gc_pauses(FILE *stream) {
+    if (num_pauses == 0) {
+        fprintf(stream, "No garbage collection pauses.\n");
+        return;
+    }
+    fprintf(stream, "%zu garbage collection pauses: total %.3f ms, longest %.3f ms\n",
+            num_pauses, total_pause / 1e6, longest_pause / 1e6);
+}
+
+static gc_stats_t *counting_stats;
+
+static void count_live_value(value_t *value){
+    counting_stats->live_values[value->type]++;
+    counting_stats->live_bytes[value->type] += value->value_size;
+    counting_stats->refs++;
+}
+
+/*!
+ * Fills in the garbage collector's statistics so far. Every value has its
+ * own reference, and none are free.
+ */
+void get_gc_stats(gc_stats_t *stats){
+    memset(stats, 0, sizeof(gc_stats_t));
+    stats->full_collections = full_collections;
+    stats->pauses = num_pauses;
+    stats->total_pause_ns = total_pause;
+    stats->longest_pause_ns = longest_pause;
+    stats->bytes_allocated = bytes_allocated;
+    stats->bytes_copied = bytes_copied;
+    stats->elapsed_ns = nanoseconds_since(&start_time);
+    stats->last_survival = last_survival;
+    stats->mean_survival = full_collections == 0 ? 0 : total_survival / full_collections;
+    stats->pool_size = pool_size;
+    stats->max_pool_size = max_pool_size;
+
+    counting_stats = stats;
+    mm_foreach_value(count_live_value);
+    counting_stats = NULL;
+}
+
+/*! Returns the name of a value type in the statistics. */
+const char *gc_stats_type_name(value_type_t type){
+    switch(type){
+        case VAL_NONE:           return "NoneType";
+        case VAL_BOOL:           return "bool";
+        case VAL_INTEGER:        return "int";
+        case VAL_STRING:         return "str";
+        case VAL_LIST:           return "list";
+        case VAL_DICT:           return "dict";
+        case VAL_REF_ARRAY:      return "ref_array";
+        case VAL_DICT_INDEX:     return "dict_index";
+        case VAL_DICT_ENTRIES:   return "dict_entries";
+        case VAL_STRING_BUILDER: return "str_builder";
+        default:                 return NULL;
+    }
+}
+
+/*! Prints the garbage collector's statistics so far. */
+void print_gc_stats(FILE *stream){
+    gc_stats_t stats;
+    get_gc_stats(&stats);
+    double seconds = stats.elapsed_ns / 1e9;
+
+    fprintf(stream, "Garbage collector statistics:\n");
+    fprintf(stream, "  collections: %zu full, %zu minor, %zu incremental cycles, "
+            "%zu of garbage cycles\n", stats.full_collections, stats.minor_collections,
+            stats.incremental_cycles, stats.cycle_collections);
+    fprintf(stream, "  pauses: %zu, total %.3f ms, longest %.3f ms\n", stats.pauses,
+            stats.total_pause_ns / 1e6, stats.longest_pause_ns / 1e6);
+    fprintf(stream, "  allocated: %zu bytes in %.3f s (%.0f bytes/s)\n",
+            stats.bytes_allocated, seconds,
+            seconds > 0 ? stats.bytes_allocated / seconds : 0.0);
+    fprintf(stream, "  copied: %zu bytes\n", stats.bytes_copied);
+    fprintf(stream, "  survival: %zu%% in the last collection, %zu%% on average\n",
+            stats.last_survival, stats.mean_survival);
+    fprintf(stream, "  pool: %zu of at most %zu bytes in each space\n",
+            stats.pool_size, stats.max_pool_size);
+    fprintf(stream, "  references: %zu direct, no table\n", stats.refs);
+    fprintf(stream, "  live values:");
+    for(value_type_t type = 0; type < VAL_FREE; type++){
+        if(stats.live_values[type] > 0){
+            fprintf(stream, " %s %zu (%zu bytes)", gc_stats_type_name(type),
+                    stats.live_values[type], stats.live_bytes[type]);
+        }
+    }
+    fprintf(stream, "\n");
+}
+
+//// END STATISTICS ////
+
+
+/*!
+ * Collects garbage automatically once more than the given percentage of the
+ * pool is in use. A negative percentage disables the trigger, so collections
+ * only happen on gc() and when an allocation would otherwise fail.
+ */
+void set_gc_trigger(int percent) {
+    gc_trigger = percent;
+    gc_limit = percent < 0 ? SIZE_MAX : pool_size / 100 * percent;
+}
+
+/*! Leaves room for the pool to fill up again before the next automatic collection. */
+static void update_gc_limit(void) {
+    if (gc_trigger >= 0) {
+        size_t trigger_limit = pool_size / 100 * gc_trigger;
+        size_t headroom = mem_used() + (pool_size - mem_used()) / 2;
+        gc_limit = headroom > trigger_limit ? headroom : trigger_limit;
+    }
+}
+
+/*! Only one thread collects, so this accepts nothing but 1. */
+void set_gc_threads(size_t threads) {
+    assert(threads == 1);
+    (void) threads;
+}
+
+/*! Collections are never incremental, so this accepts nothing but 0. */
+void set_gc_budget(size_t bytes) {
+    assert(bytes == 0);
+    (void) bytes;
+}
+
+/*! Garbage cycles are left to the full collections, so this accepts nothing but 0. */
+void set_cycle_limit(size_t roots) {
+    assert(roots == 0);
+    (void) roots;
+}
+
+/*! Gives the pages between start and end back to the system. */
+static void release_pages(uint8_t *start, uint8_t *end) {
+    uintptr_t first = ((uintptr_t) start + MM_PAGE_SIZE - 1) / MM_PAGE_SIZE * MM_PAGE_SIZE;
+    uintptr_t last = (uintptr_t) end / MM_PAGE_SIZE * MM_PAGE_SIZE;
+    if (first < last) {
+        madvise((void *) first, last - first, MADV_DONTNEED);
+    }
+}
+
+/*!
+ * Changes the size of the semispaces. The values in the from space must fit
+ * in the new size. When they shrink, the pages past their new end are given
+ * back to the system, to be committed again if they grow.
+ */
+static void set_pool_size(size_t size) {
+    size = size / ALIGNMENT * ALIGNMENT;
+    if (size < pool_size) {
+        release_pages((uint8_t *) from_space + size, (uint8_t *) from_space + pool_size);
+        release_pages((uint8_t *) to_space + size, (uint8_t *) to_space + pool_size);
+    }
+    pool_size = size;
+    mm_resize(pool_size);
+    set_gc_trigger(gc_trigger);
+}
+
+/*!
+ * Grows the semispaces if little of them is free after a collection, and
+ * shrinks them if most of them is, within min_pool_size and max_pool_size.
+ * The collector leaves the bump pointer right after the live values, so they
+ * can shrink that far.
+ */
+static void resize_pool(void) {
+    size_t used = mm_pool_used();
+    size_t extent = pool_size - mm_unallocated();
+    size_t size = pool_size;
+    while (used * 100 > size * POOL_GROW_PERCENT && size < max_pool_size) {
+        size = size * 2 < max_pool_size ? size * 2 : max_pool_size;
+    }
+    while (size == pool_size && used * 100 < size * POOL_SHRINK_PERCENT &&
+            size / 2 >= min_pool_size && size / 2 >= extent) {
+        size /= 2;
+    }
+    if (size != pool_size) {
+        set_pool_size(size);
+    }
+}
+
+/*!
+ * Grows the semispaces so that at least size more bytes fit at the bump
+ * pointer, if they may grow that far. Returns whether they grew.
+ */
+static bool grow_pool(size_t size) {
+    size_t needed = pool_size - mm_unallocated() + size;
+    if (pool_size == max_pool_size || needed > max_pool_size) {
+        return false;
+    }
+    size_t new_size = pool_size;
+    while (new_size < needed) {
+        new_size = new_size * 2 < max_pool_size ? new_size * 2 : max_pool_size;
+    }
+    set_pool_size(new_size);
+    return true;
+}
+
+/*!
+ * Attempts to allocate a value from the memory pool. Its reference is its
+ * offset from the start of the pool.
+ */
+reference_t make_ref(value_type_t type, size_t size) {
+    /* Force alignment of data size to ALIGNMENT. */
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    /* Collect first if this allocation would pass the occupancy trigger. */
+    if (mem_used() + size > gc_limit) {
+        collect_garbage();
+    }
+
+    /* Find a (free) location to store the value, collecting garbage and
+     * then growing the pool if there is no room. */
+    value_t *value = mm_malloc(size);
+    if (value == NULL) {
+        exception_clear();
+        collect_garbage();
+        value = mm_malloc(size);
+    }
+    if (value == NULL && grow_pool(size)) {
+        exception_clear();
+        value = mm_malloc(size);
+    }
+
+    /* If there is still no space, then fail. */
+    if (value == NULL) {
+        return NULL_REF;
+    }
+
+    /* Initialize the value. */
+    assert(value->type == VAL_FREE);
+    value->type = type;
+    value->ref_count = 1; // this is the first reference to the value
+    bytes_allocated += value->value_size;
+
+    /* Set the data area to a pattern so that it's easier to debug. */
+    memset(value + 1, 0xCC, value->value_size - sizeof(value_t));
+
+    return get_ref(value);
+}
+
+
+/*! Returns whether a value is in the current semispace. */
+bool is_allocated_value(value_t *value) {
+    return is_pool_address(value);
+}
+
+/*!
+ * Returns whether the reference currently maps to a value. A freed value
+ * leaves no trace of its reference, so the holders of a reference must stop
+ * using it before the value is freed, as the interned string table does.
+ */
+bool is_live_ref(reference_t ref) {
+    return is_value_ref(ref);
+}
+
+/*! Returns whether the caller's reference to a value is its only one. */
+bool is_unique_ref(reference_t ref) {
+    return is_value_ref(ref) && deref(ref)->ref_count == 1;
+}
+
+/*!
+ * Grows a value in place if it was the last one allocated. Values are only
+ * grown up to the occupancy trigger, since the collection that the trigger
+ * asks for is left to the next allocation.
+ */
+bool grow_ref(reference_t ref, size_t size) {
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    value_t *value = deref(ref);
+    if (size <= value->value_size) {
+        return true;
+    }
+    if (mem_used() + (size - value->value_size) > gc_limit) {
+        return false;
+    }
+    return mm_grow(value, size);
+}
+
+/*!
+ * A reference is the address of its value here, so it can't be given another
+ * value. String builders are the only values that are replaced, and
+ * eval_refs.c makes none in this build.
+ */
+void replace_ref(reference_t ref, reference_t replacement) {
+    (void) ref;
+    (void) replacement;
+    fprintf(stderr, "replace_ref() is not supported with direct references\n");
+    abort();
+}
+
+/*! Returns the reference that maps to the given value. */
+reference_t get_ref(value_t *value) {
+    return (reference_t) ((uint8_t *) value - ref_base);
+}
+
+static size_t values_counted;
+
+static void count_value(value_t *value) {
+    (void) value;
+    values_counted++;
+}
+
+/*! Returns the number of values in the memory pool. */
+size_t refs_used() {
+    values_counted = 0;
+    mm_foreach_value(count_value);
+    return values_counted;
+}
+
+
+//// REFERENCE COUNTING ////
+
+/*! Increases the reference count of the value at the given reference. */
+void incref(reference_t ref){
+    /* Tagged integers are not stored in the pool, so they aren't counted. */
+    if(is_tagged_int(ref)){
+        return;
+    }
+    deref(ref)->ref_count++;
+}
+
+// Calls f on the address of every reference to a value stored directly in
+// value, so that a collection can fix it up. Like foreach_child() in refs.c,
+// this is the only place here that knows which value types contain references.
+static void foreach_child(value_t *value, void (*f)(reference_t *ref)){
+    if(value->type == VAL_LIST){
+        list_value_t *list = (list_value_t*)value;
+        if(is_value_ref(list->values)){
+            f(&list->values);
+        }
+    } else if(value->type == VAL_DICT){
+        dict_value_t *dict = (dict_value_t*)value;
+        if(is_value_ref(dict->index)){
+            f(&dict->index);
+        }
+        if(is_value_ref(dict->entries)){
+            f(&dict->entries);
+        }
+    } else if(value->type == VAL_REF_ARRAY){
+        ref_array_value_t *arr = (ref_array_value_t*)value;
+        for(size_t i = 0; i < arr->capacity; i++){
+            if(is_value_ref(arr->values[i])){
+                f(&arr->values[i]);
+            }
+        }
+    } else if(value->type == VAL_DICT_ENTRIES){
+        dict_entries_value_t *arr = (dict_entries_value_t*)value;
+        for(size_t i = 0; i < arr->capacity; i++){
+            if(is_value_ref(arr->entries[i].key)){
+                f(&arr->entries[i].key);
+            }
+            if(is_value_ref(arr->entries[i].value)){
+                f(&arr->entries[i].value);
+            }
+        }
+    }
+}
+
+static void decref_child(reference_t *ref){
+    decref(*ref);
+}
+
+/*!
+ * Decreases the reference count of the value at the given reference.
+ * If the reference count reaches 0, the value is definitely garbage and should be freed.
+ */
+void decref(reference_t ref) {
+    if(is_tagged_int(ref)){
+        return;
+    }
+    value_t *value = deref(ref);
+    assert(value->ref_count > 0);
+    if(--value->ref_count > 0){
+        return;
+    }
+
+    /* The interned string table doesn't own its strings, and nothing tells
+     * it that a reference is stale once the value is freed. */
+    if(value->type == VAL_STRING){
+        forget_interned_string(ref);
+    }
+    foreach_child(value, decref_child);
+    mm_free(value);
+}
+
+//// END REFERENCE COUNTING ////
+
+
+//// GARBAGE COLLECTOR ////
+
+//Returns the value at a reference into the from space during a collection.
+//deref() would reject it, since the to space is the pool by then.
+static inline value_t *from_value(reference_t ref){
+    return (value_t*)(ref_base + ref);
+}
+
+//Copies the value that *ref refers to into the to space, unless it has been
+//copied already, and makes *ref refer to the copy. The old value becomes a
+//forwarding word: its type is VAL_FORWARD and its ref_count holds the
+//reference to the copy. It keeps its value_size, so that the from space can
+//still be walked. A variable registered twice already refers to the copy.
+static void forward_ref(reference_t *ref){
+    if(!is_value_ref(*ref)){
+        return;
+    }
+    value_t *value = from_value(*ref);
+    if(is_pool_address(value)){
+        return;
+    }
+    if(value->type != VAL_FORWARD){
+        value_t *copy = mm_copy(value);
+        if(copy == NULL){
+            fprintf(stderr, "out of memory while collecting garbage\n");
+            exit(1);
+        }
+        bytes_copied += copy->value_size;
+        value->type = VAL_FORWARD;
+        value->ref_count = get_ref(copy);
+    }
+    *ref = (reference_t) value->ref_count;
+}
+
+//Returns where a value in the from space was copied to, or NULL_REF if it is
+//garbage. Used to fix up the interned string table, which doesn't own its
+//strings, so they are not roots.
+static reference_t forwarded_ref(reference_t ref){
+    value_t *value = from_value(ref);
+    return value->type == VAL_FORWARD ? (reference_t) value->ref_count : NULL_REF;
+}
+
+//Drops a reference from a garbage value to a live value, which has been
+//copied. References between garbage values don't matter, since all of them
+//are deleted.
+static void release_live_ref(reference_t *ref){
+    value_t *value = from_value(*ref);
+    if(value->type == VAL_FORWARD){
+        from_value((reference_t) value->ref_count)->ref_count--;
+    }
+}
+
+#ifndef NDEBUG
+
+//During check_roots(), the number of references to each value in the from
+//space from the pool and the evaluator, and whether a registered C variable
+//refers to it. Both are indexed by the value's offset in the from space over
+//ALIGNMENT.
+static size_t *found_refs;
+static bool *found_root;
+
+static size_t from_index(reference_t ref){
+    assert(is_value_ref(ref));
+    size_t offset = ref_base + ref - (uint8_t*)from_space;
+    assert(offset < pool_size && offset % ALIGNMENT == 0);
+    return offset / ALIGNMENT;
+}
+
+static void count_found_ref(reference_t *ref){
+    if(is_value_ref(*ref)){
+        found_refs[from_index(*ref)]++;
+    }
+}
+
+static void check_found_refs(value_t *value){
+    size_t index = from_index(get_ref(value));
+    size_t found = found_refs[index];
+    if(found > value->ref_count || (found < value->ref_count && !found_root[index])){
+        fprintf(stderr, "%s value has %zu references, but %zu were found%s\n",
+                gc_stats_type_name(value->type), value->ref_count, found,
+                found_root[index] ? "" : " and no C variable is registered");
+        abort();
+    }
+}
+
+//Checks that every reference is found and will be fixed up. A value's count
+//includes the references in the pool and those that foreach_root() visits,
+//which each hold a count. Any more must be held in C variables, and those
+//must be registered with ROOT(), or they would be left referring to the old
+//copy. Registered variables may borrow a count, so they are not counted, and
+//an unregistered one goes unnoticed here if another variable that refers to
+//the same value is registered. It still refers to the from space after the
+//collection, though, where deref() rejects it.
+static void check_roots(void){
+    size_t slots = pool_size / ALIGNMENT;
+    found_refs = calloc(slots > 0 ? slots : 1, sizeof(size_t));
+    found_root = calloc(slots > 0 ? slots : 1, sizeof(bool));
+    if(found_refs == NULL || found_root == NULL){
+        fprintf(stderr, "could not allocate garbage collector state");
+        exit(1);
+    }
+    for(uint8_t *p = from_space; (void*)p < mm_top(); p += ((value_t*)p)->value_size){
+        if(((value_t*)p)->type != VAL_FREE){
+            foreach_child((value_t*)p, count_found_ref);
+        }
+    }
+    foreach_root(count_found_ref);
+    for(size_t i = 0; i < num_roots; i++){
+        if(is_value_ref(*roots[i])){
+            found_root[from_index(*roots[i])] = true;
+        }
+    }
+    mm_foreach_value(check_found_refs);
+    free(found_refs);
+    free(found_root);
+    found_refs = NULL;
+    found_root = NULL;
+}
+
+#endif /* NDEBUG */
+
+//Semispace copying collection: copies the values reachable from the roots
+//into the to space, fixing up each reference along the way, and then deletes
+//the rest and swaps the spaces.
+static void collect_copying(void){
+#ifndef NDEBUG
+    check_roots();
+#endif
+    uint8_t *from_top = mm_top();
+    mm_init(pool_size, to_space);
+
+    foreach_root(forward_ref);
+    for(size_t i = 0; i < num_roots; i++){
+        forward_ref(roots[i]);
+    }
+
+    //Cheney scan: everything between the scan pointer and the bump pointer
+    //has been copied but its references have not been fixed up. Fixing them
+    //up copies more values, so the scan stops once it catches up.
+    for(uint8_t *scan = to_space; (void*)scan < mm_top(); ){
+        value_t *value = (value_t*)scan;
+        foreach_child(value, forward_ref);
+        scan += value->value_size;
+    }
+    update_interned_strings(forwarded_ref);
+
+    //What is left in the from space is garbage, apart from the forwarding
+    //words. Its references to live values no longer count.
+    for(uint8_t *p = from_space; p < from_top; p += ((value_t*)p)->value_size){
+        value_t *value = (value_t*)p;
+        if(value->type != VAL_FREE && value->type != VAL_FORWARD){
+            foreach_child(value, release_live_ref);
+        }
+    }
+
+    void *temp = from_space;
+    from_space = to_space;
+    to_space = temp;
+}
+
+void collect_garbage(void) {
+    if (interactive) {
+        fprintf(stderr, "Collecting garbage.\n");
+    }
+    struct timespec pause_start;
+    clock_gettime(CLOCK_MONOTONIC, &pause_start);
+    size_t old_use = mem_used();
+
+    collect_copying();
+    resize_pool();
+    update_gc_limit();
+    full_collections++;
+    last_survival = old_use == 0 ? 100 : mem_used() * 100 / old_use;
+    total_survival += last_survival;
+
+    uint64_t ns = nanoseconds_since(&pause_start);
+    num_pauses++;
+    total_pause += ns;
+    if (ns > longest_pause) {
+        longest_pause = ns;
+    }
+
+    if (interactive) {
+        // This will report how many bytes we were able to free in this garbage
+        // collection pass.
+        fprintf(stderr, "Reclaimed %zu bytes of garbage.\n", old_use - mem_used());
+    }
+}
+
+//// END GARBAGE COLLECTOR ////
+
+
+/*!
+ * Clean up the allocator state.
+ * This requires unmapping the memory pool, so that the allocator doesn't leak memory.
+ */
+void close_refs(void) {
+    munmap(ref_base, reserved_size);
+    free(roots);
+}
@@ -6,6 +6,8 @@
 #include <assert.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
 
 #ifndef NREADLINE
 #include <readline/readline.h>
@@ -13,6 +15,7 @@
 #endif
 
 #include "eval.h"
+#include "eval_refs.h"
 #include "eval_types.h"
 #include "exception.h"
 #include "mm.h"
@@ -20,8 +23,11 @@
 #include "refs.h"
 
 #define DEFAULT_MEMORY_SIZE 1024
+#define DEFAULT_INCREMENTAL_TRIGGER 50
 
 bool interactive;
+bool tagged_ints = false;
+bool ast_eval = false;
 static int debug = 0;
 
 /*!
@@ -130,6 +136,30 @@ void usage(FILE *stream, char *program) {
     fprintf(stream, "Runs the CS24 Sub-Python interpreter\n\n");
     fprintf(stream, " -h             print this help message\n");
     fprintf(stream, " -m memory_size amount of memory (in bytes) to use for the memory pool\n");
+    fprintf(stream, " -M max_size    let the memory pool grow up to this many bytes in total,\n");
+    fprintf(stream, "                  shared by both semispaces, when most of it survives\n");
+    fprintf(stream, "                  a collection\n");
+    fprintf(stream, " -c collector   garbage collector to use for full collections:\n");
+    fprintf(stream, "                  copying (the default) uses two halves of the pool,\n");
+    fprintf(stream, "                  compact uses the whole pool and slides values down\n");
+    fprintf(stream, " -n nursery     amount of the memory pool (in bytes) to use as a nursery\n");
+    fprintf(stream, "                  for new values, enabling generational collection\n");
+    fprintf(stream, " -l large       amount of the memory pool (in bytes) to use for values of\n");
+    fprintf(stream, "                  two pages or more, which are marked and swept in place\n");
+    fprintf(stream, "                  instead of being copied\n");
+    fprintf(stream, " -g percent     collect garbage automatically once more than this\n");
+    fprintf(stream, "                  percentage of the memory pool is in use\n");
+    fprintf(stream, " -t threads     number of threads that share each copying collection\n");
+    fprintf(stream, " -I budget      collect garbage incrementally, scanning about this many\n");
+    fprintf(stream, "                  bytes on each allocation once the -g trigger (50 by\n");
+    fprintf(stream, "                  default) is passed, and report the pauses on exit\n");
+    fprintf(stream, " -r roots       free garbage cycles by trial deletion once this many\n");
+    fprintf(stream, "                  lists and dicts may have become part of one\n");
+    fprintf(stream, " -s             report the garbage collector's statistics on exit\n");
+    fprintf(stream, " -a             evaluate the syntax tree directly instead of compiling\n");
+    fprintf(stream, "                  it to bytecode\n");
+    fprintf(stream, " -i             store small integers in their references instead of\n");
+    fprintf(stream, "                  allocating them in the memory pool\n");
     fprintf(stream, " -d             run in debug mode:\n");
     fprintf(stream, "                  the REPL will printing out the current bindings and\n");
     fprintf(stream, "                  memory contents after every evaluation\n");
@@ -145,8 +175,17 @@ int main(int argc, char **argv) {
     FILE *input = stdin;
 
     size_t memory_size = DEFAULT_MEMORY_SIZE;
+    size_t max_size = 0;
+    size_t nursery_size = 0;
+    size_t large_size = 0;
+    int gc_trigger = -1;
+    long gc_threads = 1;
+    size_t gc_budget = 0;
+    size_t cycle_limit = 0;
+    bool gc_stats = false;
+    collector_t collector = COLLECTOR_COPYING;
     int c;
-    while ((c = getopt(argc, argv, "hm:d")) != -1) {
+    while ((c = getopt(argc, argv, "hm:M:c:n:l:g:t:I:r:said")) != -1) {
         switch (c) {
             case 'h':
                 usage(stdout, argv[0]);
@@ -161,6 +200,93 @@ int main(int argc, char **argv) {
                 }
                 break;
 
+            case 'M':
+                max_size = strtol(optarg, NULL, 10);
+                if ((long) max_size <= 0) {
+                    fprintf(stderr, "%s: invalid maximum memory size\n", argv[0]);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'c':
+                if (strcmp(optarg, "copying") == 0) {
+                    collector = COLLECTOR_COPYING;
+                } else if (strcmp(optarg, "compact") == 0) {
+                    collector = COLLECTOR_COMPACT;
+                } else {
+                    fprintf(stderr, "%s: unknown garbage collector '%s'\n", argv[0], optarg);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'n':
+                nursery_size = strtol(optarg, NULL, 10);
+                if ((long) nursery_size < 0) {
+                    fprintf(stderr, "%s: invalid nursery size\n", argv[0]);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'l':
+                large_size = strtol(optarg, NULL, 10);
+                if ((long) large_size < 0) {
+                    fprintf(stderr, "%s: invalid large-object space size\n", argv[0]);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'g':
+                gc_trigger = strtol(optarg, NULL, 10);
+                if (gc_trigger < 0 || gc_trigger > 100) {
+                    fprintf(stderr, "%s: invalid garbage collection trigger\n", argv[0]);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 't':
+                gc_threads = strtol(optarg, NULL, 10);
+                if (gc_threads <= 0) {
+                    fprintf(stderr, "%s: invalid number of garbage collector threads\n", argv[0]);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'I':
+                gc_budget = strtol(optarg, NULL, 10);
+                if ((long) gc_budget <= 0) {
+                    fprintf(stderr, "%s: invalid garbage collection budget\n", argv[0]);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 'r':
+                cycle_limit = strtol(optarg, NULL, 10);
+                if ((long) cycle_limit <= 0) {
+                    fprintf(stderr, "%s: invalid number of possible cycle roots\n", argv[0]);
+                    usage(stderr, argv[0]);
+                    return 1;
+                }
+                break;
+
+            case 's':
+                gc_stats = true;
+                break;
+
+            case 'a':
+                ast_eval = true;
+                break;
+
+            case 'i':
+                tagged_ints = true;
+                break;
+
             case 'd':
                 debug = 1;
                 break;
@@ -174,6 +300,16 @@ int main(int argc, char **argv) {
         }
     }
 
+#ifdef DIRECT_REFS
+    /* Only the semispace copying collector fixes up direct references. */
+    if (collector != COLLECTOR_COPYING || nursery_size > 0 || large_size > 0 ||
+            gc_threads > 1 || gc_budget > 0 || cycle_limit > 0) {
+        fprintf(stderr, "%s: -c compact, -n, -l, -t, -I and -r are not supported "
+                "with direct references\n", argv[0]);
+        return 1;
+    }
+#endif
+
     /* If there are remaining arguments, then take the first argument as a
      * script name and ignore any remaining arguments. (In actual Python, these
      * arguments, along with the script name are stored in sys.argv). */
@@ -201,20 +337,51 @@ int main(int argc, char **argv) {
         printf("Using a memory size of %zu bytes.\n", memory_size);
     }
 
-    /* Allocate the entire memory pool using malloc().
-     * This lets us create different memory-pool sizes for testing.
-     * Obviously, a real allocator's memory pool would either be a fixed region
-     * or would be requested from the operating system (e.g. with sbrk()).
+    /* Without -M, the memory pool keeps its size. */
+    if (max_size == 0) {
+        max_size = memory_size;
+    }
+    if (max_size < memory_size) {
+        fprintf(stderr, "%s: maximum memory size must be at least the memory size\n",
+            argv[0]);
+        return 1;
+    }
+
+    /* Reserve address space for the largest memory pool up front, so that it
+     * can grow in place. This one mapping of max_size bytes holds the whole
+     * pool, so each semispace gets at most half of it. The system only
+     * commits its pages once they are used, so a big maximum costs nothing
+     * until the program needs it. The mapping is page-aligned, as the
+     * large-object space at its start needs.
      */
-    void *memory_pool = malloc(memory_size);
-    if (memory_pool == NULL) {
+    void *memory_pool = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory_pool == MAP_FAILED) {
         fprintf(stderr,
             "%s: could not get %zu bytes from the system\n",
-            argv[0], memory_size
+            argv[0], max_size
         );
         abort();
     }
-    init_refs(memory_size, memory_pool);
+    if (nursery_size >= memory_size) {
+        fprintf(stderr, "%s: nursery must be smaller than the memory pool\n", argv[0]);
+        return 1;
+    }
+    if (large_size >= memory_size - nursery_size) {
+        fprintf(stderr,
+            "%s: nursery and large-object space must be smaller than the memory pool\n",
+            argv[0]);
+        return 1;
+    }
+    init_refs(memory_size, max_size, memory_pool, nursery_size, large_size, collector);
+    /* Incremental cycles start at the occupancy trigger, so they need one. */
+    if (gc_budget > 0 && gc_trigger < 0) {
+        gc_trigger = DEFAULT_INCREMENTAL_TRIGGER;
+    }
+    set_gc_trigger(gc_trigger);
+    set_gc_threads(gc_threads);
+    set_gc_budget(gc_budget);
+    set_cycle_limit(cycle_limit);
 
     eval_init();
 
@@ -224,7 +391,14 @@ int main(int argc, char **argv) {
     } else {
         code = try_parse(input) != REPL_ACTION_CONTINUE;
     }
+    if (gc_budget > 0) {
+        print_gc_pauses(stderr);
+    }
+    if (gc_stats) {
+        print_gc_stats(stderr);
+    }
 
+    close_interned_strings();
     close_refs();
 
     return code;
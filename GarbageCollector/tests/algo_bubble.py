@@ -1,6 +1,6 @@
 # -m 1920
 
-# output 72 bytes in use; 3 refs in use
+# output 712 bytes in use; 23 refs in use
 mem()
 # output [76, 34, 63, 21, 74, 37, 51, 25, 71, 19, 7, 4, 98, 1, 11, 54, 62, 87, 99]
 list = [76, 34, 63, 21, 74, 37, 51, 25, 71, 19, 7, 4, 98, 1, 11, 54, 62, 87, 99]
@@ -22,5 +22,5 @@ del list
 del switch
 del idx
 del temp
-# output 72 bytes in use; 3 refs in use
+# output 712 bytes in use; 23 refs in use
 mem()
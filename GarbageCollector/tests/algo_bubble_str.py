@@ -1,6 +1,6 @@
-# -m 1056
+# -m 1168
 
-# output 72 bytes in use; 3 refs in use
+# output 416 bytes in use; 12 refs in use
 mem()
 list = ["aetn", "nyej", "boeny", "now4y5", "xgfhoi", "iegnb", "jmigfh"]
 # output ["aetn", "nyej", "boeny", "now4y5", "xgfhoi", "iegnb", "jmigfh"]
@@ -22,5 +22,5 @@ del list
 del switch
 del idx
 del temp
-# output 72 bytes in use; 3 refs in use
+# output 416 bytes in use; 12 refs in use
 mem()
@@ -1,6 +1,6 @@
-# -m 1856
+# -m 2944
 
-# output 72 bytes in use; 3 refs in use
+# output 680 bytes in use; 22 refs in use
 mem()
 list = [76, 34, 63, 21, 74, 37, 51, 25, 71, 19, 7, 4, 98, 1, 11, 54, 62, 87, 99]
 # output [76, 34, 63, 21, 74, 37, 51, 25, 71, 19, 7, 4, 98, 1, 11, 54, 62, 87, 99]
@@ -11,9 +11,9 @@ while idx < len(list):
     idx = idx + 1
 # output [76, 110, 173, 194, 268, 305, 356, 381, 452, 471, 478, 482, 580, 581, 592, 646, 708, 795, 894]
 print(list)
-# output 864 bytes in use; 25 refs in use
+# output 1440 bytes in use; 43 refs in use
 mem()
 del list
 del idx
-# output 72 bytes in use; 3 refs in use
+# output 680 bytes in use; 22 refs in use
 mem()
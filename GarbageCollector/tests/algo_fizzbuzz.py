@@ -1,6 +1,6 @@
-# -m 416
+# -m 848
 
-# output 72 bytes in use; 3 refs in use
+# output 360 bytes in use; 11 refs in use
 mem()
 # output FizzBuzz
 # output 1
@@ -114,5 +114,5 @@ while i < 100:
         print(i)
     i = i + 1
 del i
-# output 72 bytes in use; 3 refs in use
+# output 360 bytes in use; 11 refs in use
 mem()
@@ -1,6 +1,6 @@
 # -m 1744
 
-# output 72 bytes in use; 3 refs in use
+# output 424 bytes in use; 12 refs in use
 mem()
 list = ["This", "is", "a", "sentence", "in", "a", "list."]
 joined = list[0]
@@ -13,5 +13,5 @@ print(joined)
 del list
 del joined
 del idx
-# output 72 bytes in use; 3 refs in use
+# output 424 bytes in use; 12 refs in use
 mem()
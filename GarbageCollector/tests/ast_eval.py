@@ -0,0 +1,25 @@
+# -m 4000 -a
+
+# The same program runs the same way whether it is compiled to bytecode
+# (the default) or its syntax tree is evaluated directly with -a.
+d = {"a": [1, 2], "b": 3}
+d["c"] = d["a"][1] * 5 - d["b"]
+del d["b"]
+i = 0
+s = 0
+while i < 10:
+    if i % 3 == 0 and not i == 6:
+        s = s + i
+    elif i > 7 or i == 1:
+        s = s - 1
+    else:
+        s = s + 100
+    i = i + 1
+# output {"a": [1, 2], "c": 7} 510
+print(d, s)
+del d
+del i
+del s
+gc()
+# output 72 bytes in use; 3 refs in use
+mem()
@@ -0,0 +1,18 @@
+# -m 2000 -g 50
+
+# Each iteration leaves a garbage cycle behind. The pool only has room for
+# a handful of them, so this runs out of memory unless the collector is
+# triggered automatically.
+i = 0
+total = 0
+while i < 100:
+    a = [i, None]
+    a[1] = a
+    total = total + a[0] + len([a, a])
+    i = i + 1
+del a
+# output 5150
+print(total)
+gc()
+# output 232 bytes in use; 8 refs in use
+mem()
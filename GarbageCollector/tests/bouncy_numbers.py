@@ -1,7 +1,7 @@
 # Taken from https://projecteuler.net/problem=112.
 # This test takes about 2 minutes, so it isn't run by default.
 
-# -m 656
+# -m 848
 
 bouncy = 0
 test = 100
@@ -21,5 +21,5 @@ while not (bouncy == test * 99):
         bouncy = bouncy + 100
 # output 1587000
 print(test)
-# output 200 bytes in use; 7 refs in use
+# output 360 bytes in use; 12 refs in use
 mem()
@@ -1,7 +1,7 @@
 # Taken from https://projecteuler.net/problem=40.
 # This test takes about 40 seconds.
 
-# -m 1616
+# -m 2000
 
 length = 0
 next = 1
@@ -39,7 +39,7 @@ del rest
 del next_len
 del digit
 del new_length
-# output 296 bytes in use; 10 refs in use
+# output 552 bytes in use; 18 refs in use
 mem()
 # output 210
 print(d1 * d10 * d100 * d1000 * d10000 * d100000 * d1000000)
@@ -50,5 +50,5 @@ del d1000
 del d10000
 del d100000
 del d1000000
-# output 72 bytes in use; 3 refs in use
+# output 328 bytes in use; 11 refs in use
 mem()
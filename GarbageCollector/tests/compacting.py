@@ -1,20 +1,20 @@
-# -m 432
+# -m 784
 
 # Use and free a 40-byte slot
 s = "abcdefgh"
 t = 10
 # output abcdefgh 10
 print(s, t)
-# output 144 bytes in use; 5 refs in use
+# output 312 bytes in use; 9 refs in use
 mem()
 del s
-# output 104 bytes in use; 4 refs in use
+# output 312 bytes in use; 9 refs in use
 mem()
 # Takes up the full 40-byte free slot
 r = 99999
 # output 99999 10
 print(r, t)
-# output 144 bytes in use; 5 refs in use
+# output 312 bytes in use; 9 refs in use
 mem()
 
 # Reset the pool
@@ -27,19 +27,19 @@ s = "abcdefgh"
 t = 10
 # output abcdefgh 10
 print(s, t)
-# output 144 bytes in use; 5 refs in use
+# output 312 bytes in use; 9 refs in use
 mem()
 del s
-# output 104 bytes in use; 4 refs in use
+# output 312 bytes in use; 9 refs in use
 mem()
 gc()
-# output 104 bytes in use; 4 refs in use
+# output 312 bytes in use; 9 refs in use
 mem()
 # Takes up only 32 bytes of the free space
 r = 99999
 # output 99999 10
 print(r, t)
-# output 136 bytes in use; 5 refs in use
+# output 312 bytes in use; 9 refs in use
 mem()
 
 # Reset the pool
@@ -52,11 +52,11 @@ x = 1
 l = [x]
 del x
 del l[0]
-# output 152 bytes in use; 5 refs in use
+# output 392 bytes in use; 11 refs in use
 mem()
 # After collecting garbage, the free space is coalesced at the end of the heap
 gc()
-# output 152 bytes in use; 5 refs in use
+# output 392 bytes in use; 11 refs in use
 mem()
 # output this is a pretty long string
 print("this is a pretty long string")
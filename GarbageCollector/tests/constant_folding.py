@@ -0,0 +1,16 @@
+# -m 1000
+
+# Literal arithmetic, comparisons and tests are computed once by the parser,
+# so this loop allocates nothing but the values of i, x and z.
+i = 0
+while i < 100 and not 2 < 1:
+    x = 3 * 4 + 1 - -2 % 5 * (7 / 2)
+    y = "ab" + "c" == "abc" or 1 / 0
+    z = 0 and 1 / 0
+    i = i + 1
+# output 19 True 0
+print(x, y, z)
+# output -9223372036854775807 -2 False True
+print(9223372036854775807 + 2, -7 / 3, 1 == "1", None == None)
+# output 296 bytes in use; 10 refs in use
+mem()
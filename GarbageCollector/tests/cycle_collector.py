@@ -0,0 +1,28 @@
+# -m 10000 -r 16
+
+# Each node refers to itself, so reference counting alone never frees it.
+# Trial deletion frees the garbage cycles without a full collection, which
+# the pool would need many of otherwise.
+kept = {"name": "kept"}
+kept["self"] = kept
+i = 0
+while i < 500:
+    node = {"name": "node", "next": [i, None]}
+    node["self"] = node
+    node["next"][1] = node
+    node["kept"] = kept
+    i = i + 1
+del node
+stats = gc_stats()
+# output 0 True
+print(stats["collections"], stats["cycle_collections"] > 0)
+del stats
+
+# Values that are still referenced survive, along with what they refer to.
+# output kept kept
+print(kept["name"], kept["self"]["self"]["name"])
+del kept
+del i
+gc()
+# output 472 bytes in use; 13 refs in use
+mem()
@@ -0,0 +1,29 @@
+# -m 20000
+
+# gc_stats() reports what the garbage collector has done so far, and the
+# values in memory by type.
+stats = gc_stats()
+# output 0 0 0 0
+print(stats["collections"], stats["pauses"], stats["bytes_copied"], stats["survival_percent"])
+del stats
+
+cycle = {"name": "cycle"}
+cycle["self"] = cycle
+numbers = [100, 200, 300]
+del cycle
+gc()
+stats = gc_stats()
+# output 1 1 True True
+print(stats["collections"], stats["pauses"], stats["bytes_copied"] > 0, stats["survival_percent"] < 100)
+# output True True
+print(stats["bytes_allocated"] > stats["bytes_copied"], stats["refs"] > stats["free_refs"])
+# output {"NoneType": 1, "bool": 2, "int": 4, "str": 12, "list": 1, "ref_array": 1}
+print(stats["live"])
+# output {"NoneType": 24, "bool": 48, "int": 128, "str": 536, "list": 40, "ref_array": 48}
+print(stats["live_bytes"])
+
+del stats
+del numbers
+gc()
+# output 736 bytes in use; 19 refs in use
+mem()
@@ -0,0 +1,28 @@
+# -m 12000 -n 1024
+
+# Build some long-lived structures, which get promoted out of the nursery.
+old_list = [0, 0, 0, 0]
+old_dict = {"a": 0}
+i = 0
+while i < 50:
+    garbage = [i, None]
+    garbage[1] = garbage
+    i = i + 1
+del garbage
+
+# Store new values into the old structures, which minor collections have to
+# keep although nothing in the nursery refers to them.
+i = 0
+while i < 200:
+    old_list[i % 4] = [i, "s"]
+    old_dict[i % 7] = {"n": i}
+    scratch = [[i], [i + 1], [i + 2]]
+    i = i + 1
+# output [[196, "s"], [197, "s"], [198, "s"], [199, "s"]]
+print(old_list)
+# output {"a": 0, 0: {"n": 196}, 1: {"n": 197}, 2: {"n": 198}, 3: {"n": 199}, 4: {"n": 193}, 5: {"n": 194}, 6: {"n": 195}}
+print(old_dict)
+del scratch
+gc()
+# output 3256 bytes in use; 62 refs in use
+mem()
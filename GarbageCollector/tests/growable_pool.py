@@ -0,0 +1,29 @@
+# -m 4000 -M 400000
+
+# The pool starts out too small for this table, and grows when most of it
+# survives a collection. Once the table is garbage, it shrinks again.
+table = {}
+i = 0
+while i < 300:
+    table[i] = [i, "x"]
+    i = i + 1
+# output 300 [299, "x"]
+print(len(table), table[299])
+stats = gc_stats()
+# output True True
+print(stats["pool_size"] > 2000, stats["pool_size"] <= stats["max_pool_size"])
+grown = stats["pool_size"]
+del stats
+
+del table
+gc()
+gc()
+gc()
+# output True
+print(gc_stats()["pool_size"] < grown)
+
+del grown
+del i
+gc()
+# output 368 bytes in use; 11 refs in use
+mem()
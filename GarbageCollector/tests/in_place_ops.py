@@ -0,0 +1,32 @@
+# -m 8000
+
+# A string that nothing else refers to is appended to in place.
+s = "start"
+i = 0
+while i < 500:
+    s = s + "."
+    i = i + 1
+# output 505
+print(len(s))
+
+# A shared string is left alone, even if it is the interned copy of a literal.
+c = "c"
+t = s
+s = "ab" + c
+# output abc ab 505
+print(s, "ab", len(t))
+del t
+
+# The same goes for shared integers.
+n = 1000000000000
+m = n
+n = n + 1
+# output 1000000000000 1000000000001
+print(m, n)
+n = n * 2
+# output 1000000000000 2000000000002
+print(m, n)
+
+gc()
+# output 496 bytes in use; 15 refs in use
+mem()
@@ -0,0 +1,36 @@
+# -m 20000 -I 64
+
+# The collector runs a little at a time as the program allocates. Values that
+# are moved around while a cycle is being marked must survive it, and garbage
+# cycles must be reclaimed without a full collection.
+kept = [[0], [1], [2], [3]]
+table = {"kept": kept, "name": "table"}
+names = ["zero", "one", "two", "three"]
+
+i = 0
+while i < 400:
+    garbage = {"i": i, "list": [i, names[i % 4]], "more": [[i], [i]]}
+    garbage["self"] = garbage
+    # Move values between a list and a temporary, so that some of them are
+    # only reachable from places that were already marked.
+    moved = [kept[i % 4], [i]]
+    kept[i % 4] = moved[1]
+    kept[(i + 1) % 4] = moved[0]
+    del moved
+    i = i + 1
+del garbage
+
+# output [[0], [397], [398], [399]]
+print(kept)
+# output {"kept": [[0], [397], [398], [399]], "name": "table"}
+print(table)
+# output ["zero", "one", "two", "three"]
+print(names)
+
+del kept
+del table
+del names
+del i
+gc()
+# output 704 bytes in use; 20 refs in use
+mem()
@@ -0,0 +1,40 @@
+# -m 400000 -l 98304
+
+# Values of two pages or more live in the large-object space, where the
+# collector marks them in place instead of copying them. The small values they
+# refer to are still copied, and garbage among them is swept away.
+table = {}
+i = 0
+while i < 1000:
+    table[i] = [i]
+    i = i + 1
+table["self"] = table
+
+text = "0123456789abcdef"
+i = 0
+while i < 10:
+    text = text + text
+    i = i + 1
+holder = [text, table[999]]
+del text
+
+gc()
+# output 1000 [999] 16384
+print(len(table) - 1, table[999], len(holder[0]))
+# output True
+print(holder[1] == table[999])
+gc()
+# output [16384, [5]]
+print([len(holder[0]), table[5]])
+
+# A garbage cycle through a large value is freed by the next collection.
+del table
+gc()
+# output [999]
+print(holder[1])
+
+del holder
+del i
+gc()
+# output 360 bytes in use; 11 refs in use
+mem()
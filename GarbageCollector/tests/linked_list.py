@@ -7,10 +7,10 @@ c = {"value": "three", "prev": b, "next": None}
 b["next"] = c
 d = {"value": [4, 5], "prev": c, "next": None}
 c["next"] = d
-# output 1624 bytes in use; 33 refs in use
+# output 1400 bytes in use; 26 refs in use
 mem()
 gc()
-# output 1624 bytes in use; 33 refs in use
+# output 1400 bytes in use; 26 refs in use
 mem()
 # output 1 True three [4, 5]
 print(a["value"], a["next"]["value"], a["next"]["next"]["value"], a["next"]["next"]["next"]["value"])
@@ -21,10 +21,10 @@ print(d["prev"]["prev"]["prev"]["value"], d["prev"]["prev"]["value"], d["prev"][
 del b
 a["next"] = c
 c["prev"] = a
-# output 1288 bytes in use; 27 refs in use
+# output 1168 bytes in use; 23 refs in use
 mem()
 gc()
-# output 1288 bytes in use; 27 refs in use
+# output 1168 bytes in use; 23 refs in use
 mem()
 # output 1 three [4, 5]
 print(a["value"], a["next"]["value"], a["next"]["next"]["value"])
@@ -34,23 +34,23 @@ print(d["prev"]["prev"]["value"], d["prev"]["value"], d["value"])
 # Remove references to head and tail
 del a
 gc()
-# output 1288 bytes in use; 27 refs in use
+# output 1168 bytes in use; 23 refs in use
 mem()
 # output 1 three [4, 5]
 print(c["prev"]["value"], c["value"], c["next"]["value"])
 del d
 gc()
-# output 1288 bytes in use; 27 refs in use
+# output 1168 bytes in use; 23 refs in use
 mem()
 # output 1 three [4, 5]
 print(c["prev"]["value"], c["value"], c["next"]["value"])
 
 # Remove remaining reference to list
 del c
-# output 1288 bytes in use; 27 refs in use
+# output 1168 bytes in use; 23 refs in use
 mem()
 gc()
-# output 72 bytes in use; 3 refs in use
+# output 392 bytes in use; 12 refs in use
 mem()
 
 
@@ -68,10 +68,10 @@ del a
 del b
 del d
 del e
-# output 1912 bytes in use; 38 refs in use
+# output 1552 bytes in use; 27 refs in use
 mem()
 gc()
-# output 1912 bytes in use; 38 refs in use
+# output 1552 bytes in use; 27 refs in use
 mem()
 # output 1 2 3 4 5
 print(c["prev"]["prev"]["value"], c["prev"]["value"], c["value"], c["next"]["value"], c["next"]["next"]["value"])
@@ -79,14 +79,14 @@ c["prev"]["next"] = None
 c["next"]["prev"] = None
 # output 1 2 3 4 5
 print(c["prev"]["prev"]["value"], c["prev"]["value"], c["value"], c["next"]["value"], c["next"]["next"]["value"])
-# output 1912 bytes in use; 38 refs in use
+# output 1552 bytes in use; 27 refs in use
 mem()
 gc()
-# output 1912 bytes in use; 38 refs in use
+# output 1552 bytes in use; 27 refs in use
 mem()
 del c
-# output 1544 bytes in use; 31 refs in use
+# output 1320 bytes in use; 24 refs in use
 mem()
 gc()
-# output 72 bytes in use; 3 refs in use
+# output 392 bytes in use; 12 refs in use
 mem()
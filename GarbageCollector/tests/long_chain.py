@@ -1,11 +1,11 @@
 # -m 31440
 
-# output 72 bytes in use; 3 refs in use
+# output 200 bytes in use; 7 refs in use
 mem()
 chain = [None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None]
 # output [None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None, None]
 print(chain)
-# output 544 bytes in use; 5 refs in use
+# output 672 bytes in use; 9 refs in use
 mem()
 i = 1
 while i < len(chain):
@@ -17,12 +17,12 @@ while i < len(chain):
 del i
 # output [None, [1, None, 3], [1, 2, [1, None, 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3], [1, [[..., ..., ...], 2, 3], 3], [1, 2, [1, [..., ..., ...], 3]], [[1, 2, [..., ..., ...]], 2, 3]]
 print(chain)
-# output 15592 bytes in use; 401 refs in use
+# output 9384 bytes in use; 207 refs in use
 mem()
 head = chain[-1]
 del chain
-# output 15120 bytes in use; 399 refs in use
+# output 8912 bytes in use; 205 refs in use
 mem()
 del head
-# output 72 bytes in use; 3 refs in use
+# output 200 bytes in use; 7 refs in use
 mem()
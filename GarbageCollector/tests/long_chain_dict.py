@@ -28,7 +28,7 @@ b = {"next": c}
 a = {"next": b}
 # output {"next": {"next": {"next": {...: ...}}}}
 print(a)
-# output 7176 bytes in use; 108 refs in use
+# output 6176 bytes in use; 83 refs in use
 mem()
 del z
 del y
@@ -57,8 +57,8 @@ del c
 del b
 # output {"next": {"next": {"next": {...: ...}}}}
 print(a)
-# output 7176 bytes in use; 108 refs in use
+# output 6176 bytes in use; 83 refs in use
 mem()
 del a
-# output 72 bytes in use; 3 refs in use
+# output 144 bytes in use; 5 refs in use
 mem()
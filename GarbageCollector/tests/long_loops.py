@@ -40,179 +40,179 @@ print(m)
 print(n)
 # output {"next": {"next": {"next": {...: ...}}}}
 print(z)
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del z
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del m
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del y
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del l
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del x
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del k
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del w
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del j
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del v
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del i
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del u
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del h
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del t
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del g
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del s
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del f
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del r
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del e
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del q
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del d
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del p
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del c
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 del o
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 # output {"next": {"next": {"next": {...: ...}}}}
 print(b)
 
 del b
-# output 7144 bytes in use; 107 refs in use
+# output 6192 bytes in use; 83 refs in use
 mem()
 gc()
-# output 3880 bytes in use; 59 refs in use
+# output 3408 bytes in use; 47 refs in use
 mem()
 gc()
-# output 3880 bytes in use; 59 refs in use
+# output 3408 bytes in use; 47 refs in use
 mem()
 # output {"next": {"next": {"next": {...: ...}}}}
 print(n)
 
 del n
-# output 3880 bytes in use; 59 refs in use
+# output 3408 bytes in use; 47 refs in use
 mem()
 gc()
-# output 344 bytes in use; 7 refs in use
+# output 392 bytes in use; 8 refs in use
 mem()
 # output {"next": {"next": {"next": {...: ...}}}}
 print(a)
 
 del a
-# output 344 bytes in use; 7 refs in use
+# output 392 bytes in use; 8 refs in use
 mem()
 gc()
-# output 72 bytes in use; 3 refs in use
+# output 160 bytes in use; 5 refs in use
 mem()
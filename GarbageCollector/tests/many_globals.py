@@ -0,0 +1,140 @@
+# -m 20000
+
+# Reads and writes of globals go straight to their slots, however many
+# globals there are. Deleted globals keep their slot and can be bound again.
+v0 = 0
+v1 = 1
+v2 = 2
+v3 = 3
+v4 = 4
+v5 = 5
+v6 = 6
+v7 = 7
+v8 = 8
+v9 = 9
+v10 = 10
+v11 = 11
+v12 = 12
+v13 = 13
+v14 = 14
+v15 = 15
+v16 = 16
+v17 = 17
+v18 = 18
+v19 = 19
+v20 = 20
+v21 = 21
+v22 = 22
+v23 = 23
+v24 = 24
+v25 = 25
+v26 = 26
+v27 = 27
+v28 = 28
+v29 = 29
+v30 = 30
+v31 = 31
+v32 = 32
+v33 = 33
+v34 = 34
+v35 = 35
+v36 = 36
+v37 = 37
+v38 = 38
+v39 = 39
+v40 = 40
+v41 = 41
+v42 = 42
+v43 = 43
+v44 = 44
+v45 = 45
+v46 = 46
+v47 = 47
+v48 = 48
+v49 = 49
+v50 = 50
+v51 = 51
+v52 = 52
+v53 = 53
+v54 = 54
+v55 = 55
+v56 = 56
+v57 = 57
+v58 = 58
+v59 = 59
+total = 0
+i = 0
+while i < 100:
+    total = total + v0 + v6 + v12 + v18 + v24 + v30 + v36 + v42 + v48 + v54
+    i = i + 1
+# output 27000
+print(total)
+del v0
+del v59
+v59 = "back"
+# output back 1
+print(v59, v1)
+del total
+del i
+del v1
+del v2
+del v3
+del v4
+del v5
+del v6
+del v7
+del v8
+del v9
+del v10
+del v11
+del v12
+del v13
+del v14
+del v15
+del v16
+del v17
+del v18
+del v19
+del v20
+del v21
+del v22
+del v23
+del v24
+del v25
+del v26
+del v27
+del v28
+del v29
+del v30
+del v31
+del v32
+del v33
+del v34
+del v35
+del v36
+del v37
+del v38
+del v39
+del v40
+del v41
+del v42
+del v43
+del v44
+del v45
+del v46
+del v47
+del v48
+del v49
+del v50
+del v51
+del v52
+del v53
+del v54
+del v55
+del v56
+del v57
+del v58
+del v59
+gc()
+# output 2064 bytes in use; 65 refs in use
+mem()
@@ -1,6 +1,6 @@
 # Taken from https://projecteuler.net/problem=71
 
-# -m 656
+# -m 976
 
 max_n = 0
 max_d = 1
@@ -14,11 +14,11 @@ while d <= 1000000:
     d = d + 1
 # output 428570
 print(max_n)
-# output 232 bytes in use; 8 refs in use
+# output 424 bytes in use; 14 refs in use
 mem()
 del max_d
 del d
 del three_d
 del n
-# output 104 bytes in use; 4 refs in use
+# output 296 bytes in use; 10 refs in use
 mem()
@@ -0,0 +1,48 @@
+# -m 12000 -t 4
+
+# Several threads share each copying collection. Values that are reachable
+# from several places, and cycles, must still be copied exactly once.
+shared = [1, 2, 3]
+graph = {"a": [shared, shared], "b": {"c": shared}}
+cycle = [0, "cycle"]
+cycle[0] = cycle
+names = ["zero", "one", "two", "three", "four", "five", "six", "seven"]
+
+# Lists are copied while they are half built, with the operands held by the
+# interpreter as the only references to them.
+held = [[4, 5], gc(), [6]]
+# output [[4, 5], None, [6]]
+print(held)
+
+# Make enough garbage that the pool only lasts if it is reclaimed.
+i = 0
+while i < 300:
+    garbage = {"i": i, "list": [i, names[i % 8]], "more": [[i], [i]]}
+    garbage["self"] = garbage
+    graph["a"][i % 2] = [shared, i]
+    i = i + 1
+del garbage
+gc()
+# output 2352 bytes in use; 56 refs in use
+mem()
+gc()
+# output 2352 bytes in use; 56 refs in use
+mem()
+
+shared[0] = 100
+# output [[[100, 2, 3], 298], [[100, 2, 3], 299]] {"c": [100, 2, 3]}
+print(graph["a"], graph["b"])
+# output [[[[..., ...], "cycle"], "cycle"], "cycle"]
+print(cycle)
+# output ["zero", "one", "two", "three", "four", "five", "six", "seven"]
+print(names)
+
+del shared
+del graph
+del cycle
+del names
+del held
+del i
+gc()
+# output 1032 bytes in use; 29 refs in use
+mem()
@@ -1,6 +1,6 @@
-# -m 592
+# -m 912
 
-# output 72 bytes in use; 3 refs in use
+# output 360 bytes in use; 12 refs in use
 mem()
 # output 1
 print(1)
@@ -12,7 +12,7 @@ print(1 + 2)
 print(3 * 5)
 # output 36
 print(1 + 2 + 3 + 4 + 5 + 6 + 7 + 8)
-# output 72 bytes in use; 3 refs in use
+# output 360 bytes in use; 12 refs in use
 mem()
 a = 4
 b = 5
@@ -23,7 +23,7 @@ f = 4444
 g = f * e
 # output 4 5 6 30 15 4444 66660
 print(a, b, c, d, e, f, g)
-# output 296 bytes in use; 10 refs in use
+# output 456 bytes in use; 15 refs in use
 mem()
 del a
 del b
@@ -32,5 +32,5 @@ del d
 del e
 del f
 del g
-# output 72 bytes in use; 3 refs in use
+# output 360 bytes in use; 12 refs in use
 mem()
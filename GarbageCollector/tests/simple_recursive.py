@@ -15,41 +15,41 @@ g = [[0]]
 f[0][0] = g
 g[0][0] = f
 
-# output 904 bytes in use; 21 refs in use
+# output 896 bytes in use; 21 refs in use
 mem()
 gc()
-# output 904 bytes in use; 21 refs in use
+# output 896 bytes in use; 21 refs in use
 mem()
 del f
 del g
-# output 904 bytes in use; 21 refs in use
+# output 896 bytes in use; 21 refs in use
 mem()
 gc()
-# output 584 bytes in use; 13 refs in use
+# output 576 bytes in use; 13 refs in use
 mem()
 del b
 gc()
-# output 584 bytes in use; 13 refs in use
+# output 576 bytes in use; 13 refs in use
 mem()
 del d
 gc()
-# output 584 bytes in use; 13 refs in use
+# output 576 bytes in use; 13 refs in use
 mem()
 del e
-# output 312 bytes in use; 9 refs in use
+# output 344 bytes in use; 10 refs in use
 mem()
 gc()
-# output 312 bytes in use; 9 refs in use
+# output 344 bytes in use; 10 refs in use
 mem()
 del c
-# output 312 bytes in use; 9 refs in use
+# output 344 bytes in use; 10 refs in use
 mem()
 gc()
-# output 152 bytes in use; 5 refs in use
+# output 184 bytes in use; 6 refs in use
 mem()
 del a
-# output 152 bytes in use; 5 refs in use
+# output 184 bytes in use; 6 refs in use
 mem()
 gc()
-# output 72 bytes in use; 3 refs in use
+# output 104 bytes in use; 4 refs in use
 mem()
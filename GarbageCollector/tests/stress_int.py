@@ -1,4 +1,4 @@
-# -m 464
+# -m 592
 
 a = 0
 b = 1
@@ -10,5 +10,5 @@ while i < 10000:
 
 # output -2872092127636481573 -83367563645688771 10000
 print(a, b, i)
-# output 168 bytes in use; 6 refs in use
+# output 264 bytes in use; 9 refs in use
 mem()
@@ -1,4 +1,4 @@
-# -m 1504
+# -m 1808
 
 a = [0, 1, 2, 3]
 b = {}
@@ -10,5 +10,5 @@ while i < 10000:
 
 # output [9996, 9997, 9998, 9999] {0: 9996, 1: 9997, 2: 9998, 3: 9999} 10000
 print(a, b, i)
-# output 688 bytes in use; 17 refs in use
+# output 872 bytes in use; 23 refs in use
 mem()
@@ -0,0 +1,47 @@
+# -m 6000
+
+# Appending to a long string adds to its list of chunks instead of copying it.
+s = ""
+i = 0
+while i < 100:
+    s = s + "abc"
+    i = i + 1
+# output 300 True
+print(len(s), bool(s))
+
+# Strings made by appending to the same string don't see each other's chunks.
+t = s
+s = s + "x"
+u = t + "y"
+t = t + "z"
+v = t
+t = t + "z"
+# output 301 301 301 302
+print(len(s), len(u), len(v), len(t))
+# output False False True True True
+print(u == s, t == v, t == v + "z", s < u, u < v)
+
+# A string that is still being built can be used like any other.
+w = "---------------------------------------------------------------" + "|"
+w = w + w
+# output ---------------------------------------------------------------|---------------------------------------------------------------|
+print(w)
+d = {s: 1, u: 2}
+d[v] = 3
+l = [s, t]
+# output 1 2 3 True True 302
+print(d[s], d[u], d[v], l[0] == s, l[1] == t, len(l[1]))
+# output 256 True
+print(len(w + w), w + "!" == w + "!")
+
+del s
+del t
+del u
+del v
+del w
+del d
+del l
+del i
+gc()
+# output 576 bytes in use; 15 refs in use
+mem()
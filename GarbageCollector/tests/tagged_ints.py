@@ -0,0 +1,24 @@
+# -m 1200 -i
+
+# Small integers are stored in their references, so summing and indexing them
+# takes no room in the pool. Only the list and its reference array do, while
+# without -i the integers alone would run out of memory.
+a = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9]
+total = 0
+i = 0
+while i < 1000:
+    total = total + a[i % 10] * -3
+    i = i + 1
+# output -13500
+print(total)
+# output True
+print(a[3] == 3 and a[-1] > -536870912)
+# output 536870912
+print(536870911 + 1)
+# output 7
+print(len({1: 2, -1: 3, 536870912: 4, 2: 5, 3: 6, 4: 7, 5: 8}))
+del i
+del total
+gc()
+# output 216 bytes in use; 6 refs in use
+mem()
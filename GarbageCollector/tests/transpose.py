@@ -3,7 +3,7 @@
 matrix = [[1, 2, 3], [4, 5, 6], [7, 8, 9]]
 # output [[1, 2, 3], [4, 5, 6], [7, 8, 9]]
 print(matrix)
-# output 712 bytes in use; 20 refs in use
+# output 744 bytes in use; 21 refs in use
 mem()
 
 transpose = [None, None, None]
@@ -15,7 +15,7 @@ while i < 3:
 del i
 # output [[0, 0, 0], [0, 0, 0], [0, 0, 0]]
 print(transpose)
-# output 1352 bytes in use; 37 refs in use
+# output 1096 bytes in use; 29 refs in use
 mem()
 
 i = 0
@@ -28,14 +28,14 @@ while i < len(matrix):
     i = i + 1
 # output [[1, 4, 7], [2, 5, 8], [3, 6, 9]]
 print(transpose)
-# output 1128 bytes in use; 30 refs in use
+# output 1160 bytes in use; 31 refs in use
 mem()
 
 del matrix
 del row
 del i
 del j
-# output 712 bytes in use; 20 refs in use
+# output 744 bytes in use; 21 refs in use
 mem()
 # output [[1, 4, 7], [2, 5, 8], [3, 6, 9]]
 print(transpose)
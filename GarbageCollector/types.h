@@ -9,6 +9,8 @@
  * An opaque reference that can be used to indirectly refer to a value_t.
  * The reference itself is not a pointer; rather, it is an index into a table of
  * references maintained by alloc.c. Use deref() to get the value_t pointer.
+ * When built with DIRECT_REFS, it is instead the offset of the value from the
+ * start of the memory pool, and it changes whenever the value moves.
  */
 typedef int32_t reference_t;
 
@@ -21,11 +23,21 @@ typedef int32_t reference_t;
 #define NULL_REF ((reference_t) (-1))
 
 /*!
- * An invalid reference that is used to mark dict key slots that were deleted.
- * Linear probing will continue past a TOMBSTONE_REF,
- * so we don't need to rearrange dict elements during deletion.
+ * The control bytes that describe the state of each slot in a dict's index.
+ * A full slot stores a 7-bit fragment of its key's hash instead,
+ * so a set high bit means the slot is free. Probing continues past
+ * CTRL_DELETED slots, so we don't need to rearrange the index
+ * during deletion.
  */
-#define TOMBSTONE_REF ((reference_t) (-2))
+#define CTRL_EMPTY ((uint8_t) 0x80)
+#define CTRL_DELETED ((uint8_t) 0xFE)
+
+/*!
+ * The number of control bytes that are examined at once while probing a dict.
+ * The control bytes are repeated for DICT_GROUP_WIDTH bytes after the last
+ * slot, so a group can start at any slot without wrapping around.
+ */
+#define DICT_GROUP_WIDTH 16
 
 
 /*!
@@ -42,8 +54,12 @@ typedef enum {
     NUM_TYPES,          /*!< The number of different value types. */
 
     VAL_REF_ARRAY,      /*!< A value used internally to store an array of references. */
+    VAL_DICT_INDEX,     /*!< A value used internally to store a dict's hash index. */
+    VAL_DICT_ENTRIES,   /*!< A value used internally to store a dict's entries. */
+    VAL_STRING_BUILDER, /*!< A string that has not been flattened yet. */
 
-    VAL_FREE            /*!< Used to indicate that a slot in the memory pool is free. */
+    VAL_FREE,           /*!< Used to indicate that a slot in the memory pool is free. */
+    VAL_FORWARD         /*!< A value that a collection moved; see refs_direct.c. */
 } value_type_t;
 
 /*!
@@ -52,12 +68,14 @@ typedef enum {
  *
  *  - None and bool types do not contain any data and therefore just use value_t
  *  - Integers are 64-bit and use integer_value_t
- *  - Strings use string_value_t and are '\0'-terminated
+ *  - Strings use string_value_t and are '\0'-terminated. Strings made by
+ *    concatenation may be string_builder_value_t instead, until they are used
  *  - Lists (list_value_t) are represented as fixed-length arrays of references,
  *    stored in a ref_array_value_t that is allocated from the memory pool
- *  - Dictionaries (dict_value_t) use a linear probing hash table.
- *    Both keys and values are stored as arrays of references,
- *    using ref_array_value_t structs allocated from the memory pool.
+ *  - Dictionaries (dict_value_t) store their keys, values and hashes in
+ *    insertion order in a dict_entries_value_t, and use an open addressing
+ *    hash table of entry numbers, the dict_index_value_t, to find them.
+ *    Both are allocated from the memory pool.
  */
 typedef struct {
     /*! This specifies what kind of value is actually represented. */
@@ -100,6 +118,9 @@ typedef struct {
 typedef struct {
     value_t base;
 
+    /*! The hash of string_value, computed once when the string is made. */
+    uint64_t hash;
+
     /*!
      * The string value this string_value_t represents.
      * The characters are stored immediately following the value_t struct.
@@ -109,6 +130,36 @@ typedef struct {
 } string_value_t;
 
 
+/*!
+ * A "string builder" value that represents a string made by concatenation as
+ * the list of strings it is made of, so that appending to it doesn't copy it.
+ * A builder is flattened into a string_value_t, keeping its reference, when
+ * its characters are needed. It is also flattened before it is stored in a
+ * list or dict, so only globals and the evaluator's temporaries refer to it.
+ * If the type of a value_t* is VAL_STRING_BUILDER,
+ * it can be cast to a string_builder_value_t*.
+ */
+typedef struct {
+    value_t base;
+
+    /*! The length of the string, which is the total length of its chunks. */
+    size_t length;
+
+    /*!
+     * The number of chunks the string is made of. The chunks array may hold
+     * more, if a longer string that shares the array was made by appending
+     * to this one.
+     */
+    size_t num_chunks;
+
+    /*!
+     * The reference to the ref_array_value_t of chunks, which are flat
+     * strings. The unused slots at its end are NULL_REF.
+     */
+    reference_t chunks;
+} string_builder_value_t;
+
+
 /*!
  * A "list value" type that represents list elements.
  * If the type of a value_t* is VAL_LIST, it can be cast to a list_value_t*.
@@ -142,29 +193,28 @@ typedef struct {
     int64_t size;
 
     /*!
-     * The number of key slots currently occupied in the dict.
-     * This can be greater than size if there are tombstones.
+     * The number of entries currently used in the dict. New elements are
+     * appended at this position. This can be greater than size if elements
+     * were deleted, since their entries are only reused by dict_upsize().
      */
-    int64_t occupied;
+    int64_t used;
 
     /*!
-     * The reference to the ref_array_value_t containing the dictionary's keys.
+     * The reference to the dict_index_value_t used to find entries by key.
      * Used to implement O(1) lookup.
-     * Deleting keys from dictionaries sets their slots to TOMBSTONE_REF,
-     * so TOMBSTONE_REF should be treated as NULL_REF in the reference graph.
      */
-    reference_t keys;
+    reference_t index;
 
     /*!
-     * The reference to the ref_array_value_t containing the dictionary's values.
+     * The reference to the dict_entries_value_t holding the dictionary's
+     * elements in insertion order.
      */
-    reference_t values;
+    reference_t entries;
 } dict_value_t;
 
 /*!
  * A "ref array" value that is used within the evaluator to hold lists of
- * reference. This is used by list_value_t to store the elements of the list
- * and by dict_value_t to store the both the lists of key and values.
+ * reference. This is used by list_value_t to store the elements of the list.
  * If the type of a value_t* is VAL_REF_ARRAY,
  * it can be cast to a ref_array_value_t*.
  */
@@ -182,4 +232,63 @@ typedef struct {
     reference_t values[];
 } ref_array_value_t;
 
+/*!
+ * An "index" value that is used by dict_value_t to find the entry of a key.
+ * It is an open addressing hash table of capacity slots, where capacity is a
+ * power of two. The capacity + DICT_GROUP_WIDTH control bytes of the slots
+ * come first, followed by the entry number of each full slot. Entry numbers
+ * are stored in width bytes, which is just enough for the entries array.
+ * If the type of a value_t* is VAL_DICT_INDEX,
+ * it can be cast to a dict_index_value_t*.
+ */
+typedef struct {
+    value_t base;
+
+    /*!
+     * This is the number of slots in this index.
+     */
+    size_t capacity;
+
+    /*!
+     * This is the number of bytes used for each entry number: 1, 2 or 4.
+     */
+    size_t width;
+
+    /*!
+     * The control bytes, stored immediately following the value_t struct.
+     */
+    uint8_t ctrl[];
+} dict_index_value_t;
+
+/*!
+ * A single element of a dict. The hash of the key is stored so that the
+ * index can be rebuilt without hashing the keys again.
+ * The key of a deleted element is NULL_REF.
+ */
+typedef struct {
+    uint64_t hash;
+    reference_t key;
+    reference_t value;
+} dict_entry_t;
+
+/*!
+ * An "entries" value that is used by dict_value_t to store its elements
+ * densely, in the order they were inserted.
+ * If the type of a value_t* is VAL_DICT_ENTRIES,
+ * it can be cast to a dict_entries_value_t*.
+ */
+typedef struct {
+    value_t base;
+
+    /*!
+     * This is the number of entries that can be stored in this array.
+     */
+    size_t capacity;
+
+    /*!
+     * The entries, stored immediately following the value_t struct.
+     */
+    dict_entry_t entries[];
+} dict_entries_value_t;
+
 #endif /* TYPES_H */
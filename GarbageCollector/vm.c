@@ -0,0 +1,389 @@
+/*! \file
+ * Runs the bytecode produced by compile.c.
+ *
+ * The interpreter keeps its temporaries on a stack of references, each of
+ * which owns a reference count. That is all the garbage collector needs to
+ * treat them as roots, so values may move under the interpreter whenever it
+ * allocates, exactly as they may under eval.c. With DIRECT_REFS, moving a
+ * value changes its reference, so the collector also has to fix up the stack:
+ * the instructions that may allocate leave their operands on it until they
+ * are done with them, and record its top with SAVE_SP() first.
+ *
+ * With GCC and Clang, each instruction jumps straight to the next one through
+ * a table of label addresses ("threaded dispatch"), which gives the branch
+ * predictor one indirect jump per instruction to learn from instead of a
+ * single shared one. Other compilers fall back to a switch in a loop.
+ */
+
+#include "bytecode.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "eval_dict.h"
+#include "eval_refs.h"
+#include "eval_types.h"
+#include "refs.h"
+
+#if defined(__GNUC__)
+#define THREADED_DISPATCH
+#endif
+
+#ifdef DIRECT_REFS
+/* The stack of the running program, and its top as of the last SAVE_SP(). */
+static reference_t *vm_stack;
+static reference_t *vm_top;
+
+/*! Calls f on the address of each reference on the interpreter's stack. */
+void foreach_vm_root(void (*f)(reference_t *ref)) {
+    for (reference_t *ref = vm_stack; ref < vm_top; ref++) {
+        f(ref);
+    }
+}
+#endif
+
+/*! Makes a new reference to the value of a LOAD_CONST constant. */
+static reference_t load_constant(constant_t *constant) {
+    reference_t ref = constant->value.ref;
+    if (ref == NULL_REF) {
+        exception_set_format(EXC_INTERNAL, "literal node type '%d' not implemented",
+                constant->value.literal->type);
+        return NULL_REF;
+    }
+    incref(ref);
+    return ref;
+}
+
+/*! Makes a list of the given length, whose elements are stored later. */
+static reference_t new_list(size_t length) {
+    reference_t ref_array = make_reference_refarray(length);
+    if (exception_occurred()) {
+        return NULL_REF;
+    }
+
+    ROOT(ref_array);
+    reference_t ref_list = make_reference_list();
+    UNROOT(1);
+    if (exception_occurred()) {
+        decref(ref_array);
+        return NULL_REF;
+    }
+
+    list_value_t *list = (list_value_t *) deref(ref_list);
+    list->values = ref_array;
+    list->size = length;
+    return ref_list;
+}
+
+reference_t vm_run(code_t *code) {
+    const int32_t *words = code->words;
+    constant_t *constants = code->constants;
+
+    reference_t *stack = malloc(sizeof(reference_t[code->max_depth + 1]));
+    if (stack == NULL) {
+        exception_set(EXC_INTERNAL, "allocation of interpreter stack failed");
+        return NULL_REF;
+    }
+
+    /* The stack grows up from stack[0]; sp points one past its top. */
+    reference_t *sp = stack;
+    size_t pc = 0;
+    reference_t result = NULL_REF;
+    reference_t left, right, value;
+    size_t n;
+#ifdef DIRECT_REFS
+    vm_stack = stack;
+    vm_top = stack;
+#define SAVE_SP() (vm_top = sp)
+#else
+#define SAVE_SP() ((void) 0)
+#endif
+
+#define PUSH(ref) (*sp++ = (ref))
+#define POP() (*--sp)
+#define TOP() (sp[-1])
+#define ARG() (words[pc++])
+
+/* Pushes a result unless it is NULL_REF, then checks for an exception. */
+#define PUSH_CHECKED(ref) do { \
+        value = (ref); \
+        if (value != NULL_REF) { \
+            PUSH(value); \
+        } \
+        if (exception_occurred()) { \
+            goto error; \
+        } \
+    } while (0)
+
+#ifdef THREADED_DISPATCH
+    static void *const labels[] = {
+#define OPCODE(name) [OP_##name] = &&do_##name,
+        OPCODES
+#undef OPCODE
+    };
+#define TARGET(name) do_##name:
+#define DISPATCH() goto *labels[words[pc++]]
+    DISPATCH();
+#else
+#define TARGET(name) case OP_##name:
+#define DISPATCH() continue
+    for (;;) switch ((opcode_t) words[pc++]) {
+#endif
+
+    TARGET(LOAD_CONST) {
+        PUSH_CHECKED(load_constant(&constants[ARG()]));
+        DISPATCH();
+    }
+
+    TARGET(LOAD_GLOBAL) {
+        PUSH_CHECKED(globals_get(ARG()));
+        DISPATCH();
+    }
+
+    TARGET(STORE_GLOBAL) {
+        value = POP();
+        globals_set(ARG(), value);
+        decref(value);
+        DISPATCH();
+    }
+
+    TARGET(DELETE_GLOBAL) {
+        globals_delete(ARG());
+        if (exception_occurred()) {
+            goto error;
+        }
+        DISPATCH();
+    }
+
+    TARGET(POP) {
+        decref(POP());
+        DISPATCH();
+    }
+
+    TARGET(NOT) {
+        value = POP();
+        bool cond = ref_bool(value);
+        decref(value);
+        PUSH_CHECKED(bool_ref(!cond));
+        DISPATCH();
+    }
+
+    TARGET(UNARY) {
+        /* Unary builtins get the operand as both operands, as in eval.c. */
+        SAVE_SP();
+        left = ref_builtin(ARG(), TOP(), TOP());
+        decref(POP());
+        PUSH_CHECKED(left);
+        DISPATCH();
+    }
+
+    TARGET(BINARY) {
+        n = ARG();
+
+        /* In "x = x + y", the reference held by x would stop the operation
+         * from reusing x's value for the result, and the store is about to
+         * drop it anyway, so drop it first. Put it back if the operation fails. */
+        SAVE_SP();
+        bool released = words[pc] == OP_STORE_GLOBAL &&
+            globals_release(words[pc + 1], sp[-2]);
+        value = ref_builtin(n, sp[-2], sp[-1]);
+        if (released && exception_occurred()) {
+            globals_set(words[pc + 1], sp[-2]);
+        }
+        right = POP();
+        left = POP();
+        decref(left);
+        decref(right);
+        PUSH_CHECKED(value);
+        DISPATCH();
+    }
+
+    TARGET(COMPARE) {
+        right = POP();
+        left = POP();
+        value = ref_compare(ARG(), left, right);
+        decref(left);
+        decref(right);
+        PUSH_CHECKED(value);
+        DISPATCH();
+    }
+
+    TARGET(EQUALS) {
+        right = POP();
+        left = POP();
+        bool equal = ref_eq(left, right);
+        decref(left);
+        decref(right);
+        PUSH_CHECKED(bool_ref(equal));
+        DISPATCH();
+    }
+
+    TARGET(JUMP) {
+        pc = words[pc];
+        DISPATCH();
+    }
+
+    TARGET(POP_JUMP_IF_FALSE) {
+        value = POP();
+        bool cond = ref_bool(value);
+        decref(value);
+        if (exception_occurred()) {
+            goto error;
+        }
+        pc = cond ? pc + 1 : (size_t) words[pc];
+        DISPATCH();
+    }
+
+    TARGET(JUMP_IF_FALSE_OR_POP) {
+        if (!ref_bool(TOP())) {
+            pc = words[pc];
+        } else {
+            decref(POP());
+            pc++;
+        }
+        DISPATCH();
+    }
+
+    TARGET(JUMP_IF_TRUE_OR_POP) {
+        if (ref_bool(TOP())) {
+            pc = words[pc];
+        } else {
+            decref(POP());
+            pc++;
+        }
+        DISPATCH();
+    }
+
+    TARGET(SUBSCR_GET) {
+        right = POP();
+        left = POP();
+        value = ref_subscr_get(left, right);
+        decref(left);
+        decref(right);
+        PUSH_CHECKED(value);
+        DISPATCH();
+    }
+
+    TARGET(SUBSCR_SET) {
+        SAVE_SP();
+        ref_subscr_set(sp[-2], sp[-1], sp[-3]);
+        right = POP();
+        left = POP();
+        value = POP();
+        decref(left);
+        decref(right);
+        decref(value);
+        if (exception_occurred()) {
+            goto error;
+        }
+        DISPATCH();
+    }
+
+    TARGET(SUBSCR_DEL) {
+        right = POP();
+        left = POP();
+        ref_subscr_del(left, right);
+        decref(left);
+        decref(right);
+        if (exception_occurred()) {
+            goto error;
+        }
+        DISPATCH();
+    }
+
+    TARGET(NEW_LIST) {
+        SAVE_SP();
+        PUSH_CHECKED(new_list(ARG()));
+        DISPATCH();
+    }
+
+    TARGET(LIST_STORE) {
+        /* Evaluating the element may have moved the array, and so may
+         * flattening it, since lists don't hold string builders. So look the
+         * array up now. The element is stored even if flattening fails, so
+         * that it is released along with the list. */
+        value = POP();
+        string_flatten(value);
+        reference_t ref_array = ((list_value_t *) deref(TOP()))->values;
+        ((ref_array_value_t *) deref(ref_array))->values[ARG()] = value;
+        if (exception_occurred()) {
+            goto error;
+        }
+        DISPATCH();
+    }
+
+    TARGET(NEW_DICT) {
+        SAVE_SP();
+        PUSH_CHECKED(dict_new(ARG()));
+        DISPATCH();
+    }
+
+    TARGET(DICT_STORE) {
+        SAVE_SP();
+        dict_subscr_set(sp[-3], sp[-2], sp[-1]);
+        value = POP();
+        right = POP();
+        decref(right);
+        decref(value);
+        if (exception_occurred()) {
+            goto error;
+        }
+        DISPATCH();
+    }
+
+    TARGET(CALL) {
+        builtin_function_t function = constants[ARG()].function;
+        n = ARG();
+        SAVE_SP();
+        value = function(n, sp - n);
+        for (size_t i = 0; i < n; i++) {
+            decref(POP());
+        }
+        PUSH_CHECKED(value);
+        DISPATCH();
+    }
+
+    TARGET(RAISE) {
+        constant_t *constant = &constants[ARG()];
+        exception_set_format(constant->error.type, constant->error.format,
+                constant->error.arg);
+        goto error;
+    }
+
+    TARGET(RETURN) {
+        result = POP();
+        goto done;
+    }
+
+    TARGET(RETURN_NONE) {
+        goto done;
+    }
+
+#ifndef THREADED_DISPATCH
+    }
+#endif
+
+error:
+    /* Release the temporaries of the instructions that were interrupted. */
+    while (sp > stack) {
+        decref(POP());
+    }
+
+done:
+    assert(sp == stack);
+#ifdef DIRECT_REFS
+    vm_stack = NULL;
+    vm_top = NULL;
+#endif
+    free(stack);
+    return result;
+
+#undef PUSH
+#undef POP
+#undef TOP
+#undef ARG
+#undef PUSH_CHECKED
+#undef SAVE_SP
+#undef TARGET
+#undef DISPATCH
+}
@@ -0,0 +1,207 @@
+/*
+ * fbench.c - Estimate the time (in seconds) used by a function f
+ *
+ * Runs f a few times untimed to warm up caches and the branch predictors,
+ * then times repeated runs with CLOCK_MONOTONIC_RAW, which is not slewed by
+ * NTP and does not depend on the CPU frequency the way raw cycle counts do.
+ * Samples further than OUTLIER_CUTOFF robust standard deviations from the
+ * median (median absolute deviation scaled to a normal distribution) are
+ * discarded, and the mean of the remainder is reported together with a 95%
+ * confidence interval from Student's t distribution.
+ */
+#define _GNU_SOURCE
+#include <sched.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fbench.h"
+
+/* Modified z-score above which a sample is considered an outlier */
+#define OUTLIER_CUTOFF 3.5
+
+/* Scales the median absolute deviation to a standard deviation */
+#define MAD_SCALE 1.4826
+
+static int warmup = 2;
+static int min_runs = 10;
+static int max_runs = 100;
+static double epsilon = 0.01;
+
+/* Two-sided 95% quantiles of Student's t for 1..30 degrees of freedom */
+static const double t_95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/*
+ * t_quantile - Two-sided 95% quantile of Student's t with df degrees of
+ *     freedom, falling back to the normal quantile for large df
+ */
+static double t_quantile(int df)
+{
+    if (df < 1)
+        return 0;
+    if (df <= (int)(sizeof(t_95) / sizeof(t_95[0])))
+        return t_95[df - 1];
+    return 1.960;
+}
+
+/*
+ * now - Seconds on the raw monotonic clock
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * median - Median of n sorted values
+ */
+static double median(const double *sorted, int n)
+{
+    if (n % 2)
+        return sorted[n / 2];
+    return (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/*
+ * summarize - Reject outliers from the n samples and compute the
+ *     statistics of the rest. scratch must hold n doubles.
+ */
+static void summarize(const double *samples, int n, double *scratch,
+                      fbench_result_t *result)
+{
+    double med, mad, sum = 0, sumsq = 0;
+    int i, kept = 0;
+
+    memcpy(scratch, samples, n * sizeof(double));
+    qsort(scratch, n, sizeof(double), compare_doubles);
+    med = median(scratch, n);
+
+    for (i = 0; i < n; i++)
+        scratch[i] = fabs(samples[i] - med);
+    qsort(scratch, n, sizeof(double), compare_doubles);
+    mad = median(scratch, n) * MAD_SCALE;
+
+    for (i = 0; i < n; i++) {
+        /* With a zero MAD, only samples equal to the median are kept */
+        if (fabs(samples[i] - med) > OUTLIER_CUTOFF * mad)
+            continue;
+        sum += samples[i];
+        if (kept == 0 || samples[i] < result->min)
+            result->min = samples[i];
+        kept++;
+    }
+    result->mean = sum / kept;
+    for (i = 0; i < n; i++) {
+        if (fabs(samples[i] - med) > OUTLIER_CUTOFF * mad)
+            continue;
+        sumsq += (samples[i] - result->mean) * (samples[i] - result->mean);
+    }
+    result->stddev = kept > 1 ? sqrt(sumsq / (kept - 1)) : 0;
+    result->ci = t_quantile(kept - 1) * result->stddev / sqrt(kept);
+    result->samples = kept;
+    result->rejected = n - kept;
+}
+
+/*
+ * fbench - Time repeated runs of f until the mean is known to within
+ *     epsilon or max_runs samples were taken
+ */
+double fbench(fbench_test_funct f, void *argp, fbench_result_t *result)
+{
+    fbench_result_t local;
+    double *samples, *scratch;
+    int i, n;
+
+    if (result == NULL)
+        result = &local;
+    samples = malloc(max_runs * sizeof(double));
+    scratch = malloc(max_runs * sizeof(double));
+    if (!samples || !scratch) {
+        fprintf(stderr, "Fatal error.  Malloc returned null in fbench\n");
+        exit(1);
+    }
+
+    for (i = 0; i < warmup; i++)
+        f(argp);
+
+    for (n = 0; n < max_runs; ) {
+        double start = now();
+        f(argp);
+        samples[n++] = now() - start;
+        if (n >= min_runs) {
+            summarize(samples, n, scratch, result);
+            if (result->ci <= epsilon * result->mean)
+                break;
+        }
+    }
+
+#ifdef DEBUG
+    printf(" %d samples, %d rejected: mean %.3g s, +/- %.3g s\n",
+           result->samples, result->rejected, result->mean, result->ci);
+#endif
+    free(samples);
+    free(scratch);
+    return result->mean;
+}
+
+/*
+ * fbench_pin_cpu - Keep the calling thread on one CPU so that migrations
+ *     and per-core frequency differences do not add noise
+ */
+int fbench_pin_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+
+/*************************************************************
+ * Set the various parameters used by the measurement routines
+ ************************************************************/
+
+/*
+ * set_fbench_warmup - Number of untimed runs before sampling starts
+ *     Default = 2
+ */
+void set_fbench_warmup(int runs)
+{
+    warmup = runs;
+}
+
+/*
+ * set_fbench_runs - Minimum and maximum number of timed runs
+ *     Default = 10, 100
+ */
+void set_fbench_runs(int min, int max)
+{
+    min_runs = min < 1 ? 1 : min;
+    max_runs = max < min_runs ? min_runs : max;
+}
+
+/*
+ * set_fbench_epsilon - Target half-width of the confidence interval,
+ *     relative to the mean
+ *     Default = 0.01
+ */
+void set_fbench_epsilon(double epsilon_arg)
+{
+    epsilon = epsilon_arg;
+}
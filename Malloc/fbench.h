@@ -0,0 +1,50 @@
+/*
+ * fbench.h - prototypes for the routines in fbench.c that estimate the
+ *     running time (in seconds) of a test function f from repeated,
+ *     outlier-filtered measurements with a confidence interval
+ */
+
+/* The test function takes a generic pointer as input */
+typedef void (*fbench_test_funct)(void *);
+
+/* Summary of the samples kept for one measurement */
+typedef struct {
+    double mean;     /* mean running time in seconds */
+    double stddev;   /* sample standard deviation in seconds */
+    double ci;       /* half-width of the 95% confidence interval of the mean */
+    double min;      /* fastest kept sample */
+    int samples;     /* number of samples kept */
+    int rejected;    /* number of samples rejected as outliers */
+} fbench_result_t;
+
+/* Estimate the running time of f(argp), filling in *result if non-NULL.
+   Returns the mean running time in seconds. */
+double fbench(fbench_test_funct f, void *argp, fbench_result_t *result);
+
+/* Pin the calling thread to one CPU. Returns 0 on success, -1 on failure. */
+int fbench_pin_cpu(int cpu);
+
+/*********************************************************
+ * Set the various parameters used by measurement routines
+ *********************************************************/
+
+/*
+ * set_fbench_warmup - Number of untimed runs before sampling starts
+ *     Default = 2
+ */
+void set_fbench_warmup(int runs);
+
+/*
+ * set_fbench_runs - Minimum and maximum number of timed runs.
+ *     Sampling stops once at least min runs were taken and the confidence
+ *     interval is within epsilon of the mean, or max runs were taken.
+ *     Default = 10, 100
+ */
+void set_fbench_runs(int min, int max);
+
+/*
+ * set_fbench_epsilon - Target half-width of the confidence interval,
+ *     relative to the mean
+ *     Default = 0.01
+ */
+void set_fbench_epsilon(double epsilon_arg);
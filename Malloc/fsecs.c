@@ -6,9 +6,13 @@
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "fbench.h"
 #include "config.h"
 
+#if USE_FCYC
 static double Mhz;  /* estimated CPU clock frequency */
+#endif
+static double last_error; /* confidence half-width of the last fsecs call */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -17,7 +21,15 @@ extern int verbose; /* -v option in mdriver.c */
  */
 void init_fsecs(void)
 {
-#if USE_FCYC
+#if USE_FBENCH
+    if (verbose)
+	printf("Measuring performance with the monotonic clock.\n");
+
+    /* set key parameters for the fbench package */
+    set_fbench_warmup(2);
+    set_fbench_runs(10, 100);
+    set_fbench_epsilon(0.01);
+#elif USE_FCYC
     if (verbose)
 	printf("Measuring performance with a cycle counter.\n");
 
@@ -44,7 +56,13 @@ void init_fsecs(void)
  */
 double fsecs(fsecs_test_funct f, void *argp)
 {
-#if USE_FCYC
+    last_error = 0;
+#if USE_FBENCH
+    fbench_result_t result;
+    double secs = fbench(f, argp, &result);
+    last_error = result.ci;
+    return secs;
+#elif USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
 #elif USE_ITIMER
@@ -54,4 +72,14 @@ double fsecs(fsecs_test_funct f, void *argp)
 #endif
 }
 
+/*
+ * fsecs_error - Return the half-width (in seconds) of the 95% confidence
+ *     interval of the last fsecs measurement, or 0 if the timing method
+ *     does not estimate one
+ */
+double fsecs_error(void)
+{
+    return last_error;
+}
+
 
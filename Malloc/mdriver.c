@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <math.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -26,6 +27,7 @@
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "fbench.h"
 #include "config.h"
 
 /**********************
@@ -61,9 +63,11 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-	enum { ALLOC, FREE, REALLOC } type; /* type of request */
+	enum { ALLOC, FREE, REALLOC, FREE_SIZED, GROW,
+		ALLOC_BATCH, FREE_BATCH } type; /* type of request */
 	int index;                        /* index for free() to use later */
 	size_t size;                      /* byte size of alloc/realloc request */
+	int count;                        /* number of ids from index on (batches) */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -77,6 +81,7 @@ typedef struct {
 	char **blocks;       /* array of ptrs returned by malloc/realloc... */
 	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 	int *block_rand_base;/* index into random_data, if debug is on */
+	void **batch;        /* scratch array for the largest batch request */
 } trace_t;
 
 /*
@@ -99,6 +104,7 @@ typedef struct {
 	/* run-time stats defined for both libc and student */
 	int valid;       /* was the trace processed correctly by the allocator? */
 	double secs;     /* number of secs needed to run the trace */
+	double err;      /* 95% confidence half-width of secs (0 if unknown) */
 
 	/* defined only for the student malloc package */
 	double util;     /* space utilization for this trace (always 0 for libc) */
@@ -209,6 +215,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
 			if (verbose > 1)
 				printf("and performance.\n");
 			mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+			mm_stats[i].err = fsecs_error();
 		}
 		free_trace(trace);
 	}
@@ -230,6 +237,7 @@ int main(int argc, char **argv)
 	speed_t speed_params;      /* input parameters to the xx_speed routines */
 
 	int run_libc = 0;     /* If set, run libc malloc (set by -l) */
+	int pin_cpu = -1;     /* If set, CPU to run on (set by -p) */
 
 	/* temporaries used to compute the performance index */
 	double secs, ops, util, avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
@@ -243,7 +251,7 @@ int main(int argc, char **argv)
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "d:f:c:t:hlD")) != EOF) {
+	while ((c = getopt(argc, argv, "d:f:c:t:p:hlD")) != EOF) {
 		switch (c) {
 
 			case 'f': /* Use one specific trace file only (relative to curr dir) */
@@ -277,6 +285,10 @@ int main(int argc, char **argv)
 				run_libc = 1;
 				break;
 
+			case 'p': /* Pin the driver to one CPU */
+				pin_cpu = atoi(optarg);
+				break;
+
 			case 'd':
 				debug_mode = atoi(optarg);
 				break;
@@ -306,6 +318,8 @@ int main(int argc, char **argv)
 	}
 
 	/* Initialize the timing package */
+	if (pin_cpu >= 0 && fbench_pin_cpu(pin_cpu) < 0)
+		unix_error("ERROR: could not pin to CPU %d", pin_cpu);
 	init_fsecs();
 
 	/*
@@ -332,6 +346,7 @@ int main(int argc, char **argv)
 				if (verbose > 1)
 					printf("and performance.\n");
 				libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+				libc_stats[i].err = fsecs_error();
 			}
 			free_trace(trace);
 		}
@@ -623,8 +638,9 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 	FILE *tracefile;
 	trace_t *trace;
 	char type[MAXLINE];
-	int index, size;
+	int index, size, count;
 	int max_index = 0;
+	int max_count = 0;
 	int op_index;
 
 	if (verbose > 1)
@@ -697,6 +713,44 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 				trace->ops[op_index].type = FREE;
 				trace->ops[op_index].index = index;
 				break;
+			case 'F':
+				assert(fscanf(tracefile, "%ud", &index) != EOF);
+				if (index < 0) {
+					app_error("%s: sized free of the null block", trace->filename);
+				}
+				trace->ops[op_index].type = FREE_SIZED;
+				trace->ops[op_index].index = index;
+				break;
+			case 'g':
+				assert(fscanf(tracefile, "%u %u", &index, &size) != EOF);
+				trace->ops[op_index].type = GROW;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].size = size;
+				max_index = (index > max_index) ? index : max_index;
+				break;
+			case 'b':
+				assert(fscanf(tracefile, "%u %u %u", &index, &count, &size) != EOF);
+				if (count <= 0) {
+					app_error("%s: empty batch", trace->filename);
+				}
+				trace->ops[op_index].type = ALLOC_BATCH;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].count = count;
+				trace->ops[op_index].size = size;
+				index += count - 1;
+				max_index = (index > max_index) ? index : max_index;
+				max_count = (count > max_count) ? count : max_count;
+				break;
+			case 'B':
+				assert(fscanf(tracefile, "%u %u", &index, &count) != EOF);
+				if (index < 0 || count <= 0) {
+					app_error("%s: bad batch free", trace->filename);
+				}
+				trace->ops[op_index].type = FREE_BATCH;
+				trace->ops[op_index].index = index;
+				trace->ops[op_index].count = count;
+				max_count = (count > max_count) ? count : max_count;
+				break;
 			default:
 				app_error("Bogus type character (%c) in tracefile %s\n",
 						type[0], trace->filename);
@@ -708,6 +762,10 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 	assert(max_index == trace->num_ids - 1);
 	assert(trace->num_ops == op_index);
 
+	/* mm_free_batch reorders its argument, so batches are copied here */
+	if ((trace->batch = calloc(max_count, sizeof(void *))) == NULL)
+		unix_error("malloc 6 failed in read_trace");
+
 	/* fill in the stats */
 	strcpy(stats->filename, trace->filename);
 	stats->weight = trace->weight;
@@ -727,15 +785,16 @@ static void reinit_trace(trace_t *trace)
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the five arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
 {
-	free(trace->ops);         /* free the three arrays... */
+	free(trace->ops);         /* free the five arrays... */
 	free(trace->blocks);
 	free(trace->block_sizes);
 	free(trace->block_rand_base);
+	free(trace->batch);
 	free(trace);              /* and the trace record itself... */
 }
 
@@ -749,9 +808,9 @@ static void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
-	int i;
-	int index;
-	size_t size;
+	int i, j;
+	int index, count;
+	size_t size, oldsize, newsize;
 	char *newp;
 	char *oldp;
 	char *p;
@@ -865,6 +924,94 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 				mm_free(p);
 				break;
 
+			case FREE_SIZED: /* mm_free_sized */
+				check_index(trace, i, index);
+
+				/* The usable size must cover what was asked for */
+				p = trace->blocks[index];
+				if (mm_usable_size(p) < trace->block_sizes[index]) {
+					malloc_error(trace, i, "mm_usable_size (%zu) is smaller "
+							"than the requested size (%zu).",
+							mm_usable_size(p), trace->block_sizes[index]);
+					return 0;
+				}
+
+				/* Remove region from list and call student's free function */
+				remove_range(ranges, p);
+				mm_free_sized(p, trace->block_sizes[index]);
+				break;
+
+			case GROW: /* mm_usable_size, falling back to mm_realloc */
+				check_index(trace, i, index);
+
+				oldp = trace->blocks[index];
+				if (mm_usable_size(oldp) < trace->block_sizes[index]) {
+					malloc_error(trace, i, "mm_usable_size (%zu) is smaller "
+							"than the requested size (%zu).",
+							mm_usable_size(oldp), trace->block_sizes[index]);
+					return 0;
+				}
+
+				/* Only reallocate when the slack cannot hold the new size */
+				oldsize = trace->block_sizes[index];
+				if (size <= mm_usable_size(oldp)) {
+					newp = oldp;
+				} else if ((newp = mm_realloc(oldp, size)) == NULL) {
+					malloc_error(trace, i, "mm_realloc failed.");
+					return 0;
+				}
+
+				/* A block that stays in place keeps its old size for
+				 * mm_free_sized, even when the trace shrinks it. */
+				newsize = size;
+				if (newp == oldp && oldsize > size) {
+					newsize = oldsize;
+				}
+
+				/* The grown region must not overlap any other payload */
+				remove_range(ranges, oldp);
+				if (add_range(ranges, newp, newsize, trace, i, index) == 0)
+					return 0;
+
+				/* Check up to min(size, oldsize) for correct copying. */
+				trace->blocks[index] = newp;
+				if(size < trace->block_sizes[index]) {
+					trace->block_sizes[index] = size;
+				}
+				check_index(trace, i, index);
+				trace->block_sizes[index] = newsize;
+
+				/* Set to random data, for debugging. */
+				randomize_block(trace, index);
+				break;
+
+			case ALLOC_BATCH: /* mm_malloc_batch */
+				count = trace->ops[i].count;
+				if (mm_malloc_batch(size, count,
+							(void **)&trace->blocks[index]) != (size_t)count) {
+					malloc_error(trace, i, "mm_malloc_batch failed.");
+					return 0;
+				}
+
+				/* Check and remember every block of the batch */
+				for (j = index; j < index + count; j++) {
+					if (add_range(ranges, trace->blocks[j], size, trace, i, j) == 0)
+						return 0;
+					trace->block_sizes[j] = size;
+					randomize_block(trace, j);
+				}
+				break;
+
+			case FREE_BATCH: /* mm_free_batch */
+				count = trace->ops[i].count;
+				for (j = 0; j < count; j++) {
+					check_index(trace, i, index + j);
+					trace->batch[j] = trace->blocks[index + j];
+					remove_range(ranges, trace->blocks[index + j]);
+				}
+				mm_free_batch(trace->batch, count);
+				break;
+
 			default:
 				app_error("Nonexistent request type in eval_mm_valid");
 		}
@@ -889,8 +1036,8 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  */
 static double eval_mm_util(trace_t *trace, int tracenum)
 {
-	int i;
-	int index;
+	int i, j;
+	int index, count;
 	int size, newsize, oldsize;
 	int max_total_size = 0;
 	int total_size = 0;
@@ -956,6 +1103,63 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 				total_size -= size;
 				break;
 
+			case FREE_SIZED: /* mm_free_sized */
+				index = trace->ops[i].index;
+				size = trace->block_sizes[index];
+				mm_free_sized(trace->blocks[index], size);
+
+				total_size -= size;
+				break;
+
+			case GROW: /* mm_usable_size, falling back to mm_realloc */
+				index = trace->ops[i].index;
+				newsize = trace->ops[i].size;
+				oldsize = trace->block_sizes[index];
+
+				oldp = trace->blocks[index];
+				if ((size_t)newsize <= mm_usable_size(oldp)) {
+					newp = oldp;
+				} else if ((newp = mm_realloc(oldp, newsize)) == NULL) {
+					app_error("trace %d: mm_realloc failed in eval_mm_util",
+							tracenum);
+				}
+
+				/* Remember region and size; in place, the payload
+				 * keeps the larger size until it is freed */
+				if (newp == oldp && oldsize > newsize) {
+					newsize = oldsize;
+				}
+				trace->blocks[index] = newp;
+				trace->block_sizes[index] = newsize;
+
+				total_size += (newsize - oldsize);
+				break;
+
+			case ALLOC_BATCH: /* mm_malloc_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				size = trace->ops[i].size;
+				if (mm_malloc_batch(size, count,
+							(void **)&trace->blocks[index]) != (size_t)count) {
+					app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+							tracenum);
+				}
+				for (j = index; j < index + count; j++)
+					trace->block_sizes[j] = size;
+
+				total_size += size * count;
+				break;
+
+			case FREE_BATCH: /* mm_free_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				for (j = 0; j < count; j++) {
+					trace->batch[j] = trace->blocks[index + j];
+					total_size -= trace->block_sizes[index + j];
+				}
+				mm_free_batch(trace->batch, count);
+				break;
+
 			default:
 				app_error("trace %d: Nonexistent request type in eval_mm_util",
 						tracenum);
@@ -979,7 +1183,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
+	int i, j, index, size, newsize, count;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 	reinit_trace(trace);
@@ -999,6 +1203,7 @@ static void eval_mm_speed(void *ptr)
 				if ((p = mm_malloc(size)) == NULL)
 					app_error("mm_malloc error in eval_mm_speed");
 				trace->blocks[index] = p;
+				trace->block_sizes[index] = size;
 				break;
 
 			case REALLOC: /* mm_realloc */
@@ -1008,6 +1213,7 @@ static void eval_mm_speed(void *ptr)
 				if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
 					app_error("mm_realloc error in eval_mm_speed");
 				trace->blocks[index] = newp;
+				trace->block_sizes[index] = newsize;
 				break;
 
 			case FREE: /* mm_free */
@@ -1020,6 +1226,44 @@ static void eval_mm_speed(void *ptr)
 				mm_free(block);
 				break;
 
+			case FREE_SIZED: /* mm_free_sized */
+				index = trace->ops[i].index;
+				mm_free_sized(trace->blocks[index], trace->block_sizes[index]);
+				break;
+
+			case GROW: /* mm_usable_size, falling back to mm_realloc */
+				index = trace->ops[i].index;
+				newsize = trace->ops[i].size;
+				oldp = trace->blocks[index];
+				if ((size_t)newsize > mm_usable_size(oldp)) {
+					if ((newp = mm_realloc(oldp, newsize)) == NULL)
+						app_error("mm_realloc error in eval_mm_speed");
+					trace->blocks[index] = newp;
+					trace->block_sizes[index] = newsize;
+				} else if ((size_t)newsize > trace->block_sizes[index]) {
+					/* In place, keep the larger size for mm_free_sized */
+					trace->block_sizes[index] = newsize;
+				}
+				break;
+
+			case ALLOC_BATCH: /* mm_malloc_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				size = trace->ops[i].size;
+				if (mm_malloc_batch(size, count,
+							(void **)&trace->blocks[index]) != (size_t)count)
+					app_error("mm_malloc_batch error in eval_mm_speed");
+				for (j = index; j < index + count; j++)
+					trace->block_sizes[j] = size;
+				break;
+
+			case FREE_BATCH: /* mm_free_batch */
+				index = trace->ops[i].index;
+				count = trace->ops[i].count;
+				memcpy(trace->batch, &trace->blocks[index], count * sizeof(void *));
+				mm_free_batch(trace->batch, count);
+				break;
+
 			default:
 				app_error("Nonexistent request type in eval_mm_speed");
 		}
@@ -1033,7 +1277,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace)
 {
-	int i, newsize;
+	int i, j, newsize;
 	char *p, *newp, *oldp;
 
 	reinit_trace(trace);
@@ -1060,6 +1304,7 @@ static int eval_libc_valid(trace_t *trace)
 				break;
 
 			case FREE: /* free */
+			case FREE_SIZED: /* libc has no sized free; use free */
 				if(trace->ops[i].index >= 0) {
 					free(trace->blocks[trace->ops[i].index]);
 				} else {
@@ -1067,6 +1312,31 @@ static int eval_libc_valid(trace_t *trace)
 				}
 				break;
 
+			case GROW: /* libc has no portable usable size; use realloc */
+				newsize = trace->ops[i].size;
+				oldp = trace->blocks[trace->ops[i].index];
+				if ((newp = realloc(oldp, newsize)) == NULL) {
+					malloc_error(trace, i, "libc realloc failed");
+					unix_error("System message");
+				}
+				trace->blocks[trace->ops[i].index] = newp;
+				break;
+
+			case ALLOC_BATCH: /* libc has no batch malloc; use malloc */
+				for (j = 0; j < trace->ops[i].count; j++) {
+					if ((p = malloc(trace->ops[i].size)) == NULL) {
+						malloc_error(trace, i, "libc malloc failed");
+						unix_error("System message");
+					}
+					trace->blocks[trace->ops[i].index + j] = p;
+				}
+				break;
+
+			case FREE_BATCH: /* libc has no batch free; use free */
+				for (j = 0; j < trace->ops[i].count; j++)
+					free(trace->blocks[trace->ops[i].index + j]);
+				break;
+
 			default:
 				app_error("invalid operation type  in eval_libc_valid");
 		}
@@ -1082,7 +1352,7 @@ static int eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-	int i;
+	int i, j;
 	int index, size, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
@@ -1110,6 +1380,7 @@ static void eval_libc_speed(void *ptr)
 				break;
 
 			case FREE: /* free */
+			case FREE_SIZED: /* libc has no sized free; use free */
 				index = trace->ops[i].index;
 				if(index >= 0) {
 					block = trace->blocks[index];
@@ -1118,6 +1389,32 @@ static void eval_libc_speed(void *ptr)
 					free(0);
 				}
 				break;
+
+			case GROW: /* libc has no portable usable size; use realloc */
+				index = trace->ops[i].index;
+				newsize = trace->ops[i].size;
+				oldp = trace->blocks[index];
+				if ((newp = realloc(oldp, newsize)) == NULL)
+					unix_error("realloc failed in eval_libc_speed\n");
+
+				trace->blocks[index] = newp;
+				break;
+
+			case ALLOC_BATCH: /* libc has no batch malloc; use malloc */
+				index = trace->ops[i].index;
+				size = trace->ops[i].size;
+				for (j = 0; j < trace->ops[i].count; j++) {
+					if ((p = malloc(size)) == NULL)
+						unix_error("malloc failed in eval_libc_speed");
+					trace->blocks[index + j] = p;
+				}
+				break;
+
+			case FREE_BATCH: /* libc has no batch free; use free */
+				index = trace->ops[i].index;
+				for (j = 0; j < trace->ops[i].count; j++)
+					free(trace->blocks[index + j]);
+				break;
 		}
 	}
 }
@@ -1135,36 +1432,40 @@ static void printresults(int n, stats_t *stats)
 	int i;
 	/* weighted sums all */
 	double sumsecs = 0;
+	double sumerr  = 0; /* sum of squared errors */
 	double sumops  = 0;
 	double sumutil = 0;
 	int sumweight = 0;
 
 	/* Print the individual results for each trace */
-	printf("  %6s%6s %5s%8s%9s  %s\n",
-			"valid", "util", "ops", "secs", "Kops", "trace");
+	printf("  %6s%6s %5s%8s%11s%7s  %s\n",
+			"valid", "util", "ops", "secs", "Kops", "+/-", "trace");
 	for (i=0; i < n; i++) {
 		if (stats[i].valid) {
-			printf("%2s%4s %5.0f%%%8.0f%10.6f%6.0f %s\n",
+			printf("%2s%4s %5.0f%%%8.0f%10.6f%8.0f%6.1f%% %s\n",
 					stats[i].weight != 0 ? "*" : "",
 					"yes",
 					stats[i].util*100.0,
 					stats[i].ops,
 					stats[i].secs,
 					(stats[i].ops/1e3)/stats[i].secs,
+					stats[i].err/stats[i].secs*100.0,
 					stats[i].filename);
 			sumweight += stats[i].weight;
 			sumsecs += stats[i].secs * stats[i].weight;
+			sumerr += stats[i].err * stats[i].err * stats[i].weight;
 			sumops += stats[i].ops * stats[i].weight;
 			sumutil += stats[i].util * stats[i].weight;
 		}
 		else {
-			printf("%2s%4s %6s%8s%9s%6s %s\n",
+			printf("%2s%4s %6s%8s%10s%8s%7s %s\n",
 					stats[i].weight != 0 ? "*" : "",
 					"no",
 					"-",
 					"-",
 					"-",
 					"-",
+					"-",
 					stats[i].filename);
 		}
 	}
@@ -1173,15 +1474,18 @@ static void printresults(int n, stats_t *stats)
 	if (errors == 0) {
 		if(sumweight == 0) sumweight = 1;
 
-		printf("%2d     %5.0f%%%8.0f%10.6f%6.0f\n",
+		printf("%2d     %5.0f%%%8.0f%10.6f%8.0f%6.1f%%\n",
 				sumweight,
 				(sumutil/(double)sumweight)*100.0,
 				sumops,
 				sumsecs,
-				(sumsecs==0.0) ? 0 : (sumops/1e3)/sumsecs);
+				(sumsecs==0.0) ? 0 : (sumops/1e3)/sumsecs,
+				(sumsecs==0.0) ? 0 : sqrt(sumerr)/sumsecs*100.0);
 	}
 	else {
-		printf("       %8s%10s%6s\n",
+		printf("       %6s%8s%10s%8s%7s\n",
+				"-",
+				"-",
 				"-",
 				"-",
 				"-");
@@ -1235,7 +1539,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
 static void usage(void)
 {
 	fprintf(stderr,
-		"Usage: mdriver [-hlD] [-d <i>] [-t <dir>] [-c <file>] [-f <file>]\n"
+		"Usage: mdriver [-hlD] [-d <i>] [-t <dir>] [-c <file>] [-f <file>] [-p <cpu>]\n"
 		"Options\n"
 		"\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n"
 		"\t-D         Equivalent to -d2.\n"
@@ -1244,5 +1548,6 @@ static void usage(void)
 		"\t-h         Print this message.\n"
 		"\t-l         Run libc malloc as well.\n"
 		"\t-f <file>  Use <file> as the trace file.\n"
+		"\t-p <cpu>   Pin the driver to CPU <cpu> while timing.\n"
 	);
 }
@@ -21,6 +21,11 @@ the program could reuse for calls to malloc, the program searches the list from
 the front first. This means the implementation uses a first in first out
 approach. When an appropriate block is found, the program attempts to split it
 into two smaller blocks so the remaining portion of memory can be reused.
+
+A remainder too small to hold the free list pointers becomes a "fragment": a
+free block of just a header and footer, which is left out of the free list
+until a neighbor is freed and coalesces with it. So every allocated block has
+exactly the size that its request calls for, which mm_free_sized relies on.
 */
 
 #include <assert.h>
@@ -79,7 +84,7 @@ static block_t *free_block_last = NULL;
 
 // Returns true if ptr is between mem_heap_lo and mem_heap_hi, false otherwise
 static bool ptr_in_range(void *ptr){
-    return ptr != NULL && (char*)ptr - (char*)mem_heap_lo >= 0 && (char*)mem_heap_hi() - (char*)ptr >= 0;
+    return ptr != NULL && (char*)ptr - (char*)mem_heap_lo() >= 0 && (char*)mem_heap_hi() - (char*)ptr >= 0;
 }
 
 // Returns the smallest integer above size which is a multiple of n
@@ -237,12 +242,31 @@ static void add_to_start_free_list(block_t *free_block){
     }
 }
 
+// Returns true if a free block is in the free list, which fragments are not
+static bool is_listed(block_t *free_block){
+    return get_size(free_block) >= get_block_size(1);
+}
+
+// Adds a free block which is not linked to anything yet to the free list
+static void add_new_free_block(block_t *free_block){
+    free_list_t *free_list = free_list_ptr(free_block);
+    free_list->next = NULL;
+    free_list->prev = NULL;
+    add_to_start_free_list(free_block);
+}
+
 // free_block_1 and free_block_2 are assumed to both be free blocks
 // Makes free_block_1 a larger block which includes the size of free_block_2
 static block_t *coalesce_adjacent_blocks(block_t *free_block_1, block_t *free_block_2){
     dbg_printf("Going to coalesced block %p with %p\n", free_block_1, free_block_2);
-    remove_from_free_list(free_block_2);
+    if (is_listed(free_block_2)){
+        remove_from_free_list(free_block_2);
+    }
+    bool was_listed = is_listed(free_block_1);
     set_header_and_footer(free_block_1, get_size(free_block_1) + get_size(free_block_2), false);
+    if (!was_listed){
+        add_new_free_block(free_block_1);
+    }
 
     if (heap_last == free_block_2){
         heap_last = free_block_1;
@@ -267,32 +291,35 @@ static void coalesce_free_block(block_t* free_block){
     }
 }
 
-// Tries to split free_block into a block of new_block_size if possible
-// It is only possible if the remaining block would have enough space to be
-// a valid block which can contain some amount of bytes
-// If a split does occur, free_block now has size new_block_size whose next
-// block is a free block with the remaining size
+// Splits block into a block of new_block_size followed by a free block with
+// the remaining size, if there is any. The remainder goes in the free list
+// unless it is a fragment. Returns the remainder, or NULL if there is none.
+static block_t *split_off(block_t *block, size_t new_block_size){
+    size_t old_block_size = get_size(block);
+    if (old_block_size == new_block_size){
+        return NULL;
+    }
+    dbg_printf("Can split, Old size: %zu\tNew size: %zu\n", old_block_size, new_block_size);
+    size_t remaining_block_size = old_block_size - new_block_size;
+    set_header_and_footer(block, new_block_size, get_allocated(block));
+    block_t *new_block = (block_t*)((char*)block + new_block_size);
+    dbg_printf("Remaining block address: %p\n", new_block);
+    set_header_and_footer(new_block, remaining_block_size, false);
+    if (is_listed(new_block)){
+        add_new_free_block(new_block);
+    }
+    if(heap_last == block){
+        heap_last = new_block;
+    }
+    return new_block;
+}
+
+// Takes free_block out of the free list and splits it into a block of
+// new_block_size, leaving the rest free
 static void split(block_t *free_block, size_t new_block_size){
     dbg_printf("Trying to split block: %p...\n", free_block);
-    size_t old_block_size = get_size(free_block);
     remove_from_free_list(free_block);
-    if (old_block_size - new_block_size >= get_block_size(1)){
-        dbg_printf("Can split, Old size: %zu\tNew size: %zu\n", old_block_size, new_block_size);
-        size_t remaining_block_size = old_block_size - new_block_size;
-        set_header_and_footer(free_block, new_block_size, false);
-        block_t *new_block = (block_t*)((char*)free_block + new_block_size);
-        dbg_printf("Remaining block address: %p\n", new_block);
-        set_header_and_footer(new_block, remaining_block_size, false);
-
-        free_list_t *new_block_free_list = free_list_ptr(new_block);
-        new_block_free_list->prev = NULL;
-        new_block_free_list->next = NULL;
-
-        add_to_start_free_list(new_block);
-        if(heap_last == free_block){
-            heap_last = new_block;
-        }
-    }
+    split_off(free_block, new_block_size);
 }
 
 // Returns a free block of the appropriate size (block_size) if it exists in
@@ -364,6 +391,139 @@ void free(void *ptr) {
     }
 }
 
+// Marks a pointer as no longer in use when the caller already knows its size.
+// Unlike free, ptr must be a live pointer returned by malloc, realloc or calloc
+// (not NULL), so the range check is skipped. Allocated blocks always have the
+// size that get_block_size gives for their request, so the header is not read
+// except to check it under assert. size must be the size last passed to
+// malloc or realloc for ptr or, if the caller used the slack reported by
+// mm_usable_size, any size up to mm_usable_size(ptr): every size in between
+// gives the same block size.
+void mm_free_sized(void *ptr, size_t size) {
+    block_t *block = (block_t*)((char*)ptr - sizeof(block_t));
+    size_t block_size = get_block_size(size);
+    dbg_printf("Starting to free %p with size %zu...\n", block, size);
+    assert(block->header == (block_size | 0x1));
+    set_header_and_footer(block, block_size, false);
+
+    free_list_t *new_last_free_list = free_list_ptr(block);
+    new_last_free_list->next = NULL;
+    new_last_free_list->prev = NULL;
+
+    add_to_start_free_list(block);
+    coalesce_free_block(block);
+}
+
+// Returns the number of bytes that can be stored at ptr, which is at least the
+// size that was requested for it. Returns 0 for NULL.
+size_t mm_usable_size(void *ptr) {
+    if (ptr == NULL){
+        return 0;
+    }
+    block_t *block = (block_t*)((char*)ptr - sizeof(block_t));
+    return get_size(block) - sizeof(block_t) - sizeof(footer_t);
+}
+
+// Writes block headers for n consecutive blocks of block_size starting at
+// start; all n blocks are block_size. Returns the last block so the caller
+// can fix up heap_last.
+static block_t *carve_blocks(block_t *start, size_t block_size, size_t n,
+                             void **out){
+    block_t *block = start;
+    for(size_t i = 0; i < n - 1; i++){
+        set_header_and_footer(block, block_size, true);
+        out[i] = block->payload;
+        block = (block_t*)((char*)block + block_size);
+    }
+    set_header_and_footer(block, block_size, true);
+    out[n - 1] = block->payload;
+    return block;
+}
+
+// Allocates n blocks of size bytes each, storing the pointers in out.
+// All n blocks are carved from a single free block (or a single call to
+// mem_sbrk), so the free list is searched and relinked only once.
+// Returns n on success and 0 if the blocks could not be allocated, in which
+// case nothing is allocated.
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    dbg_printf("Starting to batch malloc %zu x %zu...\n", n, size);
+    if (n == 0){
+        return 0;
+    }
+    size_t block_size = get_block_size(size);
+    if (block_size > SIZE_MAX / n){
+        return 0;
+    }
+    size_t total_size = block_size * n;
+    block_t *start = find_fit(total_size);
+    if (start == NULL){
+        start = mem_sbrk(total_size);
+        if ((long) start < 0) {
+            return 0;
+        }
+        heap_last = start;
+    }
+    if(!heap_first){
+        heap_first = start;
+    }
+    bool was_last = heap_last == start;
+    block_t *last = carve_blocks(start, block_size, n, out);
+    if (was_last){
+        heap_last = last;
+    }
+    return n;
+}
+
+static int compare_addresses(const void *a, const void *b){
+    uintptr_t x = (uintptr_t)*(void * const *)a;
+    uintptr_t y = (uintptr_t)*(void * const *)b;
+    return (x > y) - (x < y);
+}
+
+// Frees the n pointers in ptrs. ptrs is sorted by address in place so that
+// runs of blocks which are adjacent in the heap are merged into a single
+// free block before it is linked into the free list and coalesced with its
+// neighbors. NULL and out of range pointers are ignored, as in free.
+void mm_free_batch(void **ptrs, size_t n) {
+    dbg_printf("Starting to batch free %zu pointers...\n", n);
+    // Batches usually come straight from mm_malloc_batch and are sorted already
+    for (size_t i = 1; i < n; i++){
+        if ((uintptr_t)ptrs[i - 1] > (uintptr_t)ptrs[i]){
+            qsort(ptrs, n, sizeof(void*), compare_addresses);
+            break;
+        }
+    }
+    size_t i = 0;
+    while (i < n){
+        if (!ptr_in_range(ptrs[i])){
+            i++;
+            continue;
+        }
+        block_t *run_first = (block_t*)((char*)ptrs[i] - sizeof(block_t));
+        block_t *run_last = run_first;
+        size_t run_size = get_size(run_first);
+        for (i++; i < n; i++){
+            block_t *next = next_block(run_last);
+            if (next == NULL || ptrs[i] != (void*)next->payload){
+                break;
+            }
+            run_last = next;
+            run_size += get_size(run_last);
+        }
+        set_header_and_footer(run_first, run_size, false);
+        if (heap_last == run_last){
+            heap_last = run_first;
+        }
+
+        free_list_t *new_free_list = free_list_ptr(run_first);
+        new_free_list->next = NULL;
+        new_free_list->prev = NULL;
+
+        add_to_start_free_list(run_first);
+        coalesce_free_block(run_first);
+    }
+}
+
 // Copies the data from old_ptr to a new block which has size size.
 void *realloc(void *old_ptr, size_t size) {
     dbg_printf("Realloccing...\n");
@@ -378,7 +538,13 @@ void *realloc(void *old_ptr, size_t size) {
 
     block_t *block = old_ptr - offsetof(block_t, payload);
     size_t old_size = get_size(block);
-    if(old_size >= get_block_size(size)){
+    size_t block_size = get_block_size(size);
+    if(old_size >= block_size){
+        // Shrink in place, so that the block keeps the size of its request
+        block_t *tail = split_off(block, block_size);
+        if (tail != NULL){
+            coalesce_free_block(tail);
+        }
         return old_ptr;
     }
 
@@ -450,7 +616,7 @@ void mm_checkheap(int lineno) {
             printf("ERROR: Header and Footer are not equal at line %d\n", lineno);
             exit(1);
         }
-        if(!get_allocated(current_block)){
+        if(!get_allocated(current_block) && is_listed(current_block)){
             //Check if an unallocated block is in the free list
             bool is_in_list = false;
             for(block_t *curr_free_block = free_block_first; curr_free_block != NULL; curr_free_block = next_free_block(curr_free_block)){
@@ -460,13 +626,14 @@ void mm_checkheap(int lineno) {
                 printf("ERROR: Found a free block that is not in the list at line %d\n", lineno);
                 exit(1);
             }
-
+            num_free_blocks++;
+        }
+        if(!get_allocated(current_block)){
             //Make sure there are no two consecutive free blocks
             if(!prev_block_allocated){
                 printf("ERROR: Found two adjacent free blocks at line %d\n", lineno);
                 exit(1);
             }
-            num_free_blocks++;
         }
         prev_block_allocated = get_allocated(current_block);
     }
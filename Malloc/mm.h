@@ -20,6 +20,18 @@ extern void *calloc(size_t nmemb, size_t size);
 
 extern int mm_init(void);
 
+/* Sized free and usable-size queries. mm_free_sized requires a live, non-NULL
+   pointer and the size last requested for it from mm_malloc or mm_realloc.
+   A caller that used the slack may pass any size up to mm_usable_size(ptr)
+   instead, but never less than the requested size. */
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/* Batch allocation and release of many same-sized objects. mm_malloc_batch
+   returns n on success and 0 on failure; mm_free_batch sorts ptrs. */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);